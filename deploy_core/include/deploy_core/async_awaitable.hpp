@@ -0,0 +1,119 @@
+#pragma once
+
+/**
+ * @brief Opt-in C++20 coroutine layer of the async pipeline. It is compiled only when the
+ * translation unit is built with C++20 or later, and `EASY_DEPLOY_HAS_COROUTINE` is defined then.
+ *
+ */
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+
+#define EASY_DEPLOY_HAS_COROUTINE 1
+
+#include <coroutine>
+#include <functional>
+#include <memory>
+#include <utility>
+
+#include "deploy_core/async_completion.hpp"
+#include "deploy_core/pipeline_executor.hpp"
+
+namespace easy_deploy {
+
+/**
+ * @brief Awaitable of an async request, e.g. `co_await DetectAwait(*model, image, 0.4)`. The
+ * request is pushed when the coroutine is suspended, and the coroutine is resumed on `executor`
+ * once the request is completed, so the requests in flight do not hold any thread.
+ *
+ * `co_await` returns the result, or throws `AsyncPipelineException` with the final status if the
+ * request is not finished with `SUCCESS` or could not be pushed.
+ *
+ * @tparam ResultType
+ */
+template <typename ResultType>
+class AsyncResultAwaitable {
+public:
+  /**
+   * @brief Functor which pushes the request with the given completion, return false if the
+   * request is not pushed.
+   *
+   */
+  using Starter_t = std::function<bool(const AsyncCompletion<ResultType> &)>;
+
+  /**
+   * @brief Construct the awaitable.
+   *
+   * @param start
+   * @param executor resume the coroutine on it. If nullptr, the coroutine is resumed on the
+   * pipeline thread which completes the request, it should not block then.
+   */
+  AsyncResultAwaitable(Starter_t start, std::shared_ptr<IPipelineExecutor> executor)
+      : start_(std::move(start)), executor_(std::move(executor))
+  {}
+
+  bool await_ready() const noexcept
+  {
+    return false;
+  }
+
+  bool await_suspend(std::coroutine_handle<> handle)
+  {
+    // the completion may run before `start_` returns, do not touch `this` after pushing
+    AsyncCompletion<ResultType> completion([this, handle](PackageStatus  status,
+                                                          ResultType   &&result) {
+      auto executor = executor_;
+      status_       = status;
+      result_       = std::move(result);
+      if (executor != nullptr)
+      {
+        executor->Submit([handle]() { handle.resume(); });
+      } else
+      {
+        handle.resume();
+      }
+    });
+    // the awaitable may be destroyed by the resumed coroutine while `start` is still running
+    auto start = std::move(start_);
+    pushed_    = true;
+    if (!start(completion))
+    {
+      // not pushed, resume at once
+      pushed_ = false;
+      return false;
+    }
+    return true;
+  }
+
+  ResultType await_resume()
+  {
+    if (!pushed_)
+    {
+      throw AsyncPipelineException(PackageStatus::DROPPED,
+                                   "[AsyncResultAwaitable] request is not pushed");
+    }
+    if (status_ != PackageStatus::SUCCESS)
+    {
+      throw AsyncPipelineException(status_, status_ == PackageStatus::TIMEOUT
+                                                ? "[AsyncResultAwaitable] request expired deadline"
+                                            : status_ == PackageStatus::FAILED
+                                                ? "[AsyncResultAwaitable] request failed"
+                                            : status_ == PackageStatus::CANCELLED
+                                                ? "[AsyncResultAwaitable] request is cancelled"
+                                            : status_ == PackageStatus::REJECTED
+                                                ? "[AsyncResultAwaitable] request is rejected"
+                                                : "[AsyncResultAwaitable] request is dropped");
+    }
+    return std::move(result_);
+  }
+
+private:
+  Starter_t                          start_;
+  std::shared_ptr<IPipelineExecutor> executor_;
+
+  bool          pushed_ = false;
+  PackageStatus status_ = PackageStatus::SUCCESS;
+  ResultType    result_{};
+};
+
+} // namespace easy_deploy
+
+#endif
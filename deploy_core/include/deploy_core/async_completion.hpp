@@ -0,0 +1,271 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <utility>
+
+#include "common_utils/log.hpp"
+#include "deploy_core/async_pipeline_impl.hpp"
+
+namespace easy_deploy {
+
+/**
+ * @brief One completed request delivered by `AsyncCompletionQueue`.
+ *
+ * @tparam ResultType
+ */
+template <typename ResultType>
+struct AsyncCompletionEntry {
+  // the tag given when the request is pushed
+  uint64_t tag = 0;
+  // the final status, `result` is only valid with `SUCCESS`
+  PackageStatus status = PackageStatus::SUCCESS;
+  ResultType    result{};
+};
+
+/**
+ * @brief A bounded lock-free multi-producer/multi-consumer queue of completed requests, so an
+ * event loop could poll the results of many requests without parking one thread per request.
+ *
+ * The pipeline threads push the results as soon as the requests are completed. If the queue is
+ * full, they yield until the consumer takes some, and drop the result after `kPushTimeout`, so
+ * `capacity` should be larger than the number of requests in flight. An optional notifier is
+ * called after each push, e.g. to write an `eventfd` watched by the event loop.
+ *
+ * @tparam ResultType
+ */
+template <typename ResultType>
+class AsyncCompletionQueue {
+public:
+  using Entry_t = AsyncCompletionEntry<ResultType>;
+
+  // max time a pipeline thread waits on the full queue before it drops the result
+  static constexpr std::chrono::milliseconds kPushTimeout{100};
+
+  /**
+   * @brief Construct the queue.
+   *
+   * @param capacity rounded up to the power of 2.
+   * @param notifier called by the pipeline threads after each push, should not block. default
+   * is none.
+   */
+  explicit AsyncCompletionQueue(size_t capacity, std::function<void()> notifier = nullptr)
+      : mask_(RoundUpPowerOf2(capacity) - 1),
+        cells_(new Cell[mask_ + 1]),
+        notifier_(std::move(notifier))
+  {
+    for (size_t i = 0; i <= mask_; ++i)
+    {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  AsyncCompletionQueue(const AsyncCompletionQueue &)            = delete;
+  AsyncCompletionQueue &operator=(const AsyncCompletionQueue &) = delete;
+
+  /**
+   * @brief Push a completed request, yield while the queue is full. If it is still full after
+   * `kPushTimeout`, the request is dropped and counted by `GetDroppedCount`.
+   *
+   * @return true
+   * @return false if the request is dropped.
+   */
+  bool Push(Entry_t entry) noexcept
+  {
+    if (!TryPush(entry))
+    {
+      const auto timeout = std::chrono::steady_clock::now() + kPushTimeout;
+      while (!TryPush(entry))
+      {
+        if (std::chrono::steady_clock::now() > timeout)
+        {
+          dropped_.fetch_add(1, std::memory_order_relaxed);
+          LOG_ERROR("[AsyncCompletionQueue] queue is full, drop the request of tag {%lu}!",
+                    entry.tag);
+          return false;
+        }
+        std::this_thread::yield();
+      }
+    }
+    if (notifier_ != nullptr)
+    {
+      try
+      {
+        notifier_();
+      } catch (const std::exception &e)
+      {
+        LOG_ERROR("[AsyncCompletionQueue] notifier got exception : %s", e.what());
+      } catch (...)
+      {
+        LOG_ERROR("[AsyncCompletionQueue] notifier got unknown exception!");
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief Push a completed request if the queue is not full.
+   *
+   * @return true
+   * @return false if the queue is full, `entry` is left unchanged.
+   */
+  bool TryPush(Entry_t &entry) noexcept
+  {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true)
+    {
+      Cell     &cell = cells_[pos & mask_];
+      size_t    seq  = cell.sequence.load(std::memory_order_acquire);
+      ptrdiff_t diff = static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos);
+      if (diff == 0)
+      {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          cell.entry = std::move(entry);
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0)
+      {
+        return false;
+      } else
+      {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /**
+   * @brief Take a completed request if any; else return std::nullopt.
+   *
+   */
+  std::optional<Entry_t> TryPop() noexcept
+  {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true)
+    {
+      Cell     &cell = cells_[pos & mask_];
+      size_t    seq  = cell.sequence.load(std::memory_order_acquire);
+      ptrdiff_t diff = static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos + 1);
+      if (diff == 0)
+      {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          std::optional<Entry_t> ret(std::move(cell.entry));
+          cell.entry = Entry_t();
+          cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+          return ret;
+        }
+      } else if (diff < 0)
+      {
+        return std::nullopt;
+      } else
+      {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /**
+   * @brief Return a snapshot of the number of completed requests in the queue.
+   *
+   */
+  size_t Size() const noexcept
+  {
+    const size_t enqueue = enqueue_pos_.load(std::memory_order_relaxed);
+    const size_t dequeue = dequeue_pos_.load(std::memory_order_relaxed);
+    return enqueue > dequeue ? enqueue - dequeue : 0;
+  }
+
+  size_t GetCapacity() const noexcept
+  {
+    return mask_ + 1;
+  }
+
+  /**
+   * @brief Return the number of requests dropped because the queue stayed full.
+   *
+   */
+  size_t GetDroppedCount() const noexcept
+  {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    Entry_t             entry;
+  };
+
+  static size_t RoundUpPowerOf2(size_t n)
+  {
+    size_t ret = 2;
+    while (ret < n) ret <<= 1;
+    return ret;
+  }
+
+  const size_t            mask_;
+  std::unique_ptr<Cell[]> cells_;
+  std::function<void()>   notifier_;
+
+  // the producers and the consumers do not share cache lines
+  alignas(64) std::atomic<size_t> enqueue_pos_{0};
+  alignas(64) std::atomic<size_t> dequeue_pos_{0};
+  std::atomic<size_t> dropped_{0};
+};
+
+/**
+ * @brief The completion handle of an async request, as an alternative to `std::future`. The
+ * result is delivered either to a callback or to an `AsyncCompletionQueue` with a tag, directly
+ * from the pipeline thread which completes the request.
+ *
+ * The callback runs on the pipeline threads, it should be short and never block, e.g. post the
+ * result to an event loop.
+ *
+ * @tparam ResultType
+ */
+template <typename ResultType>
+class AsyncCompletion {
+public:
+  /**
+   * @brief `result` is only valid with `SUCCESS` status, else it is default-constructed.
+   *
+   */
+  using Callback_t = std::function<void(PackageStatus status, ResultType &&result)>;
+
+  explicit AsyncCompletion(Callback_t callback) : callback_(std::move(callback))
+  {}
+
+  AsyncCompletion(AsyncCompletionQueue<ResultType> &queue, uint64_t tag)
+      : queue_(&queue), tag_(tag)
+  {}
+
+  bool IsValid() const noexcept
+  {
+    return queue_ != nullptr || callback_ != nullptr;
+  }
+
+  void operator()(PackageStatus status, ResultType &&result) const
+  {
+    if (queue_ != nullptr)
+    {
+      queue_->Push({tag_, status, std::move(result)});
+    } else
+    {
+      callback_(status, std::move(result));
+    }
+  }
+
+private:
+  Callback_t                        callback_;
+  AsyncCompletionQueue<ResultType> *queue_ = nullptr;
+  uint64_t                          tag_   = 0;
+};
+
+} // namespace easy_deploy
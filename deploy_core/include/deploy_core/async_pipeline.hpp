@@ -1,13 +1,16 @@
 #pragma once
 
+#include <atomic>
 #include <functional>
 #include <future>
 #include <memory>
 #include <thread>
 #include <unordered_map>
 
+#include "deploy_core/async_completion.hpp"
 #include "deploy_core/async_pipeline_impl.hpp"
 #include "deploy_core/blob_buffer.hpp"
+#include "deploy_core/pipeline_memory_pool.hpp"
 #include "common_utils/block_queue.hpp"
 
 namespace easy_deploy {
@@ -31,13 +34,32 @@ protected:
   virtual ~IPipelinePackage() = default;
 };
 
+/**
+ * @brief Heap allocation statistics of the request path in `BaseAsyncPipeline`, which covers the
+ * request slots, the promise shared states and the package headers.
+ *
+ */
+struct AsyncPipelineAllocStats {
+  // number of packages pushed into pipelines
+  size_t request_count = 0;
+  // number of heap allocations, grows only when the pools grow
+  size_t heap_allocations = 0;
+
+  double GetAllocationsPerRequest() const noexcept
+  {
+    return request_count == 0 ? 0. : static_cast<double>(heap_allocations) / request_count;
+  }
+};
+
 /**
  * @brief This base class provides a simple implementation of the asynchronous inference
  * pipeline which could be plug-and-play.
  *
  * `BaseAsyncPipeline` takes function instance as a basic unit `Block` of the pipeline. User should
  * call the static method `BuildPipelineBlock` to construct a `Block`. Multiple `Block`s make up
- * a `Context`, which pipeline deploys the whole process on.
+ * a `Context`, which pipeline deploys the whole process on. The blocks run one after another by
+ * default. Blocks declaring their parents by `SetDependencies` make a DAG, the independent
+ * branches run concurrently on the same package, so they should write disjoint fields of it.
  *
  * @tparam ResultType
  * @tparam GenResult
@@ -70,18 +92,93 @@ protected:
     return Block_t(func, block_name);
   }
 
+  /**
+   * @brief Build a `Block` which is executed by `parallelism` worker threads. Use it for cpu-heavy
+   * and thread-safe blocks, e.g. image resize or nms. The order of packages is kept by a reorder
+   * buffer, set `keep_order` to false if the order does not matter.
+   *
+   * @param func
+   * @param block_name
+   * @param parallelism
+   * @param keep_order default=true.
+   * @return Block_t
+   */
+  static Block_t BuildPipelineBlock(const std::function<bool(ParsingType)> &func,
+                                    const std::string                      &block_name,
+                                    int                                     parallelism,
+                                    bool                                    keep_order = true)
+  {
+    return Block_t(func, block_name, parallelism, keep_order);
+  }
+
+  /**
+   * @brief Build a batch `Block` which calls `func` once on up to `max_batch_size` packages, e.g.
+   * to run one batched inference for several requests. It waits at most `max_wait_us` for a full
+   * batch after the first package arrives. A batch block runs on its own dedicated thread.
+   *
+   * @param func
+   * @param block_name
+   * @param max_batch_size
+   * @param max_wait_us
+   * @return Block_t
+   */
+  static Block_t BuildPipelineBatchBlock(
+      const std::function<bool(const std::vector<ParsingType> &)> &func,
+      const std::string                                           &block_name,
+      int                                                          max_batch_size,
+      int                                                          max_wait_us)
+  {
+    return Block_t(func, block_name, max_batch_size, max_wait_us);
+  }
+
   /**
    * @brief Configure the pipelien with a `pipeline_name` and multiple `Context_t` instances. One
-   * derived class intance could have sereral pipelines by calling `ConfigPipeline`.
+   * derived class intance could have sereral pipelines by calling `ConfigPipeline`. A configured
+   * pipeline could be configured again before it is initialized.
    *
    * @param pipeline_name
    * @param block_list
    */
   void ConfigPipeline(const std::string &pipeline_name, const std::vector<Context_t> &block_list)
   {
+    auto iter = map_name2instance_.find(pipeline_name);
+    if (iter != map_name2instance_.end())
+    {
+      if (iter->second.IsInitialized())
+      {
+        LOG_ERROR("[BaseAsyncPipeline] `ConfigPipeline` pipeline {%s} is already initialized !!!",
+                  pipeline_name.c_str());
+        return;
+      }
+      map_name2instance_.erase(iter);
+    }
     map_name2instance_.emplace(pipeline_name, block_list);
   }
 
+  /**
+   * @brief Allocate a resource which is held by the packages in pipeline, e.g. the blobs buffer.
+   * With `cover_oldest`, the oldest pending packages are dropped to release their resources
+   * until `alloc(false)` succeeds, and block on `alloc(true)` if nothing could be dropped.
+   *
+   * @param pipeline_name
+   * @param cover_oldest
+   * @param alloc functor with a `bool block` argument, return nullptr on failure.
+   */
+  template <typename AllocFunc>
+  auto AllocOrCoverOldest(const std::string &pipeline_name, bool cover_oldest, AllocFunc &&alloc)
+  {
+    if (!cover_oldest)
+    {
+      return alloc(true);
+    }
+    auto res = alloc(false);
+    while (res == nullptr && DropOldestPackage(pipeline_name))
+    {
+      res = alloc(false);
+    }
+    return res != nullptr ? res : alloc(true);
+  }
+
 public:
   /**
    * @brief Get the default pipeline context. Multiple instances derived from `BaseAsyncPipeline`
@@ -106,21 +203,47 @@ public:
    * the `future` in another thread. The instance of template type `Result` is generated by functor
    * `GenResult`.
    *
+   * It is thread-safe, multiple threads could push packages into the same pipeline concurrently.
+   * The packages of one thread keep their order, but there is no order between threads.
+   *
+   * If the package does not go through the pipeline, the `future` throws
+   * `AsyncPipelineException` with the status, e.g. `DROPPED` when it is evicted by a newer package
+   * pushed with `cover_oldest`, `TIMEOUT` when it expired `deadline` before some block, `FAILED`
+   * as soon as some block returned false or threw an exception, `CANCELLED` when `cancel_token` is
+   * cancelled before it went through all blocks, `REJECTED` at once when the pipeline is too
+   * overloaded to finish it in time, see `AsyncPipelineConfig::admission_slo_ms`.
+   *
+   * While the pipeline is drained or reconfigured, it blocks until the pipeline is resumed.
+   *
    * @param pipeline_name
    * @param package
+   * @param cover_oldest drop the oldest package instead of blocking if the pipeline is full.
+   * default=false.
+   * @param deadline default=kPipelineNoDeadline.
+   * @param priority the blocks serve packages of higher priority first. default=PRIORITY_NORMAL.
+   * @param cancel_token cancel the package, see `AsyncCancelToken`. default=empty token.
+   * @param latency filled with the latency breakdown of the package before the `future` is ready,
+   * see `PipelineLatencyRecord`. default=nullptr, not recorded.
    * @return std::future<ResultType>
    */
-  [[nodiscard]] std::future<ResultType> PushPipeline(const std::string &pipeline_name,
-                                                     const ParsingType &package) noexcept
+  [[nodiscard]] std::future<ResultType> PushPipeline(
+      const std::string              &pipeline_name,
+      const ParsingType              &package,
+      bool                            cover_oldest = false,
+      const PipelineClock::time_point deadline     = kPipelineNoDeadline,
+      PackagePriority                 priority     = PackagePriority::PRIORITY_NORMAL,
+      const AsyncCancelToken         &cancel_token = AsyncCancelToken(),
+      const PipelineLatencyRecordPtr &latency      = nullptr) noexcept
   {
-    if (map_name2instance_.find(pipeline_name) == map_name2instance_.end())
+    auto iter = map_name2instance_.find(pipeline_name);
+    if (iter == map_name2instance_.end())
     {
       LOG_ERROR("[BaseAsyncPipeline] `PushPipeline` pipeline {%s} is not valid !!!",
                 pipeline_name.c_str());
       return std::future<ResultType>();
     }
 
-    if (!map_name2instance_.at(pipeline_name).IsInitialized())
+    if (!iter->second.IsInitialized())
     {
       LOG_ERROR("[BaseAsyncPipeline] `PushPipeline` pipeline {%s} is not initilized !!!",
                 pipeline_name.c_str());
@@ -128,36 +251,123 @@ public:
       return std::future<ResultType>();
     }
 
-    map_index2result_[package_index_] = std::promise<ResultType>();
-    auto ret                          = map_index2result_[package_index_].get_future();
+    // the promise and its shared state are recycled by the request pool
+    auto slot      = request_pool_->New<_RequestSlot>(request_pool_);
+    slot->pipeline = this;
+    auto ret       = slot->promise.get_future();
 
-    auto callback = [this, package_index = package_index_](const ParsingType &package) -> bool {
-      ResultType result = gen_result_from_package_(package);
-      map_index2result_[package_index].set_value(std::move(result));
-      map_index2result_.erase(package_index);
-      return true;
-    };
-    map_name2instance_[pipeline_name].PushPipeline(package, callback);
+    iter->second.PushPipeline(package, &BaseAsyncPipeline::CompleteRequest, slot, cover_oldest,
+                              deadline, priority, cancel_token, latency);
 
-    package_index_++;
+    package_index_.fetch_add(1, std::memory_order_relaxed);
 
-    return std::move(ret);
+    return ret;
   }
 
   /**
-   * @brief Return if the pipeline is initialized.
+   * @brief Same as above, but the result is delivered to `completion` instead of a `std::future`,
+   * i.e. a callback or an `AsyncCompletionQueue`, directly from the pipeline thread which
+   * completes the package. No consumer thread has to block on it.
    *
    * @param pipeline_name
+   * @param package
+   * @param completion called exactly once if the package is pushed.
+   * @param cover_oldest drop the oldest package instead of blocking if the pipeline is full.
+   * default=false.
+   * @param deadline default=kPipelineNoDeadline.
+   * @param priority default=PRIORITY_NORMAL.
+   * @param cancel_token default=empty token.
+   * @param latency filled before `completion` is called. default=nullptr.
    * @return true
-   * @return false
+   * @return false if the pipeline is not valid or not initialized, `completion` is not called.
    */
-  bool IsPipelineInitialized(const std::string &pipeline_name) noexcept
+  bool PushPipeline(
+      const std::string                 &pipeline_name,
+      const ParsingType                 &package,
+      const AsyncCompletion<ResultType> &completion,
+      bool                               cover_oldest = false,
+      const PipelineClock::time_point    deadline     = kPipelineNoDeadline,
+      PackagePriority                    priority     = PackagePriority::PRIORITY_NORMAL,
+      const AsyncCancelToken            &cancel_token = AsyncCancelToken(),
+      const PipelineLatencyRecordPtr    &latency      = nullptr) noexcept
   {
-    if (map_name2instance_.find(pipeline_name) == map_name2instance_.end())
+    auto iter = map_name2instance_.find(pipeline_name);
+    if (iter == map_name2instance_.end())
+    {
+      LOG_ERROR("[BaseAsyncPipeline] `PushPipeline` pipeline {%s} is not valid !!!",
+                pipeline_name.c_str());
+      return false;
+    }
+
+    if (!iter->second.IsInitialized())
     {
+      LOG_ERROR("[BaseAsyncPipeline] `PushPipeline` pipeline {%s} is not initilized !!!",
+                pipeline_name.c_str());
       return false;
     }
-    return map_name2instance_[pipeline_name].IsInitialized();
+
+    if (!completion.IsValid())
+    {
+      LOG_ERROR("[BaseAsyncPipeline] `PushPipeline` got invalid completion !!!");
+      return false;
+    }
+
+    auto slot      = request_pool_->New<_CompletionSlot>(completion);
+    slot->pipeline = this;
+
+    iter->second.PushPipeline(package, &BaseAsyncPipeline::CompleteWithCallback, slot,
+                              cover_oldest, deadline, priority, cancel_token, latency);
+
+    package_index_.fetch_add(1, std::memory_order_relaxed);
+
+    return true;
+  }
+
+  /**
+   * @brief Return false if pipeline `pipeline_name` is too overloaded to finish a request pushed
+   * now within the SLO of admission control or `deadline`, see
+   * `AsyncPipelineConfig::admission_slo_ms`. Check it before creating a package which may block,
+   * e.g. on the blobs buffer pool. True if the pipeline is not valid or admission control is
+   * disabled.
+   *
+   * @param pipeline_name
+   * @param deadline default=kPipelineNoDeadline.
+   * @return true
+   * @return false
+   */
+  bool AdmitRequest(const std::string              &pipeline_name,
+                    const PipelineClock::time_point deadline = kPipelineNoDeadline) noexcept
+  {
+    auto iter = map_name2instance_.find(pipeline_name);
+    return iter == map_name2instance_.end() || !iter->second.IsInitialized() ||
+           iter->second.Admit(deadline);
+  }
+
+  /**
+   * @brief Drop the oldest pending package of pipeline `pipeline_name`, its `future` throws
+   * `AsyncPipelineException` with `DROPPED` status. Return false if there is no pending package.
+   *
+   * @param pipeline_name
+   * @return true
+   * @return false
+   */
+  bool DropOldestPackage(const std::string &pipeline_name) noexcept
+  {
+    auto iter = map_name2instance_.find(pipeline_name);
+    return iter != map_name2instance_.end() && iter->second.DropOldest();
+  }
+
+  /**
+   * @brief Return if the pipeline is initialized.
+   *
+   * @param pipeline_name
+   * @return true
+   * @return false
+   */
+  bool IsPipelineInitialized(const std::string &pipeline_name) noexcept
+  {
+    auto iter = map_name2instance_.find(pipeline_name);
+    return iter != map_name2instance_.end() && iter->second.IsInitialized();
   }
 
   /**
@@ -191,18 +401,320 @@ public:
    */
   void InitPipeline()
   {
+    InitPipeline(AsyncPipelineConfig());
+  }
+
+  /**
+   * @brief Initialize all configured pipeline with `config`, e.g. run the blocks on one executor
+   * shared between pipelines, use lock-free `SpscQueue` between blocks, or pin the dedicated
+   * threads to cpus by `config.placement`. Call this function before push packages into pipeline.
+   *
+   * @param config
+   */
+  void InitPipeline(const AsyncPipelineConfig &config)
+  {
+    // the pipelines take turns on the auto-assigned cpus
+    size_t auto_cpu_cursor = 0;
     for (auto &p_name_ins : map_name2instance_)
     {
-      p_name_ins.second.Init();
+      p_name_ins.second.Init(config, auto_cpu_cursor);
+    }
+  }
+
+  /**
+   * @brief Initialize the pipeline named `pipeline_name` with `config`. Return false if the
+   * pipeline is not configured.
+   *
+   * @param pipeline_name
+   * @param config
+   * @return true
+   * @return false
+   */
+  bool InitPipeline(const std::string &pipeline_name, const AsyncPipelineConfig &config)
+  {
+    auto iter = map_name2instance_.find(pipeline_name);
+    if (iter == map_name2instance_.end())
+    {
+      LOG_ERROR("[BaseAsyncPipeline] `InitPipeline` pipeline {%s} is not valid !!!",
+                pipeline_name.c_str());
+      return false;
+    }
+    iter->second.Init(config);
+    return true;
+  }
+
+  /**
+   * @brief Stop admission of pipeline `pipeline_name` and wait until the pending packages are
+   * finished, the pushes block meanwhile. Call `ResumePipeline` to reopen admission. Return false
+   * if the pipeline is not valid, or not drained in `timeout_ms`, in which case admission is
+   * reopened.
+   *
+   * @param pipeline_name
+   * @param timeout_ms wait forever if < 0. default=-1.
+   * @return true
+   * @return false
+   */
+  bool DrainPipeline(const std::string &pipeline_name, int timeout_ms = -1)
+  {
+    auto iter = map_name2instance_.find(pipeline_name);
+    if (iter == map_name2instance_.end())
+    {
+      LOG_ERROR("[BaseAsyncPipeline] `DrainPipeline` pipeline {%s} is not valid !!!",
+                pipeline_name.c_str());
+      return false;
     }
+    return iter->second.Drain(timeout_ms);
+  }
+
+  /**
+   * @brief Reopen admission of pipeline `pipeline_name` after `DrainPipeline`.
+   *
+   * @param pipeline_name
+   */
+  void ResumePipeline(const std::string &pipeline_name)
+  {
+    auto iter = map_name2instance_.find(pipeline_name);
+    if (iter == map_name2instance_.end())
+    {
+      LOG_ERROR("[BaseAsyncPipeline] `ResumePipeline` pipeline {%s} is not valid !!!",
+                pipeline_name.c_str());
+      return;
+    }
+    iter->second.Resume();
+  }
+
+  /**
+   * @brief Drain the running pipeline `pipeline_name`, rebuild it with `block_list` and `config`,
+   * e.g. another queue depth or block parallelism, and resume it. No package is dropped, the
+   * pushes blocked meanwhile go into the new pipeline. Return false and keep the old pipeline
+   * running if it is not valid, or not drained in `timeout_ms`.
+   *
+   * @param pipeline_name
+   * @param block_list
+   * @param config
+   * @param timeout_ms wait forever if < 0. default=-1.
+   * @return true
+   * @return false
+   */
+  bool ReconfigurePipeline(const std::string            &pipeline_name,
+                           const std::vector<Context_t> &block_list,
+                           const AsyncPipelineConfig    &config,
+                           int                           timeout_ms = -1)
+  {
+    auto iter = map_name2instance_.find(pipeline_name);
+    if (iter == map_name2instance_.end())
+    {
+      LOG_ERROR("[BaseAsyncPipeline] `ReconfigurePipeline` pipeline {%s} is not valid !!!",
+                pipeline_name.c_str());
+      return false;
+    }
+    return iter->second.Reconfigure(block_list, config, timeout_ms);
+  }
+
+  /**
+   * @brief Same as above, but keep the current blocks of the pipeline and only apply `config`.
+   *
+   */
+  bool ReconfigurePipeline(const std::string         &pipeline_name,
+                           const AsyncPipelineConfig &config,
+                           int                        timeout_ms = -1)
+  {
+    auto iter = map_name2instance_.find(pipeline_name);
+    if (iter == map_name2instance_.end())
+    {
+      LOG_ERROR("[BaseAsyncPipeline] `ReconfigurePipeline` pipeline {%s} is not valid !!!",
+                pipeline_name.c_str());
+      return false;
+    }
+    return iter->second.Reconfigure(config, timeout_ms);
+  }
+
+  /**
+   * @brief Get the wait statistics of the block queues of pipeline `pipeline_name`, see
+   * `AsyncPipelineConfig::wait_strategy`. Return empty if the pipeline is not valid.
+   *
+   * @param pipeline_name
+   * @return std::vector<std::pair<std::string, QueueWaitStats>> block name and the wait
+   * statistics of its input queue.
+   */
+  std::vector<std::pair<std::string, QueueWaitStats>> GetQueueWaitStats(
+      const std::string &pipeline_name) const
+  {
+    auto iter = map_name2instance_.find(pipeline_name);
+    if (iter == map_name2instance_.end())
+    {
+      LOG_ERROR("[BaseAsyncPipeline] `GetQueueWaitStats` pipeline {%s} is not valid !!!",
+                pipeline_name.c_str());
+      return {};
+    }
+    return iter->second.GetQueueWaitStats();
+  }
+
+  /**
+   * @brief Get the bottleneck report of pipeline `pipeline_name`, i.e. the saturated block and
+   * the headroom of the others, see `AsyncPipelineConfig::bottleneck_sample_ms`. Return an empty
+   * report if the pipeline is not valid or the sampler is disabled.
+   *
+   * @param pipeline_name
+   * @return PipelineBottleneckReport
+   */
+  PipelineBottleneckReport GetBottleneckReport(const std::string &pipeline_name) const
+  {
+    auto iter = map_name2instance_.find(pipeline_name);
+    if (iter == map_name2instance_.end())
+    {
+      LOG_ERROR("[BaseAsyncPipeline] `GetBottleneckReport` pipeline {%s} is not valid !!!",
+                pipeline_name.c_str());
+      return {};
+    }
+    return iter->second.GetBottleneckReport();
+  }
+
+  /**
+   * @brief Get the heap allocation statistics of the request path, e.g. `heap_allocations` stays
+   * unchanged in steady state.
+   *
+   * @return AsyncPipelineAllocStats
+   */
+  AsyncPipelineAllocStats GetAllocationStats() const noexcept
+  {
+    AsyncPipelineAllocStats stats;
+    stats.request_count    = package_index_.load(std::memory_order_relaxed);
+    stats.heap_allocations = request_pool_->GetHeapAllocationCount();
+    for (const auto &p_name_ins : map_name2instance_)
+    {
+      stats.heap_allocations += p_name_ins.second.GetHeapAllocationCount();
+    }
+    return stats;
+  }
+
+protected:
+  /**
+   * @brief Return the `future` of a request rejected by `AdmitRequest` before it is pushed, which
+   * throws `AsyncPipelineException` with `REJECTED` status.
+   *
+   * @return std::future<ResultType>
+   */
+  static std::future<ResultType> RejectRequest()
+  {
+    std::promise<ResultType> promise;
+    promise.set_exception(std::make_exception_ptr(
+        AsyncPipelineException(PackageStatus::REJECTED, kRejectedMessage)));
+    return promise.get_future();
+  }
+
+  /**
+   * @brief Deliver `REJECTED` status to `completion` of a request rejected by `AdmitRequest`
+   * before it is pushed. Return true as `completion` is called, false if it is not valid.
+   *
+   */
+  static bool RejectRequest(const AsyncCompletion<ResultType> &completion)
+  {
+    if (!completion.IsValid())
+    {
+      LOG_ERROR("[BaseAsyncPipeline] `RejectRequest` got invalid completion !!!");
+      return false;
+    }
+    try
+    {
+      completion(PackageStatus::REJECTED, ResultType{});
+    } catch (const std::exception &e)
+    {
+      LOG_ERROR("[BaseAsyncPipeline] completion callback throws exception : %s", e.what());
+    }
+    return true;
   }
 
 private:
+  static constexpr const char *kRejectedMessage =
+      "[BaseAsyncPipeline] package is rejected by admission control";
+
+  // the promise of one request, lives in the request pool until the package is completed
+  struct _RequestSlot {
+    explicit _RequestSlot(const std::shared_ptr<FixedBlockPool> &pool)
+        : promise(std::allocator_arg, PoolAllocator<ResultType>(pool))
+    {}
+
+    std::promise<ResultType> promise;
+    BaseAsyncPipeline       *pipeline = nullptr;
+  };
+
+  static bool CompleteRequest(void *ctx, const ParsingType &package, PackageStatus status)
+  {
+    auto slot = static_cast<_RequestSlot *>(ctx);
+    try
+    {
+      if (status == PackageStatus::SUCCESS)
+      {
+        slot->promise.set_value(slot->pipeline->gen_result_from_package_(package));
+      } else
+      {
+        const char *message = status == PackageStatus::TIMEOUT
+                                  ? "[BaseAsyncPipeline] package expired its deadline"
+                              : status == PackageStatus::FAILED
+                                  ? "[BaseAsyncPipeline] package failed in some block"
+                              : status == PackageStatus::CANCELLED
+                                  ? "[BaseAsyncPipeline] package is cancelled"
+                              : status == PackageStatus::REJECTED
+                                  ? kRejectedMessage
+                                  : "[BaseAsyncPipeline] package is dropped";
+        slot->promise.set_exception(
+            std::make_exception_ptr(AsyncPipelineException(status, message)));
+      }
+    } catch (...)
+    {
+      slot->promise.set_exception(std::current_exception());
+    }
+    slot->pipeline->request_pool_->Delete(slot);
+    return true;
+  }
+
+  // the completion handle of one request, lives in the request pool until it is completed
+  struct _CompletionSlot {
+    explicit _CompletionSlot(const AsyncCompletion<ResultType> &_completion)
+        : completion(_completion)
+    {}
+
+    AsyncCompletion<ResultType> completion;
+    BaseAsyncPipeline          *pipeline = nullptr;
+  };
+
+  static bool CompleteWithCallback(void *ctx, const ParsingType &package, PackageStatus status)
+  {
+    auto       slot = static_cast<_CompletionSlot *>(ctx);
+    ResultType result{};
+    if (status == PackageStatus::SUCCESS)
+    {
+      try
+      {
+        result = slot->pipeline->gen_result_from_package_(package);
+      } catch (const std::exception &e)
+      {
+        LOG_ERROR("[BaseAsyncPipeline] failed to generate result, Got exception : %s", e.what());
+        status = PackageStatus::FAILED;
+      }
+    }
+    try
+    {
+      slot->completion(status, std::move(result));
+    } catch (const std::exception &e)
+    {
+      LOG_ERROR("[BaseAsyncPipeline] completion callback throws exception : %s", e.what());
+    }
+    slot->pipeline->request_pool_->Delete(slot);
+    return true;
+  }
+
+  // big enough for the promise shared states of the results, e.g. `cv::Mat`
+  static constexpr size_t kRequestBlockSize    = 256;
+  static constexpr size_t kRequestPoolSlabSize = 64;
+
   std::unordered_map<std::string, PipelineInstance<ParsingType>> map_name2instance_;
 
-  size_t                                               package_index_ = 0;
-  std::unordered_map<size_t, std::promise<ResultType>> map_index2result_;
-  GenResult                                            gen_result_from_package_;
+  std::atomic<size_t>             package_index_{0};
+  std::shared_ptr<FixedBlockPool> request_pool_ =
+      std::make_shared<FixedBlockPool>(kRequestBlockSize, kRequestPoolSlabSize);
+  GenResult gen_result_from_package_;
 };
 
 } // namespace easy_deploy
@@ -1,15 +1,225 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <functional>
 #include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "common_utils/block_queue.hpp"
 #include "common_utils/log.hpp"
+#include "common_utils/priority_block_queue.hpp"
+#include "common_utils/ring_buffer.hpp"
+#include "common_utils/spsc_queue.hpp"
 #include "common_utils/types.hpp"
+#include "common_utils/wait_strategy.hpp"
+#include "deploy_core/pipeline_bottleneck.hpp"
+#include "deploy_core/pipeline_executor.hpp"
+#include "deploy_core/pipeline_latency.hpp"
+#include "deploy_core/pipeline_memory_pool.hpp"
+#include "deploy_core/pipeline_placement.hpp"
+#include "deploy_core/pipeline_shared_stage.hpp"
+#include "deploy_core/pipeline_trace.hpp"
 
 namespace easy_deploy {
 
+/**
+ * @brief Enum of the queue implementation used between pipeline blocks.
+ *
+ * @param BLOCK_QUEUE mutex and condition_variable based `PriorityBlockQueue` with priority lanes
+ * @param SPSC_QUEUE lock-free single-producer/single-consumer `SpscQueue`
+ */
+enum PipelineQueueType { BLOCK_QUEUE = 0, SPSC_QUEUE = 1 };
+
+/**
+ * @brief Enum of how the pipeline blocks are executed.
+ *
+ * @param SHARED_EXECUTOR blocks run as tasks on a `IPipelineExecutor` shared by pipelines, so the
+ * number of threads follows the number of cpu cores instead of the number of blocks. The tasks
+ * never block, a block whose next queue is full keeps its outputs aside and stops taking packages
+ * until the next block takes one.
+ * @param DEDICATED_THREAD every block owns its worker threads which wait on its input queue.
+ */
+enum PipelineExecutionMode { SHARED_EXECUTOR = 0, DEDICATED_THREAD = 1 };
+
+/**
+ * @brief Enum of the final status of a package pushed into async pipeline.
+ *
+ * @param SUCCESS the package went through all blocks.
+ * @param DROPPED the package was evicted by a newer package pushed with `cover_oldest`.
+ * @param TIMEOUT the package expired its deadline before some block was executed.
+ * @param FAILED some block returned false or threw an exception, the rest blocks were skipped.
+ * @param CANCELLED the cancel token of the package was cancelled before it went through all blocks.
+ * @param REJECTED the package was not admitted into the overloaded pipeline, see
+ * `AsyncPipelineConfig::admission_slo_ms`.
+ */
+enum PackageStatus {
+  SUCCESS   = 0,
+  DROPPED   = 1,
+  TIMEOUT   = 2,
+  FAILED    = 3,
+  CANCELLED = 4,
+  REJECTED  = 5
+};
+
+/**
+ * @brief Enum of the priority classes of packages. The block queues serve the packages of higher
+ * priority first, and the packages waiting longer than the aging time are served before the
+ * higher priority ones, see `AsyncPipelineConfig::priority_aging_ms`. The lock-free `SpscQueue`
+ * does not support priority and keeps FIFO order.
+ *
+ * @param PRIORITY_HIGH e.g. interactive requests which need bounded latency.
+ * @param PRIORITY_NORMAL the default priority.
+ * @param PRIORITY_LOW e.g. background batch jobs.
+ */
+enum PackagePriority { PRIORITY_HIGH = 0, PRIORITY_NORMAL = 1, PRIORITY_LOW = 2 };
+
+/**
+ * @brief Number of the priority classes, i.e. the lanes of each block queue.
+ *
+ */
+constexpr size_t kPackagePriorityNum = 3;
+
+/**
+ * @brief Clock of the package deadlines.
+ *
+ */
+using PipelineClock = std::chrono::steady_clock;
+
+/**
+ * @brief Deadline of the packages which never expire.
+ *
+ */
+constexpr PipelineClock::time_point kPipelineNoDeadline = PipelineClock::time_point::max();
+
+/**
+ * @brief Exception set into the `std::future` of a package which did not complete successfully.
+ *
+ */
+class AsyncPipelineException : public std::runtime_error {
+public:
+  AsyncPipelineException(PackageStatus status, const std::string &message)
+      : std::runtime_error(message), status_(status)
+  {}
+
+  PackageStatus GetStatus() const noexcept
+  {
+    return status_;
+  }
+
+private:
+  PackageStatus status_;
+};
+
+/**
+ * @brief Cancel token of async requests, the copies share one flag. Pass it when pushing packages
+ * and call `Cancel` once their results are not needed any more, e.g. the user abandoned a SAM
+ * interaction. A cancelled package is completed with `CANCELLED` status before the next block it
+ * would enter, so it stops occupying the inference engine and releases its blobs buffer at once.
+ * The running block is not interrupted. One token could be shared by several packages, e.g. all
+ * requests of a tracking window.
+ *
+ */
+class AsyncCancelToken {
+public:
+  /**
+   * @brief An empty token which is never cancelled, and costs nothing in the pipeline.
+   *
+   */
+  AsyncCancelToken() = default;
+
+  /**
+   * @brief Create a token which could be cancelled.
+   *
+   * @return AsyncCancelToken
+   */
+  static AsyncCancelToken Create()
+  {
+    AsyncCancelToken token;
+    token.flag_ = std::make_shared<std::atomic<bool>>(false);
+    return token;
+  }
+
+  /**
+   * @brief Cancel the packages pushed with this token, or its copies. Thread-safe. Does nothing on
+   * an empty token.
+   *
+   */
+  void Cancel() const noexcept
+  {
+    if (flag_ != nullptr)
+    {
+      flag_->store(true, std::memory_order_release);
+    }
+  }
+
+  bool IsCancelled() const noexcept
+  {
+    return flag_ != nullptr && flag_->load(std::memory_order_acquire);
+  }
+
+  bool IsValid() const noexcept
+  {
+    return flag_ != nullptr;
+  }
+
+private:
+  std::shared_ptr<std::atomic<bool>> flag_;
+};
+
+/**
+ * @brief Configuration of an async pipeline instance, used in `InitPipeline`.
+ *
+ */
+struct AsyncPipelineConfig {
+  // max size of each block queue, the lower priority packages leave a slot for each higher
+  // priority.
+  int bq_max_size = 100;
+  // queue type of the links between blocks. The input queue of the pipeline is always a
+  // `PriorityBlockQueue`, because `PushPipeline` could be called from any thread.
+  PipelineQueueType queue_type = PipelineQueueType::BLOCK_QUEUE;
+  // a package waiting longer than it in a block queue is served before the higher priority ones.
+  int priority_aging_ms = 100;
+  // `DEDICATED_THREAD` makes every block use dedicated threads. In `SHARED_EXECUTOR` mode, only
+  // blocks marked by `SetDedicatedThread` get dedicated threads, the others run on `executor`.
+  PipelineExecutionMode execution_mode = PipelineExecutionMode::SHARED_EXECUTOR;
+  // the executor of the blocks without dedicated threads. Use `GetDefaultPipelineExecutor()` if
+  // nullptr.
+  std::shared_ptr<IPipelineExecutor> executor = nullptr;
+  // cpu placement of the dedicated threads, they float freely by default. It does not pin the
+  // blocks running on `executor`, pass a `WorkStealingThreadPool` constructed with `cpus` to pin
+  // them.
+  PipelinePlacementPolicy placement;
+  // how the threads wait on empty or full block queues, each queue keeps its default if not set.
+  // `WaitStrategy::Hybrid()` saves the wake up latency of blocks taking sub-millisecond.
+  std::optional<WaitStrategy> wait_strategy;
+  // target end-to-end latency of the adaptive queue depth, 0 disables it. The bounded block queues
+  // are resized at runtime from the measured service time of blocks, so the packages in flight
+  // just saturate the slowest block and do not build standing queues.
+  int target_latency_ms = 0;
+  // the adaptive queue depth never goes below it, nor above `bq_max_size`.
+  int min_queue_size = 2;
+  // interval of the bottleneck sampler, which records the queue depth and load of each block in
+  // the background, see `GetBottleneckReport`. 0 disables it.
+  int bottleneck_sample_ms = 0;
+  // latency SLO of admission control, 0 disables it. The completion time of a new package is
+  // estimated from the measured service time of blocks and the packages in flight before it. If
+  // it misses the SLO, or the deadline of the package, the package is rejected at once with
+  // `REJECTED` status instead of blocking the caller. The packages pushed with `cover_oldest` are
+  // never rejected, they evict the oldest ones instead.
+  int admission_slo_ms = 0;
+};
+
 /**
  * @brief Async Pipeline Block
  *
@@ -20,13 +230,36 @@ class AsyncPipelineBlock {
 public:
   AsyncPipelineBlock() = default;
   AsyncPipelineBlock(const AsyncPipelineBlock &block)
-      : func_(block.func_), block_name_(block.block_name_)
+      : func_(block.func_),
+        batch_func_(block.batch_func_),
+        block_name_(block.block_name_),
+        parallelism_(block.parallelism_),
+        keep_order_(block.keep_order_),
+        dedicated_thread_(block.dedicated_thread_),
+        trivial_(block.trivial_),
+        fusible_(block.fusible_),
+        max_batch_size_(block.max_batch_size_),
+        max_batch_wait_us_(block.max_batch_wait_us_),
+        dependencies_(block.dependencies_),
+        has_dependencies_(block.has_dependencies_),
+        shared_stage_(block.shared_stage_)
   {}
 
   AsyncPipelineBlock &operator=(const AsyncPipelineBlock &block)
   {
-    func_       = block.func_;
-    block_name_ = block.block_name_;
+    func_              = block.func_;
+    batch_func_        = block.batch_func_;
+    block_name_        = block.block_name_;
+    parallelism_       = block.parallelism_;
+    keep_order_        = block.keep_order_;
+    dedicated_thread_  = block.dedicated_thread_;
+    trivial_           = block.trivial_;
+    fusible_           = block.fusible_;
+    max_batch_size_    = block.max_batch_size_;
+    max_batch_wait_us_ = block.max_batch_wait_us_;
+    dependencies_      = block.dependencies_;
+    has_dependencies_  = block.has_dependencies_;
+    shared_stage_      = block.shared_stage_;
     return *this;
   }
 
@@ -37,24 +270,225 @@ public:
       : func_(func), block_name_(block_name)
   {}
 
+  /**
+   * @brief Construct a block which is executed by `parallelism` worker threads. The block function
+   * should be thread-safe if `parallelism` > 1. The packages leave the block in the same order as
+   * they enter it unless `keep_order` is false.
+   *
+   * @param func
+   * @param block_name
+   * @param parallelism number of worker threads, should be >= 1.
+   * @param keep_order whether to reorder the packages to their input order.
+   */
+  AsyncPipelineBlock(const std::function<bool(ParsingType)> &func,
+                     const std::string                      &block_name,
+                     int                                     parallelism,
+                     bool                                    keep_order = true)
+      : func_(func), block_name_(block_name), parallelism_(parallelism), keep_order_(keep_order)
+  {
+    if (parallelism_ < 1)
+    {
+      throw std::invalid_argument("[AsyncPipelineBlock] parallelism should be >= 1, Got: " +
+                                  std::to_string(parallelism_));
+    }
+  }
+
+  /**
+   * @brief Construct a batch block which processes the packages in micro-batches. It collects up
+   * to `max_batch_size` packages, or as many as arrived within `max_wait_us` after the first one,
+   * and calls `batch_func` once on all of them. A batch block always runs on one dedicated thread,
+   * and the packages leave it in input order.
+   *
+   * @param batch_func
+   * @param block_name
+   * @param max_batch_size should be >= 1.
+   * @param max_wait_us max time to wait for a full batch in microseconds, should be >= 0.
+   */
+  AsyncPipelineBlock(const std::function<bool(const std::vector<ParsingType> &)> &batch_func,
+                     const std::string                                           &block_name,
+                     int                                                          max_batch_size,
+                     int                                                          max_wait_us)
+      : batch_func_(batch_func),
+        block_name_(block_name),
+        dedicated_thread_(true),
+        max_batch_size_(max_batch_size),
+        max_batch_wait_us_(max_wait_us)
+  {
+    if (max_batch_size_ < 1 || max_batch_wait_us_ < 0)
+    {
+      throw std::invalid_argument(
+          "[AsyncPipelineBlock] max_batch_size should be >= 1 and max_wait_us should be >= 0, "
+          "Got: " +
+          std::to_string(max_batch_size_) + ", " + std::to_string(max_batch_wait_us_));
+    }
+  }
+
   const std::string &GetName() const
   {
     return block_name_;
   }
 
+  int GetParallelism() const
+  {
+    return parallelism_;
+  }
+
+  bool IsKeepOrder() const
+  {
+    return keep_order_;
+  }
+
+  /**
+   * @brief Let the block own its worker threads instead of running on the shared executor in
+   * `SHARED_EXECUTOR` mode, which saves the scheduling latency for latency-critical blocks.
+   *
+   * @param dedicated_thread
+   * @return AsyncPipelineBlock&
+   */
+  AsyncPipelineBlock &SetDedicatedThread(bool dedicated_thread = true)
+  {
+    dedicated_thread_ = dedicated_thread;
+    return *this;
+  }
+
+  bool IsDedicatedThread() const
+  {
+    return dedicated_thread_;
+  }
+
+  /**
+   * @brief Mark the block as trivial, i.e. it does nothing but return true. Trivial blocks are
+   * removed when the pipeline is compiled, so they cost no queue hop.
+   *
+   * @param trivial
+   * @return AsyncPipelineBlock&
+   */
+  AsyncPipelineBlock &SetTrivial(bool trivial = true)
+  {
+    trivial_ = trivial;
+    return *this;
+  }
+
+  bool IsTrivial() const
+  {
+    return trivial_;
+  }
+
+  /**
+   * @brief Mark the block as fusible, i.e. it is cheap enough to run right after the previous
+   * block on the same thread. Fusible blocks are merged into the previous block when the pipeline
+   * is compiled, and inherit its parallelism, so they should be thread-safe.
+   *
+   * @param fusible
+   * @return AsyncPipelineBlock&
+   */
+  AsyncPipelineBlock &SetFusible(bool fusible = true)
+  {
+    fusible_ = fusible;
+    return *this;
+  }
+
+  bool IsFusible() const
+  {
+    return fusible_;
+  }
+
+  bool IsBatchBlock() const
+  {
+    return batch_func_ != nullptr;
+  }
+
+  int GetMaxBatchSize() const
+  {
+    return max_batch_size_;
+  }
+
+  int GetMaxBatchWaitUs() const
+  {
+    return max_batch_wait_us_;
+  }
+
+  /**
+   * @brief Declare the parent blocks by name, which makes the pipeline a DAG. The block runs once
+   * all its parents have finished the package, and the blocks without dependencies between them
+   * run concurrently on the same package. Empty `parents` means the block starts from the input
+   * of pipeline. A block without declared dependencies depends on the previous block in the
+   * context.
+   *
+   * @param parents names of the blocks before this one in the context. If several blocks have the
+   * same name, the latest one before this block is used.
+   * @return AsyncPipelineBlock&
+   */
+  AsyncPipelineBlock &SetDependencies(const std::vector<std::string> &parents)
+  {
+    dependencies_     = parents;
+    has_dependencies_ = true;
+    return *this;
+  }
+
+  bool HasDependencies() const
+  {
+    return has_dependencies_;
+  }
+
+  const std::vector<std::string> &GetDependencies() const
+  {
+    return dependencies_;
+  }
+
+  /**
+   * @brief Let the block run on the worker of `shared_stage` instead of its own threads or tasks.
+   * The blocks of several pipelines using one engine set the same shared stage, so their packages
+   * are served one at a time in round-robin by one thread. The block is never fused, and the
+   * setting is ignored by batch blocks.
+   *
+   * @param shared_stage nullptr to run the block by the pipeline itself.
+   * @return AsyncPipelineBlock&
+   */
+  AsyncPipelineBlock &SetSharedStage(std::shared_ptr<SharedPipelineStage> shared_stage)
+  {
+    shared_stage_ = std::move(shared_stage);
+    return *this;
+  }
+
+  const std::shared_ptr<SharedPipelineStage> &GetSharedStage() const
+  {
+    return shared_stage_;
+  }
+
   bool operator()(const ParsingType &pipeline_unit) const
   {
     return func_(pipeline_unit);
   }
 
+  bool operator()(const std::vector<ParsingType> &pipeline_units) const
+  {
+    return batch_func_(pipeline_units);
+  }
+
 private:
-  std::function<bool(ParsingType)> func_;
-  std::string                      block_name_;
+  std::function<bool(ParsingType)>                      func_;
+  std::function<bool(const std::vector<ParsingType> &)> batch_func_;
+  std::string                                           block_name_;
+  int                                                   parallelism_       = 1;
+  bool                                                  keep_order_        = true;
+  bool                                                  dedicated_thread_  = false;
+  bool                                                  trivial_           = false;
+  bool                                                  fusible_           = false;
+  int                                                   max_batch_size_    = 1;
+  int                                                   max_batch_wait_us_ = 0;
+  std::vector<std::string>                              dependencies_;
+  bool                                                  has_dependencies_ = false;
+  std::shared_ptr<SharedPipelineStage>                  shared_stage_;
 };
 
 /**
  * @brief Async Pipeline Context
  *
+ * The blocks are listed in topological order. By default every block depends on the previous
+ * one, which makes a linear pipeline. Blocks declaring their parents by `SetDependencies` make up
+ * a DAG, e.g. two preprocess branches which fan out from the input and join before inference.
+ *
  * @tparam ParsingType
  */
 template <typename ParsingType>
@@ -127,37 +561,196 @@ public:
 /**
  * @brief Async Pipeline Processing Instance
  *
+ * Every block is wrapped into a stage which owns its input queue. A stage either runs on
+ * dedicated threads waiting on the input queue, or runs as tasks on the shared executor which
+ * are scheduled when packages are delivered to it. The output stage executes the callbacks.
+ *
+ * The inner package headers are recycled by a `FixedBlockPool` and passed between stages by
+ * `std::unique_ptr`, so pushing a package does not allocate in steady state.
+ *
+ * A running pipeline could be drained, i.e. new pushes wait at the admission gate while the
+ * packages in flight finish, and then be reconfigured with new blocks or config without losing
+ * packages.
+ *
  * @tparam ParsingType
  */
 template <typename ParsingType>
 class PipelineInstance {
   using Block_t    = AsyncPipelineBlock<ParsingType>;
   using Context_t  = AsyncPipelineContext<ParsingType>;
-  using Callback_t = std::function<bool(const ParsingType &)>;
+
+public:
+  /**
+   * @brief Completion callback of packages, a plain function pointer with the user context `ctx`
+   * which is given in `PushPipeline`.
+   *
+   */
+  using Callback_t = bool (*)(void *ctx, const ParsingType &package, PackageStatus status);
+
+private:
+  // max number of join stages, i.e. stages with several parents, in one pipeline
+  static constexpr int kMaxJoinNum = 8;
 
   // for inner processing
   struct _InnerPackage {
-    ParsingType package;
-    Callback_t  callback;
+    ParsingType               package;
+    std::atomic<Callback_t>   callback{nullptr};
+    void                     *ctx      = nullptr;
+    PipelineClock::time_point deadline = kPipelineNoDeadline;
+    PackagePriority           priority = PackagePriority::PRIORITY_NORMAL;
+    PipelineInstance         *instance = nullptr;
+    // the branches of a DAG pipeline share the package, each holds one reference
+    std::atomic<int> refs{1};
+    // number of parents which have finished the package, for each join stage
+    std::atomic<int> join_arrivals[kMaxJoinNum]{};
+    // id of `PipelineTracer` records, 0 if not traced
+    uint64_t trace_id = 0;
+    // completed before going through all blocks, e.g. failed in another branch of a DAG pipeline
+    std::atomic<bool> finished{false};
+    AsyncCancelToken  cancel_token;
+    // latency breakdown requested by the caller, nullptr if not requested
+    PipelineLatencyRecordPtr latency;
+  };
+  // a package destroyed without being completed, e.g. cleared from queues when closing pipeline,
+  // is reported as `DROPPED`
+  struct _InnerPackageDeleter {
+    void operator()(_InnerPackage *inner_pack) const noexcept
+    {
+      if (inner_pack->refs.fetch_sub(1) != 1)
+      {
+        return;
+      }
+      if (inner_pack->callback.load() != nullptr)
+      {
+        Complete(inner_pack, PackageStatus::DROPPED);
+      }
+      auto instance = inner_pack->instance;
+      instance->package_pool_.Delete(inner_pack);
+      instance->ReleaseInFlight();
+    }
+  };
+  using InnerParsingType = std::unique_ptr<_InnerPackage, _InnerPackageDeleter>;
+  using InnerBlock_t     = AsyncPipelineBlock<_InnerPackage *>;
+  using InnerContext_t   = AsyncPipelineContext<_InnerPackage *>;
+  using InnerQueue_t     = IBlockQueue<InnerParsingType>;
+
+  struct _LaneOfPackage {
+    size_t operator()(const InnerParsingType &inner_pack) const noexcept
+    {
+      return inner_pack->priority;
+    }
+  };
+  using InnerPriorityQueue_t = PriorityBlockQueue<InnerParsingType, _LaneOfPackage>;
+
+  // one sample of a block taken by the bottleneck sampler
+  struct _LoadSample {
+    PipelineClock::time_point time;
+    size_t                    queue_depth = 0;
+    StageLoadSnapshot         load;
+  };
+
+  // runtime states of one block, served by its shared stage if any
+  struct _StageRuntime : public ISharedStageClient {
+    _StageRuntime(const InnerBlock_t &_block, bool _dedicated, std::shared_ptr<InnerQueue_t> _input)
+        : block(_block),
+          parallelism(_block.GetParallelism()),
+          keep_order(_block.IsKeepOrder()),
+          dedicated(_dedicated),
+          input(std::move(_input)),
+          reorder_buffer(parallelism),
+          blocked_output(kBlockedOutputInitCapacity),
+          alive_workers(parallelism)
+    {
+      if (block.IsBatchBlock())
+      {
+        batch.reserve(block.GetMaxBatchSize());
+        batch_units.reserve(block.GetMaxBatchSize());
+      }
+      emit_run.reserve(parallelism);
+    }
+
+    const InnerBlock_t            block;
+    const int                     parallelism;
+    const bool                    keep_order;
+    const bool                    dedicated;
+    std::shared_ptr<InnerQueue_t> input;
+    // the next stages, empty for the output stage
+    std::vector<_StageRuntime *> children;
+    // the previous stages, empty for the input stage
+    std::vector<_StageRuntime *> parents;
+    // number of parent stages, a join stage waits for all of them
+    int parent_num = 1;
+    // index of `_InnerPackage::join_arrivals`, -1 if not a join stage
+    int join_index = -1;
+    // number of running parent stages, no more input once all of them quit
+    std::atomic<int> alive_parents{1};
+    // id of the block name in `PipelineTracer` records
+    uint32_t trace_name = 0;
+    // index of the block in `PipelineLatencyRecord`
+    size_t index = 0;
+    // moving average of the service time of one package, in nanoseconds
+    std::atomic<int64_t> service_ns{0};
+    // load of the block, and its samples taken by the bottleneck sampler in a ring
+    StageLoadCounters        load;
+    std::vector<_LoadSample> load_samples;
+    size_t                   next_sample = 0;
+
+    // order the packages taken from the input queue, read without lock by executor tasks
+    std::mutex          take_mtx;
+    std::atomic<size_t> next_ticket{0};
+
+    // reorder buffer, indexed by `ticket % parallelism`. One worker at a time is the emitter,
+    // which forwards the packages in order without holding `emit_mtx`.
+    std::mutex                                     emit_mtx;
+    std::condition_variable                        emit_cv;
+    std::atomic<size_t>                            next_emit{0};
+    bool                                           emitting = false;
+    std::vector<std::pair<bool, InnerParsingType>> reorder_buffer;
+    // the in-order run taken from the reorder buffer by the emitter
+    std::vector<InnerParsingType> emit_run;
+
+    // the outputs of an executor stage which found the next queue full, kept in order with the
+    // next stage of each. The stage takes no package until the next stages take them all.
+    std::mutex                                               output_mtx;
+    RingBuffer<std::pair<_StageRuntime *, InnerParsingType>> blocked_output;
+    std::atomic<bool>                                        output_blocked{false};
+
+    // the packages collected by a batch block
+    std::vector<InnerParsingType> batch;
+    std::vector<_InnerPackage *>  batch_units;
+
+    // number of running dedicated threads
+    std::atomic<int> alive_workers;
+    // number of scheduled executor tasks
+    std::atomic<int> scheduled_tasks{0};
+
+    // the shared stage running the block instead of dedicated threads or executor tasks
+    SharedPipelineStage *shared_stage = nullptr;
+    PipelineInstance    *instance     = nullptr;
+
+    bool RunOne() override
+    {
+      return instance->RunSharedStage(*this);
+    }
   };
-  using InnerParsingType = std::shared_ptr<_InnerPackage>;
-  using InnerBlock_t     = AsyncPipelineBlock<InnerParsingType>;
-  using InnerContext_t   = AsyncPipelineContext<InnerParsingType>;
+
+  // max packages processed by one executor task before it yields to the others
+  static constexpr int kTaskBatchSize = 32;
+  // the adaptive queue depth is updated once every so many processed packages
+  static constexpr uint32_t kAdaptInterval = 64;
+  // initial capacity of the outputs kept aside by a blocked executor stage
+  static constexpr size_t kBlockedOutputInitCapacity = 4;
+  // number of package headers allocated by the pool at once
+  static constexpr size_t kPackagePoolSlabSize = 64;
+  // number of samples kept for each block by the bottleneck sampler
+  static constexpr size_t kLoadSampleWindow = 32;
 
 public:
   PipelineInstance() = default;
 
   PipelineInstance(const std::vector<Context_t> &block_list) : context_(block_list)
   {
-    // initialize inner context
-    std::vector<InnerBlock_t> inner_block_list;
-    for (const auto &block : context_.blocks_)
-    {
-      auto         func = [&](InnerParsingType p) -> bool { return block(p->package); };
-      InnerBlock_t inner_block(func, block.GetName());
-      inner_block_list.push_back(inner_block);
-    }
-    inner_context_ = InnerContext_t(inner_block_list);
+    CompileContext(context_, inner_context_, inner_parents_);
   }
 
   ~PipelineInstance()
@@ -167,60 +760,196 @@ public:
 
   void Init(int bq_max_size = 100)
   {
-    // 1. for `n` blocks, construct `n+1` block queues
-    const auto blocks = inner_context_.blocks_;
-    const int  n      = blocks.size();
-    LOG_DEBUG("[AsyncPipelineInstance] Total {%d} Pipeline Blocks", n);
-    for (int i = 0; i < n + 1; ++i)
-    {
-      block_queue_.emplace_back(std::make_shared<BlockQueue<InnerParsingType>>(bq_max_size));
-    }
-    pipeline_close_flag_.store(false);
+    AsyncPipelineConfig config;
+    config.bq_max_size = bq_max_size;
+    Init(config);
+  }
 
-    async_futures_.resize(n + 1);
-    // 2. open `n` async threads to execute blocks
-    for (int i = 0; i < n; ++i)
+  void Init(const AsyncPipelineConfig &config)
+  {
+    size_t auto_cpu_cursor = 0;
+    Init(config, auto_cpu_cursor);
+  }
+
+  /**
+   * @brief Initialize the pipeline. The threads auto-assigned by the placement policy take the
+   * cpus from `auto_cpu_cursor` on, so several pipelines sharing a cursor do not overlap.
+   *
+   * @param config
+   * @param auto_cpu_cursor
+   */
+  void Init(const AsyncPipelineConfig &config, size_t &auto_cpu_cursor)
+  {
+    if (pipeline_initialized_)
     {
-      async_futures_[i] = std::async(&PipelineInstance::ThreadExcuteEntry, this, block_queue_[i],
-                                     block_queue_[i + 1], blocks[i]);
+      LOG_WARN("[AsyncPipelineInstance] pipeline is already initialized, skip `Init`.");
+      return;
     }
-    // 3. open output threads to execute callback
-    async_futures_[n] = std::async(&PipelineInstance::ThreadOutputEntry, this, block_queue_[n]);
-
+    config_          = config;
+    auto_cpu_cursor_ = auto_cpu_cursor;
+    StartStages(config, auto_cpu_cursor);
+    StartSampler(config.bottleneck_sample_ms);
+    OpenAdmission();
     pipeline_initialized_.store(true);
   }
 
+  /**
+   * @brief Close the pipeline. The un-finished packages are completed with `DROPPED` status, and
+   * the pushes waiting at the admission gate return. Call `Drain` first to finish them instead.
+   *
+   */
   void ClosePipeline()
   {
     if (pipeline_initialized_)
     {
-      LOG_DEBUG("[AsyncPipelineInstance] Closing pipeline ...");
-      for (const auto &bq : block_queue_)
+      // unblock the pushes waiting on full queues before waiting for them
       {
-        bq->DisableAndClear();
+        std::lock_guard<std::mutex> lk(admission_mtx_);
+        admission_open_.store(false);
+        admission_closing_ = true;
       }
-      LOG_DEBUG("[AsyncPipelineInstance] Disabled all block queue ...");
-      pipeline_close_flag_.store(true);
-
-      for (auto &future : async_futures_)
+      admission_cv_.notify_all();
+      for (const auto &stage : stages_)
       {
-        auto res = future.get();
+        stage->input->DisableAndClear();
       }
-      LOG_DEBUG("[AsyncPipelineInstance] Join all block queue ...");
-      block_queue_.clear();
-      LOG_DEBUG("[AsyncPipelineInstance] Async pipeline is released successfully!!");
-      pipeline_initialized_ = false;
-      pipeline_close_flag_.store(true);
+      CloseAdmission();
+      StopSampler();
+      ShutdownStages();
+      {
+        std::lock_guard<std::mutex> lk(admission_mtx_);
+        pipeline_initialized_ = false;
+        admission_closing_    = false;
+      }
+      admission_cv_.notify_all();
       pipeline_no_more_input_.store(true);
     }
   }
 
+  /**
+   * @brief Stop admission and wait until all the packages in flight are completed. The pushes
+   * wait at the admission gate until `Resume` or `Reconfigure` is called. Return false and reopen
+   * admission if it is not drained in `timeout_ms`, or the pipeline is not initialized.
+   *
+   * @param timeout_ms wait forever if < 0.
+   * @return true
+   * @return false
+   */
+  bool Drain(int timeout_ms = -1)
+  {
+    if (!pipeline_initialized_)
+    {
+      return false;
+    }
+    CloseAdmission();
+    std::unique_lock<std::mutex> lk(drain_mtx_);
+    auto drained = [this] { return in_flight_.load() == 0; };
+    if (timeout_ms < 0)
+    {
+      drain_cv_.wait(lk, drained);
+    } else if (!drain_cv_.wait_for(lk, std::chrono::milliseconds(timeout_ms), drained))
+    {
+      lk.unlock();
+      LOG_WARN("[AsyncPipelineInstance] drain timeout, %zu packages in flight, reopen admission.",
+               in_flight_.load());
+      OpenAdmission();
+      return false;
+    }
+    LOG_DEBUG("[AsyncPipelineInstance] pipeline is drained.");
+    return true;
+  }
+
+  /**
+   * @brief Reopen admission after `Drain`.
+   *
+   */
+  void Resume()
+  {
+    if (pipeline_initialized_)
+    {
+      OpenAdmission();
+    }
+  }
+
+  /**
+   * @brief Drain the running pipeline, rebuild it with `block_list` and `config`, and reopen
+   * admission. The pushes waiting at the admission gate go into the new pipeline. Return false
+   * and keep the old one running if `block_list` or `config` is invalid, or it is not drained in
+   * `timeout_ms`. The auto-assigned cpus are taken from the same cursor as `Init`.
+   *
+   * @param block_list
+   * @param config
+   * @param timeout_ms wait forever if < 0.
+   * @return true
+   * @return false
+   */
+  bool Reconfigure(const std::vector<Context_t> &block_list,
+                   const AsyncPipelineConfig    &config,
+                   int                           timeout_ms = -1)
+  {
+    // compile the new pipeline aside, the running one is untouched if it is invalid
+    Context_t                     context(block_list);
+    InnerContext_t                inner_context;
+    std::vector<std::vector<int>> inner_parents;
+    try
+    {
+      ValidateConfig(config);
+      CompileContext(context, inner_context, inner_parents);
+    } catch (const std::exception &e)
+    {
+      LOG_ERROR("[AsyncPipelineInstance] `Reconfigure` got invalid pipeline : %s", e.what());
+      return false;
+    }
+    if (!Drain(timeout_ms))
+    {
+      return false;
+    }
+    StopSampler();
+    ShutdownStages();
+    std::swap(context_.blocks_, context.blocks_);
+    std::swap(inner_context_.blocks_, inner_context.blocks_);
+    std::swap(inner_parents_, inner_parents);
+    if (!RestartStages(config))
+    {
+      // roll back to the old pipeline
+      std::swap(context_.blocks_, context.blocks_);
+      std::swap(inner_context_.blocks_, inner_context.blocks_);
+      std::swap(inner_parents_, inner_parents);
+      if (!RestartStages(config_))
+      {
+        LOG_ERROR("[AsyncPipelineInstance] failed to restore the pipeline, it is closed.");
+        {
+          std::lock_guard<std::mutex> lk(admission_mtx_);
+          pipeline_initialized_ = false;
+        }
+        admission_cv_.notify_all();
+        pipeline_no_more_input_.store(true);
+        return false;
+      }
+      OpenAdmission();
+      return false;
+    }
+    config_ = config;
+    OpenAdmission();
+    LOG_DEBUG("[AsyncPipelineInstance] pipeline is reconfigured.");
+    return true;
+  }
+
+  /**
+   * @brief Same as `Reconfigure` with the current blocks, e.g. to change the queue depth.
+   *
+   */
+  bool Reconfigure(const AsyncPipelineConfig &config, int timeout_ms = -1)
+  {
+    return Reconfigure({context_}, config, timeout_ms);
+  }
+
   void StopPipeline()
   {
     if (pipeline_initialized_)
     {
       pipeline_no_more_input_.store(true);
-      block_queue_[0]->SetNoMoreInput();
+      stages_[0]->input->SetNoMoreInput();
     }
   }
 
@@ -229,105 +958,1645 @@ public:
     return pipeline_initialized_;
   }
 
-  const Context_t &GetContext() const
+  /**
+   * @brief Return the number of packages pushed but not completed yet.
+   *
+   * @return size_t
+   */
+  size_t GetInFlightCount() const noexcept
   {
-    return context_;
+    return in_flight_.load();
   }
 
-  void PushPipeline(const ParsingType &obj, const Callback_t &callback)
+  /**
+   * @brief Return the wait statistics of the input queue of each block, in pipeline order. The
+   * last one is the output stage.
+   *
+   * @return std::vector<std::pair<std::string, QueueWaitStats>>
+   */
+  std::vector<std::pair<std::string, QueueWaitStats>> GetQueueWaitStats() const
   {
-    auto inner_pack      = std::make_shared<_InnerPackage>();
-    inner_pack->package  = obj;
-    inner_pack->callback = callback;
-
-    block_queue_[0]->BlockPush(inner_pack);
+    std::lock_guard<std::mutex>                         lk(stages_mtx_);
+    std::vector<std::pair<std::string, QueueWaitStats>> stats;
+    for (const auto &stage : stages_)
+    {
+      stats.emplace_back(stage->block.GetName(), stage->input->GetWaitStats());
+    }
+    return stats;
   }
 
-private:
-  bool ThreadExcuteEntry(std::shared_ptr<BlockQueue<InnerParsingType>> bq_input,
-                         std::shared_ptr<BlockQueue<InnerParsingType>> bq_output,
-                         const InnerBlock_t                           &pipeline_block)
+  /**
+   * @brief Return the load of each block over the recent samples of the bottleneck sampler, and
+   * which one is the bottleneck. The report is empty if the sampler is disabled, see
+   * `AsyncPipelineConfig::bottleneck_sample_ms`.
+   *
+   * @return PipelineBottleneckReport
+   */
+  PipelineBottleneckReport GetBottleneckReport() const
   {
-    LOG_DEBUG("[AsyncPipelineInstance] {%s} thread start!", pipeline_block.GetName().c_str());
-    while (!pipeline_close_flag_)
+    std::lock_guard<std::mutex> lk(stages_mtx_);
+    PipelineBottleneckReport    report;
+    for (const auto &stage : stages_)
     {
-      auto data = bq_input->Take();
-      if (!data.has_value())
+      const auto &samples = stage->load_samples;
+      if (samples.size() < 2)
       {
-        if (pipeline_no_more_input_)
-        {
-          LOG_DEBUG("[AsyncPipelineInstance] {%s} set no more output ...",
-                    pipeline_block.GetName().c_str());
-          bq_output->SetNoMoreInput();
-          break;
-        } else
-        {
-          continue;
-        }
+        return {};
+      }
+      // the oldest sample is the next one to overwrite once the ring is full
+      const size_t oldest_index =
+          samples.size() < kLoadSampleWindow ? 0 : stage->next_sample % kLoadSampleWindow;
+      const auto &oldest  = samples[oldest_index];
+      const auto &newest  = samples[(stage->next_sample - 1) % kLoadSampleWindow];
+      const auto  elapsed = ToNanoseconds(newest.time - oldest.time);
+      if (elapsed <= 0)
+      {
+        return {};
       }
+      report.window_ms = elapsed / 1e6;
 
-      try
+      StageLoadStats stats;
+      stats.name           = stage->block.GetName();
+      stats.parallelism    = stage->parallelism;
+      stats.queue_capacity = stage->input->GetMaxSize();
+      for (const auto &sample : samples)
       {
-        auto start = std::chrono::high_resolution_clock::now();
-        pipeline_block(data.value());
-        auto end = std::chrono::high_resolution_clock::now();
-        LOG_DEBUG("[AsyncPipelineInstance] Block name: {%s}, cost(us): %ld",
-                  pipeline_block.GetName().c_str(),
-                  std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
-      } catch (const std::exception &e)
+        stats.queue_depth += sample.queue_depth;
+        stats.max_queue_depth = std::max(stats.max_queue_depth, sample.queue_depth);
+      }
+      stats.queue_depth /= samples.size();
+
+      const int64_t busy_ns   = newest.load.busy_ns - oldest.load.busy_ns;
+      const auto    processed = newest.load.processed - oldest.load.processed;
+      stats.busy_ratio =
+          std::min(static_cast<double>(busy_ns) / elapsed / stage->parallelism, 1.0);
+      stats.headroom   = 1.0 - stats.busy_ratio;
+      stats.throughput = processed * 1e9 / elapsed;
+      if (busy_ns > 0)
       {
-        LOG_ERROR(
-            "[AsyncPipelineInstance] {%s}, excute block function failed! Got exception : %s, Drop "
-            "package.",
-            pipeline_block.GetName().c_str(), e.what());
-        continue;
+        stats.capacity = processed * 1e9 * stage->parallelism / busy_ns;
+      }
+      ServiceTimeHistogram service;
+      for (int i = 0; i < ServiceTimeHistogram::kBucketNum; ++i)
+      {
+        service.counts[i] = newest.load.service.counts[i] - oldest.load.service.counts[i];
       }
+      stats.service_p50_us = service.Percentile(0.5) / 1e3;
+      stats.service_p90_us = service.Percentile(0.9) / 1e3;
+      stats.service_p99_us = service.Percentile(0.99) / 1e3;
 
-      bq_output->BlockPush(data.value());
+      if (report.bottleneck < 0 || stats.busy_ratio > report.stages[report.bottleneck].busy_ratio)
+      {
+        report.bottleneck = report.stages.size();
+      }
+      report.stages.push_back(std::move(stats));
     }
-    LOG_DEBUG("[AsyncPipelineInstance] {%s} thread quit!", pipeline_block.GetName().c_str());
+    report.saturated = report.bottleneck >= 0 && report.stages[report.bottleneck].busy_ratio >=
+                                                     PipelineBottleneckReport::kSaturatedBusyRatio;
+    return report;
+  }
+
+  /**
+   * @brief Return the number of heap allocations made for the package headers.
+   *
+   * @return size_t
+   */
+  size_t GetHeapAllocationCount() const noexcept
+  {
+    return package_pool_.GetHeapAllocationCount();
+  }
+
+  const Context_t &GetContext() const
+  {
+    return context_;
+  }
+
+  /**
+   * @brief Push a package into pipeline, `callback` is called with `ctx` and the final status of
+   * it exactly once. It waits at the admission gate while the pipeline is drained, and the package
+   * is completed with `DROPPED` status if the pipeline is closed meanwhile.
+   *
+   * @param obj
+   * @param callback
+   * @param ctx
+   * @param cover_oldest if the input queue is full for the priority, drop the oldest package of the
+   * lowest priority not higher than it instead of blocking, or this one if there is none.
+   * @param deadline the package is completed with `TIMEOUT` status if it is not finished by then.
+   * @param priority
+   * @param cancel_token the package is completed with `CANCELLED` status at the next block once it
+   * is cancelled.
+   * @param latency filled with the latency breakdown of the package before `callback` is called.
+   * nullptr if not needed.
+   */
+  void PushPipeline(const ParsingType              &obj,
+                    Callback_t                      callback,
+                    void                           *ctx,
+                    bool                            cover_oldest = false,
+                    const PipelineClock::time_point deadline     = kPipelineNoDeadline,
+                    PackagePriority                 priority     = PackagePriority::PRIORITY_NORMAL,
+                    const AsyncCancelToken         &cancel_token = AsyncCancelToken(),
+                    const PipelineLatencyRecordPtr &latency      = nullptr)
+  {
+    if (cancel_token.IsCancelled())
+    {
+      FinishLatencyRecord(latency);
+      callback(ctx, obj, PackageStatus::CANCELLED);
+      return;
+    }
+    if (!EnterAdmission(true))
+    {
+      LOG_WARN("[AsyncPipelineInstance] pipeline is closed, Drop package.");
+      FinishLatencyRecord(latency);
+      callback(ctx, obj, PackageStatus::DROPPED);
+      return;
+    }
+    if (!cover_oldest && !IsAdmissible(deadline))
+    {
+      LeaveAdmission();
+      LOG_DEBUG("[AsyncPipelineInstance] pipeline is overloaded, Reject package.");
+      FinishLatencyRecord(latency);
+      callback(ctx, obj, PackageStatus::REJECTED);
+      return;
+    }
+    PushPackage(obj, callback, ctx, cover_oldest, deadline, priority, cancel_token, latency);
+    LeaveAdmission();
+  }
+
+  /**
+   * @brief Return false if a package pushed now is estimated to miss the SLO of admission control
+   * or `deadline`, see `AsyncPipelineConfig::admission_slo_ms`. Always true if admission control is
+   * disabled, or the pipeline is being drained or closed, in which case the push blocks or drops.
+   *
+   * @param deadline
+   * @return true
+   * @return false
+   */
+  bool Admit(const PipelineClock::time_point deadline = kPipelineNoDeadline)
+  {
+    if (admission_slo_ns_.load(std::memory_order_relaxed) == 0 || !EnterAdmission(false))
+    {
+      return true;
+    }
+    const bool admissible = IsAdmissible(deadline);
+    LeaveAdmission();
+    return admissible;
+  }
+
+  /**
+   * @brief Drop the oldest package of the lowest priority which is waiting in the earliest
+   * non-empty block queue, so the dropped one wasted the least processing. Its blobs buffer is
+   * released once it is completed with `DROPPED` status. Return false if no package could be
+   * dropped, e.g. the pipeline is being drained.
+   *
+   * @return true
+   * @return false
+   */
+  bool DropOldest()
+  {
+    if (!EnterAdmission(false))
+    {
+      return false;
+    }
+    const bool dropped = DropOldestPackage();
+    LeaveAdmission();
+    return dropped;
+  }
+
+private:
+  /**
+   * @brief Compile the blocks of `context` into `inner_context`. Trivial blocks are removed and
+   * fusible blocks are merged into the previous ones.
+   *
+   */
+  void CompileContext(const Context_t               &context,
+                      InnerContext_t                &inner_context,
+                      std::vector<std::vector<int>> &inner_parents_out)
+  {
+    std::vector<InnerBlock_t>     inner_block_list;
+    std::vector<std::vector<int>> inner_parents;
+    // inner block indices which stand for each block name, -1 is the input of pipeline
+    std::unordered_map<std::string, std::vector<int>> name2inner;
+    // parents of the next block without declared dependencies
+    std::vector<int> prev_parents = {-1};
+
+    for (const auto &block : context.blocks_)
+    {
+      auto parents =
+          block.HasDependencies() ? ResolveParents(block, name2inner) : prev_parents;
+      const int last = static_cast<int>(inner_block_list.size()) - 1;
+      if (block.IsTrivial())
+      {
+        LOG_DEBUG("[AsyncPipelineInstance] {%s} is trivial, removed from pipeline.",
+                  block.GetName().c_str());
+      } else if (block.IsBatchBlock())
+      {
+        inner_block_list.push_back(BuildInnerBatchBlock(block));
+        inner_parents.push_back(parents);
+        parents = {last + 1};
+      } else if (block.IsFusible() && block.GetSharedStage() == nullptr && last >= 0 &&
+                 parents == std::vector<int>{last} && !inner_block_list.back().IsBatchBlock())
+      {
+        inner_block_list.back() = FuseInnerBlock(inner_block_list.back(), block);
+      } else
+      {
+        auto         func = [&](_InnerPackage *p) -> bool { return block(p->package); };
+        InnerBlock_t inner_block(func, block.GetName(), block.GetParallelism(),
+                                 block.IsKeepOrder());
+        inner_block.SetDedicatedThread(block.IsDedicatedThread());
+        inner_block.SetSharedStage(block.GetSharedStage());
+        inner_block_list.push_back(inner_block);
+        inner_parents.push_back(parents);
+        parents = {last + 1};
+      }
+      // a removed block stands for its parents, a fused one for the block it is fused into
+      name2inner[block.GetName()] = parents;
+      prev_parents                = parents;
+    }
+
+    // several blocks start from the input, fan out from an extra input block
+    int root_num = 0;
+    for (const auto &parents : inner_parents)
+    {
+      root_num += std::count(parents.begin(), parents.end(), -1);
+    }
+    if (root_num > 1 || (root_num == 1 && inner_parents[0] != std::vector<int>{-1}))
+    {
+      for (auto &parents : inner_parents)
+      {
+        for (auto &parent : parents)
+        {
+          parent += 1;
+        }
+      }
+      inner_block_list.insert(inner_block_list.begin(), BuildInputBlock());
+      inner_parents.insert(inner_parents.begin(), {-1});
+    }
+
+    // each package tracks the arrivals of every join block, the parents of one are not limited
+    const auto join_num = std::count_if(inner_parents.begin(), inner_parents.end(),
+                                        [](const std::vector<int> &p) { return p.size() > 1; });
+    if (join_num > kMaxJoinNum)
+    {
+      throw std::invalid_argument("[AsyncPipelineInstance] too many join blocks, max: " +
+                                  std::to_string(kMaxJoinNum) +
+                                  ", Got: " + std::to_string(join_num));
+    }
+
+    inner_context.blocks_ = InnerContext_t(inner_block_list).blocks_;
+    inner_parents_out     = std::move(inner_parents);
+  }
+
+  /**
+   * @brief Map the declared dependencies of `block` to inner block indices.
+   *
+   */
+  static std::vector<int> ResolveParents(
+      const Block_t                                           &block,
+      const std::unordered_map<std::string, std::vector<int>> &name2inner)
+  {
+    std::vector<int> parents;
+    for (const auto &name : block.GetDependencies())
+    {
+      auto iter = name2inner.find(name);
+      if (iter == name2inner.end())
+      {
+        throw std::invalid_argument("[AsyncPipelineInstance] {" + block.GetName() +
+                                    "} depends on unknown block {" + name +
+                                    "}, the parents should be listed before it.");
+      }
+      parents.insert(parents.end(), iter->second.begin(), iter->second.end());
+    }
+    if (parents.empty())
+    {
+      parents.push_back(-1);
+    }
+    std::sort(parents.begin(), parents.end());
+    parents.erase(std::unique(parents.begin(), parents.end()), parents.end());
+    // the input of pipeline is implied by any other parent
+    if (parents.size() > 1 && parents.front() == -1)
+    {
+      parents.erase(parents.begin());
+    }
+    return parents;
+  }
+
+  static void ValidateConfig(const AsyncPipelineConfig &config)
+  {
+    if (config.priority_aging_ms < 0)
+    {
+      throw std::invalid_argument(
+          "[AsyncPipelineInstance] priority_aging_ms should be >= 0, Got: " +
+          std::to_string(config.priority_aging_ms));
+    }
+    if (config.target_latency_ms < 0 || config.min_queue_size < 1)
+    {
+      throw std::invalid_argument("[AsyncPipelineInstance] target_latency_ms should be >= 0 and "
+                                  "min_queue_size should be >= 1, Got: " +
+                                  std::to_string(config.target_latency_ms) + ", " +
+                                  std::to_string(config.min_queue_size));
+    }
+    if (config.admission_slo_ms < 0)
+    {
+      throw std::invalid_argument(
+          "[AsyncPipelineInstance] admission_slo_ms should be >= 0, Got: " +
+          std::to_string(config.admission_slo_ms));
+    }
+  }
+
+  /**
+   * @brief Construct the stages and open the dedicated threads.
+   *
+   */
+  void StartStages(const AsyncPipelineConfig &config, size_t &auto_cpu_cursor)
+  {
+    ValidateConfig(config);
+    target_latency_ns_.store(static_cast<int64_t>(config.target_latency_ms) * 1000000,
+                             std::memory_order_relaxed);
+    admission_slo_ns_.store(static_cast<int64_t>(config.admission_slo_ms) * 1000000,
+                            std::memory_order_relaxed);
+    min_queue_size_ = std::min(config.min_queue_size, config.bq_max_size);
+    max_queue_size_ = config.bq_max_size;
+    executor_ = config.executor != nullptr ? config.executor : GetDefaultPipelineExecutor();
+
+    // 1. for `n` blocks, construct `n+1` stages, the last one is the output stage
+    const auto &blocks = inner_context_.blocks_;
+    const int   n      = blocks.size();
+    LOG_DEBUG("[AsyncPipelineInstance] Total {%d} Pipeline Blocks", n);
+    // the output stage joins all the blocks without children
+    std::vector<bool> has_child(n, false);
+    for (const auto &parents : inner_parents_)
+    {
+      for (int parent : parents)
+      {
+        if (parent >= 0)
+        {
+          has_child[parent] = true;
+        }
+      }
+    }
+    std::vector<int> output_parents;
+    for (int i = 0; i < n; ++i)
+    {
+      if (!has_child[i])
+      {
+        output_parents.push_back(i);
+      }
+    }
+    if (output_parents.empty())
+    {
+      output_parents.push_back(-1);
+    }
+
+    auto block_names = std::make_shared<std::vector<std::string>>();
+    for (const auto &block : blocks)
+    {
+      block_names->push_back(block.GetName());
+    }
+    block_names_ = std::move(block_names);
+
+    int                         join_num = 0;
+    std::lock_guard<std::mutex> stages_lk(stages_mtx_);
+    for (int i = 0; i < n + 1; ++i)
+    {
+      const auto  block   = i < n ? blocks[i] : BuildOutputBlock();
+      const auto &parents = i < n ? inner_parents_[i] : output_parents;
+      const bool  shared = block.GetSharedStage() != nullptr && !block.IsBatchBlock();
+      const bool  dedicated =
+          !shared && (config.execution_mode == PipelineExecutionMode::DEDICATED_THREAD ||
+                      block.IsDedicatedThread() || block.IsBatchBlock());
+      stages_.emplace_back(std::make_unique<_StageRuntime>(
+          block, dedicated,
+          CreateInputQueue(config, i == 0 || block.IsBatchBlock(), parents.size() > 1)));
+
+      auto &stage      = *stages_.back();
+      stage.trace_name = PipelineTracer::RegisterName(block.GetName());
+      stage.index      = i;
+      if (config.wait_strategy.has_value())
+      {
+        stage.input->SetWaitStrategy(config.wait_strategy.value());
+      }
+      stage.parent_num = parents.size();
+      stage.alive_parents.store(stage.parent_num);
+      if (shared)
+      {
+        stage.shared_stage = block.GetSharedStage().get();
+        stage.instance     = this;
+        stage.shared_stage->Attach(&stage);
+      }
+      if (stage.parent_num > 1)
+      {
+        // bounded by `kMaxJoinNum` in `CompileContext`
+        stage.join_index = join_num++;
+      }
+      for (int parent : parents)
+      {
+        if (parent >= 0)
+        {
+          stages_[parent]->children.push_back(&stage);
+          stage.parents.push_back(stages_[parent].get());
+        }
+      }
+    }
+    pipeline_close_flag_.store(false);
+    pipeline_no_more_input_.store(false);
+
+    // 2. open async threads for the stages with dedicated threads, pinned by placement policy
+    const auto &placement = config.placement;
+    const auto  auto_cpus =
+        placement.auto_assign ? placement.GetAutoAssignCpus() : std::vector<int>();
+    if ((placement.auto_assign || !placement.block_cpus.empty()) &&
+        std::none_of(stages_.begin(), stages_.end(),
+                     [](const auto &stage) { return stage->dedicated; }))
+    {
+      LOG_WARN("[AsyncPipelineInstance] placement is set but no block has dedicated threads, it "
+               "is ignored. Pin the executor threads by `config.executor` instead.");
+    }
+    for (auto &stage : stages_)
+    {
+      auto iter = placement.block_cpus.find(stage->block.GetName());
+      for (int k = 0; stage->dedicated && k < stage->parallelism; ++k)
+      {
+        std::vector<int> cpus;
+        if (iter != placement.block_cpus.end())
+        {
+          cpus = iter->second;
+        } else if (!auto_cpus.empty())
+        {
+          cpus = {auto_cpus[auto_cpu_cursor++ % auto_cpus.size()]};
+        }
+        async_futures_.emplace_back(
+            std::async(&PipelineInstance::ThreadExcuteEntry, this, stage.get(), std::move(cpus)));
+      }
+    }
+  }
+
+  /**
+   * @brief Close the queues, join the threads and tasks, and destroy the stages.
+   *
+   */
+  void ShutdownStages()
+  {
+    LOG_DEBUG("[AsyncPipelineInstance] Closing pipeline ...");
+    for (const auto &stage : stages_)
+    {
+      stage->input->DisableAndClear();
+    }
+    LOG_DEBUG("[AsyncPipelineInstance] Disabled all block queue ...");
+    pipeline_close_flag_.store(true);
+    DetachSharedStages();
+
+    for (auto &future : async_futures_)
+    {
+      auto res = future.get();
+    }
+    {
+      std::unique_lock<std::mutex> lk(task_mtx_);
+      task_cv_.wait(lk, [this] { return running_tasks_ == 0; });
+    }
+    LOG_DEBUG("[AsyncPipelineInstance] Join all block queue ...");
+    async_futures_.clear();
+    {
+      std::lock_guard<std::mutex> stages_lk(stages_mtx_);
+      stages_.clear();
+    }
+    executor_.reset();
+    LOG_DEBUG("[AsyncPipelineInstance] Async pipeline is released successfully!!");
+  }
+
+  /**
+   * @brief Start the stages and the sampler of a drained pipeline again with `config`. Return
+   * false and release the stages if they could not be built.
+   *
+   */
+  bool RestartStages(const AsyncPipelineConfig &config)
+  {
+    try
+    {
+      size_t auto_cpu_cursor = auto_cpu_cursor_;
+      StartStages(config, auto_cpu_cursor);
+      StartSampler(config.bottleneck_sample_ms);
+    } catch (const std::exception &e)
+    {
+      LOG_ERROR("[AsyncPipelineInstance] failed to start pipeline : %s", e.what());
+      StopSampler();
+      ShutdownStages();
+      return false;
+    }
+    return true;
+  }
+
+  void PushPackage(const ParsingType              &obj,
+                   Callback_t                      callback,
+                   void                           *ctx,
+                   bool                            cover_oldest,
+                   const PipelineClock::time_point deadline,
+                   PackagePriority                 priority,
+                   const AsyncCancelToken         &cancel_token,
+                   const PipelineLatencyRecordPtr &latency)
+  {
+    if (latency != nullptr)
+    {
+      const auto now = PipelineClock::now();
+      latency->Reset(now, block_names_);
+      latency->RecordEnqueue(0, now);
+    }
+    InnerParsingType inner_pack(package_pool_.New<_InnerPackage>());
+    inner_pack->package      = obj;
+    inner_pack->callback     = callback;
+    inner_pack->ctx          = ctx;
+    inner_pack->deadline     = deadline;
+    inner_pack->priority     = priority;
+    inner_pack->instance     = this;
+    inner_pack->trace_id     = PipelineTracer::IsEnabled() ? PipelineTracer::NewPackageId() : 0;
+    inner_pack->cancel_token = cancel_token;
+    inner_pack->latency      = latency;
+    in_flight_.fetch_add(1);
+
+    if (!cover_oldest)
+    {
+      Deliver(*stages_[0], std::move(inner_pack));
+      return;
+    }
+
+    // the input queue of pipeline is always a `PriorityBlockQueue`
+    auto &input = static_cast<InnerPriorityQueue_t &>(*stages_[0]->input);
+
+    if (inner_pack->trace_id != 0)
+    {
+      PipelineTracer::RecordEnqueue(stages_[0]->trace_name, inner_pack->trace_id);
+    }
+    std::optional<InnerParsingType> evicted;
+    if (input.CoverPush(std::move(inner_pack), &evicted))
+    {
+      if (evicted.has_value())
+      {
+        Complete(evicted.value().get(), PackageStatus::DROPPED);
+      }
+      if (!stages_[0]->dedicated)
+      {
+        Schedule(*stages_[0]);
+      }
+    }
+  }
+
+  bool DropOldestPackage()
+  {
+    // the packages in front of output stage already have their results, keep them
+    for (size_t i = 0; i + 1 < stages_.size(); ++i)
+    {
+      // only the `PriorityBlockQueue` allows taking from a thread other than the consumer
+      auto input = dynamic_cast<InnerPriorityQueue_t *>(stages_[i]->input.get());
+      if (input == nullptr)
+      {
+        continue;
+      }
+      auto data = input->TryTakeLowest();
+      if (data.has_value())
+      {
+        ResumeBlockedParents(*stages_[i]);
+        Complete(data.value().get(), PackageStatus::DROPPED);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief Enter the admission gate before touching the stages. If admission is closed, wait until
+   * it is reopened when `wait` is true, else return false at once. Return false if the pipeline is
+   * closed.
+   *
+   */
+  bool EnterAdmission(bool wait)
+  {
+    while (true)
+    {
+      active_pushes_.fetch_add(1);
+      if (admission_open_.load())
+      {
+        return true;
+      }
+      LeaveAdmission();
+      if (!wait)
+      {
+        return false;
+      }
+      std::unique_lock<std::mutex> lk(admission_mtx_);
+      admission_cv_.wait(lk, [this] {
+        return admission_open_.load() || !pipeline_initialized_ || admission_closing_;
+      });
+      if (!admission_open_.load())
+      {
+        return false;
+      }
+    }
+  }
+
+  void LeaveAdmission()
+  {
+    if (active_pushes_.fetch_sub(1) == 1)
+    {
+      std::lock_guard<std::mutex> lk(admission_mtx_);
+      admission_cv_.notify_all();
+    }
+  }
+
+  /**
+   * @brief Close the admission gate, and wait until the pushes which already passed it are done.
+   *
+   */
+  void CloseAdmission()
+  {
+    admission_open_.store(false);
+    std::unique_lock<std::mutex> lk(admission_mtx_);
+    admission_cv_.wait(lk, [this] { return active_pushes_.load() == 0; });
+  }
+
+  void OpenAdmission()
+  {
+    {
+      std::lock_guard<std::mutex> lk(admission_mtx_);
+      admission_open_.store(true);
+    }
+    admission_cv_.notify_all();
+  }
+
+  void StartSampler(int interval_ms)
+  {
+    if (interval_ms <= 0)
+    {
+      return;
+    }
+    sampler_stop_   = false;
+    sampler_thread_ = std::thread(&PipelineInstance::SamplerEntry, this, interval_ms);
+  }
+
+  void StopSampler()
+  {
+    if (!sampler_thread_.joinable())
+    {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lk(sampler_mtx_);
+      sampler_stop_ = true;
+    }
+    sampler_cv_.notify_all();
+    sampler_thread_.join();
+  }
+
+  void SamplerEntry(int interval_ms)
+  {
+    std::unique_lock<std::mutex> lk(sampler_mtx_);
+    while (!sampler_cv_.wait_for(lk, std::chrono::milliseconds(interval_ms),
+                                 [this] { return sampler_stop_; }))
+    {
+      SampleStageLoad();
+    }
+  }
+
+  /**
+   * @brief Record the input queue depth and the load counters of every stage into its ring.
+   *
+   */
+  void SampleStageLoad()
+  {
+    std::lock_guard<std::mutex> lk(stages_mtx_);
+    const auto                  now = PipelineClock::now();
+    for (auto &stage : stages_)
+    {
+      _LoadSample sample;
+      sample.time        = now;
+      sample.queue_depth = stage->input->Size();
+      sample.load        = stage->load.GetSnapshot();
+      if (stage->load_samples.size() < kLoadSampleWindow)
+      {
+        stage->load_samples.push_back(std::move(sample));
+      } else
+      {
+        stage->load_samples[stage->next_sample % kLoadSampleWindow] = std::move(sample);
+      }
+      stage->next_sample++;
+    }
+  }
+
+  static int64_t ToNanoseconds(PipelineClock::duration duration) noexcept
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+  }
+
+  // called by the package deleter, wake up `Drain` when the last package in flight is released
+  void ReleaseInFlight() noexcept
+  {
+    if (in_flight_.fetch_sub(1) == 1)
+    {
+      std::lock_guard<std::mutex> lk(drain_mtx_);
+      drain_cv_.notify_all();
+    }
+  }
+
+  /**
+   * @brief The output stage takes packages from the blocks without children, the callbacks are
+   * called when `Forward` finds no next stage.
+   *
+   */
+  static InnerBlock_t BuildOutputBlock()
+  {
+    return InnerBlock_t([](_InnerPackage *) -> bool { return true; }, "Output");
+  }
+
+  /**
+   * @brief The input stage is only added when several blocks start from the input of pipeline, it
+   * fans out the packages to them.
+   *
+   */
+  static InnerBlock_t BuildInputBlock()
+  {
+    return InnerBlock_t([](_InnerPackage *) -> bool { return true; }, "Input");
+  }
+
+  /**
+   * @brief Append the fusible `block` to `prev`, it is skipped if `prev` fails.
+   *
+   */
+  static InnerBlock_t FuseInnerBlock(const InnerBlock_t &prev, const Block_t &block)
+  {
+    auto func = [prev, &block](_InnerPackage *p) -> bool { return prev(p) && block(p->package); };
+    LOG_DEBUG("[AsyncPipelineInstance] {%s} is fused into {%s}.", block.GetName().c_str(),
+              prev.GetName().c_str());
+    InnerBlock_t fused(func, prev.GetName() + " + " + block.GetName(), prev.GetParallelism(),
+                       prev.IsKeepOrder());
+    fused.SetDedicatedThread(prev.IsDedicatedThread());
+    fused.SetSharedStage(prev.GetSharedStage());
+    return fused;
+  }
+
+  /**
+   * @brief Wrap a batch block, the inner packages are unpacked into a vector which is reused by the
+   * dedicated thread of the block.
+   *
+   */
+  static InnerBlock_t BuildInnerBatchBlock(const Block_t &block)
+  {
+    auto func = [&block](const std::vector<_InnerPackage *> &inner_packs) -> bool {
+      thread_local std::vector<ParsingType> packages;
+      for (auto inner_pack : inner_packs)
+      {
+        packages.push_back(inner_pack->package);
+      }
+      bool ret = false;
+      try
+      {
+        ret = block(packages);
+      } catch (...)
+      {
+        packages.clear();
+        throw;
+      }
+      packages.clear();
+      return ret;
+    };
+    return InnerBlock_t(func, block.GetName(), block.GetMaxBatchSize(), block.GetMaxBatchWaitUs());
+  }
+
+  /**
+   * @brief Call the callback of package with its final status, and reset the callback so it is
+   * never called again.
+   *
+   */
+  static bool Complete(_InnerPackage *inner_pack, PackageStatus status) noexcept
+  {
+    if (inner_pack != nullptr)
+    {
+      inner_pack->finished.store(true, std::memory_order_relaxed);
+    }
+    // the branches of a DAG pipeline may complete the same package concurrently
+    auto callback = inner_pack == nullptr ? nullptr : inner_pack->callback.exchange(nullptr);
+    if (callback == nullptr)
+    {
+      LOG_WARN(
+          "[AsyncPipelineInstance] {Output} package without valid callback will be dropped!!!");
+      return false;
+    }
+    if (inner_pack->latency != nullptr)
+    {
+      inner_pack->latency->Finish(PipelineClock::now());
+    }
+    try
+    {
+      return callback(inner_pack->ctx, inner_pack->package, status);
+    } catch (const std::exception &e)
+    {
+      LOG_ERROR("[AsyncPipelineInstance] callback of package got exception : %s", e.what());
+      return false;
+    }
+  }
+
+  std::shared_ptr<InnerQueue_t> CreateInputQueue(const AsyncPipelineConfig &config,
+                                                 bool                       priority_block_queue,
+                                                 bool                       multi_producer) const
+  {
+    const auto aging_time = std::chrono::milliseconds(config.priority_aging_ms);
+    // the input of pipeline, and the input of batch blocks which wait on it with timeout
+    if (priority_block_queue)
+    {
+      return std::make_shared<InnerPriorityQueue_t>(config.bq_max_size, kPackagePriorityNum,
+                                                    aging_time);
+    }
+    if (config.queue_type == PipelineQueueType::SPSC_QUEUE && !multi_producer)
+    {
+      // every link between blocks has one producer and one consumer at a time, except the links
+      // into join blocks. The workers of a replicated block take turns under `take_mtx` and
+      // `emit_mtx`, and the executor tasks push under `output_mtx`.
+      return std::make_shared<SpscQueue<InnerParsingType>>(config.bq_max_size);
+    }
+    return std::make_shared<InnerPriorityQueue_t>(config.bq_max_size, kPackagePriorityNum,
+                                                  aging_time);
+  }
+
+  /**
+   * @brief Push the package into the input queue of `stage`, and schedule an executor task if
+   * the stage does not have dedicated threads. Blocks while the queue is full.
+   *
+   */
+  void Deliver(_StageRuntime &stage, InnerParsingType package)
+  {
+    if (!Arrive(stage, package) || !stage.input->BlockPush(std::move(package)))
+    {
+      return;
+    }
+    if (!stage.dedicated)
+    {
+      Schedule(stage);
+    }
+  }
+
+  /**
+   * @brief Record the arrival of the package at `stage`. Return false if it should not be pushed
+   * into the input queue.
+   *
+   */
+  bool Arrive(_StageRuntime &stage, const InnerParsingType &package)
+  {
+    // a join stage takes the package from the last arriving parent, the others only release their
+    // references. If a branch dropped it, the package never gets here and is `DROPPED` once the
+    // last reference is released.
+    if (stage.join_index >= 0 &&
+        package->join_arrivals[stage.join_index].fetch_add(1) + 1 < stage.parent_num)
+    {
+      return false;
+    }
+    if (package->trace_id != 0)
+    {
+      PipelineTracer::RecordEnqueue(stage.trace_name, package->trace_id);
+    }
+    if (package->latency != nullptr)
+    {
+      package->latency->RecordEnqueue(stage.index, PipelineClock::now());
+    }
+    return true;
+  }
+
+  /**
+   * @brief Push the arrived package into the input queue of `stage` if it is not full, and
+   * schedule an executor task if the stage does not have dedicated threads.
+   *
+   */
+  bool TryDeliver(_StageRuntime &stage, InnerParsingType &package)
+  {
+    if (!stage.input->TryPush(package))
+    {
+      return false;
+    }
+    if (!stage.dedicated)
+    {
+      Schedule(stage);
+    }
+    return true;
+  }
+
+  /**
+   * @brief Deliver the output of an executor or shared stage without blocking. If the next queue
+   * is full, or earlier outputs are still waiting, the package is kept in `blocked_output` and the
+   * stage stops taking packages until the next stages take some, see `ResumeBlockedParents`.
+   *
+   */
+  void DeliverOutput(_StageRuntime &stage, _StageRuntime &child, InnerParsingType package)
+  {
+    if (!Arrive(child, package))
+    {
+      return;
+    }
+    std::lock_guard<std::mutex> lk(stage.output_mtx);
+    if (stage.blocked_output.empty() && TryDeliver(child, package))
+    {
+      return;
+    }
+    stage.blocked_output.push_back({&child, std::move(package)});
+    stage.output_blocked.store(true);
+    // pairs with the take of the next stage before `ResumeBlockedParents`, either the next stage
+    // sees the flag or the retry sees the free slot.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    FlushBlockedOutputLocked(stage);
+  }
+
+  /**
+   * @brief Deliver the outputs kept aside in order, should be called with `output_mtx` locked.
+   * Return true if all of them are delivered.
+   *
+   */
+  bool FlushBlockedOutputLocked(_StageRuntime &stage)
+  {
+    auto &blocked_output = stage.blocked_output;
+    while (!blocked_output.empty())
+    {
+      if (!TryDeliver(*blocked_output.front().first, blocked_output.front().second))
+      {
+        return false;
+      }
+      blocked_output.pop_front();
+    }
+    stage.output_blocked.store(false);
     return true;
   }
 
-  bool ThreadOutputEntry(std::shared_ptr<BlockQueue<InnerParsingType>> bq_input)
+  bool FlushBlockedOutput(_StageRuntime &stage)
+  {
+    std::lock_guard<std::mutex> lk(stage.output_mtx);
+    return FlushBlockedOutputLocked(stage);
+  }
+
+  /**
+   * @brief Called after `stage` takes packages. The blocked parents deliver their outputs kept
+   * aside into the free slots, and are scheduled again once all are delivered.
+   *
+   */
+  void ResumeBlockedParents(_StageRuntime &stage)
+  {
+    for (auto parent : stage.parents)
+    {
+      if (parent->output_blocked.load() && FlushBlockedOutput(*parent))
+      {
+        ScheduleIfReady(*parent);
+      }
+    }
+  }
+
+  /**
+   * @brief An executor or shared stage takes packages only if its outputs are not blocked and its
+   * reorder window is not full, so the tasks and the shared worker never wait.
+   *
+   */
+  bool IsReady(_StageRuntime &stage)
+  {
+    return (!stage.output_blocked.load() || FlushBlockedOutput(stage)) && !IsWindowFull(stage);
+  }
+
+  bool IsWindowFull(const _StageRuntime &stage) const
+  {
+    return stage.keep_order && stage.parallelism > 1 &&
+           stage.next_ticket.load() >= stage.next_emit.load() + stage.parallelism;
+  }
+
+  void ScheduleIfReady(_StageRuntime &stage)
+  {
+    if (!stage.dedicated && !stage.input->Empty() && IsReady(stage))
+    {
+      Schedule(stage);
+    }
+  }
+
+  void Schedule(_StageRuntime &stage)
+  {
+    if (stage.shared_stage != nullptr)
+    {
+      stage.shared_stage->Notify(&stage);
+      return;
+    }
+    int scheduled = stage.scheduled_tasks.load();
+    while (scheduled < stage.parallelism)
+    {
+      if (stage.scheduled_tasks.compare_exchange_weak(scheduled, scheduled + 1))
+      {
+        {
+          std::lock_guard<std::mutex> lk(task_mtx_);
+          running_tasks_++;
+        }
+        executor_->Submit([this, &stage]() { ExecutorTaskEntry(stage); });
+        return;
+      }
+    }
+  }
+
+  /**
+   * @brief Take one package from the input queue of `stage`. The replicated workers take packages
+   * one by one, so the ticket records the input order.
+   *
+   */
+  std::optional<InnerParsingType> TakePackage(_StageRuntime &stage, bool block, size_t &ticket)
+  {
+    std::optional<InnerParsingType> data;
+    if (stage.parallelism == 1)
+    {
+      data = block ? stage.input->Take() : stage.input->TryTake();
+    } else
+    {
+      std::lock_guard<std::mutex> lk(stage.take_mtx);
+      // an executor task never takes a ticket which has to wait for the reorder window
+      if (!block && IsWindowFull(stage))
+      {
+        return std::nullopt;
+      }
+      data = block ? stage.input->Take() : stage.input->TryTake();
+      if (data.has_value())
+      {
+        ticket = stage.next_ticket++;
+      }
+    }
+    if (data.has_value())
+    {
+      ResumeBlockedParents(stage);
+    }
+    return data;
+  }
+
+  bool ThreadExcuteEntry(_StageRuntime *stage, std::vector<int> cpus)
   {
-    LOG_DEBUG("[AsyncPipelineInstance] {Output} thread start!");
+    const auto &pipeline_block = stage->block;
+    LOG_DEBUG("[AsyncPipelineInstance] {%s} thread start!", pipeline_block.GetName().c_str());
+    if (!cpus.empty() && !SetCurrentThreadAffinity(cpus))
+    {
+      LOG_WARN("[AsyncPipelineInstance] {%s} failed to pin thread, it floats freely.",
+               pipeline_block.GetName().c_str());
+    }
     while (!pipeline_close_flag_)
     {
-      auto data = bq_input->Take();
+      size_t ticket = 0;
+      auto   data   = TakePackage(*stage, true, ticket);
       if (!data.has_value())
       {
         if (pipeline_no_more_input_)
         {
-          LOG_DEBUG("[AsyncPipelineInstance] {Output} set no more output ...");
+          // the last quitting worker tells the next blocks, which quit after all their parents
+          if (stage->alive_workers.fetch_sub(1) == 1)
+          {
+            LOG_DEBUG("[AsyncPipelineInstance] {%s} set no more output ...",
+                      pipeline_block.GetName().c_str());
+            for (auto child : stage->children)
+            {
+              if (child->alive_parents.fetch_sub(1) == 1)
+              {
+                child->input->SetNoMoreInput();
+              }
+            }
+          }
           break;
         } else
         {
           continue;
         }
       }
-      const auto &inner_pack = data.value();
-      if (inner_pack != nullptr && inner_pack->callback != nullptr)
+
+      if (pipeline_block.IsBatchBlock())
       {
-        inner_pack->callback(inner_pack->package);
+        ProcessBatch(*stage, std::move(data.value()));
       } else
       {
-        LOG_WARN(
-            "[AsyncPipelineInstance] {Output} package without valid callback will be dropped!!!");
+        ProcessPackage(*stage, ticket, std::move(data.value()));
+      }
+    }
+    LOG_DEBUG("[AsyncPipelineInstance] {%s} thread quit!", pipeline_block.GetName().c_str());
+    return true;
+  }
+
+  void ExecutorTaskEntry(_StageRuntime &stage)
+  {
+    for (int i = 0; i < kTaskBatchSize; ++i)
+    {
+      size_t                          ticket = 0;
+      std::optional<InnerParsingType> data;
+      if (IsReady(stage))
+      {
+        data = TakePackage(stage, false, ticket);
+      }
+      if (!data.has_value())
+      {
+        stage.scheduled_tasks.fetch_sub(1);
+        // a package may be delivered, or the stage unblocked, after `TryTake` but before the
+        // decrement
+        ScheduleIfReady(stage);
+        std::lock_guard<std::mutex> lk(task_mtx_);
+        if (--running_tasks_ == 0)
+        {
+          task_cv_.notify_all();
+        }
+        return;
       }
+      ProcessPackage(stage, ticket, std::move(data.value()));
+    }
+    // yield to the other tasks, the scheduled slot is handed to the new task
+    executor_->Submit([this, &stage]() { ExecutorTaskEntry(stage); });
+  }
+
+  /**
+   * @brief Complete the latency record of a package which never entered the pipeline.
+   *
+   */
+  static void FinishLatencyRecord(const PipelineLatencyRecordPtr &latency)
+  {
+    if (latency != nullptr)
+    {
+      const auto now = PipelineClock::now();
+      latency->Reset(now, nullptr);
+      latency->Finish(now);
     }
-    LOG_DEBUG("[AsyncPipelineInstance] {Output} thread quit!");
+  }
 
+  /**
+   * @brief Process one package of `stage` on the worker of its shared stage. Like an executor
+   * task it never waits on a full queue, a blocked stage is notified again by
+   * `ResumeBlockedParents` so the worker serves the other stages meanwhile.
+   *
+   */
+  bool RunSharedStage(_StageRuntime &stage)
+  {
+    size_t                          ticket = 0;
+    std::optional<InnerParsingType> data;
+    if (IsReady(stage))
+    {
+      data = TakePackage(stage, false, ticket);
+    }
+    if (!data.has_value())
+    {
+      return false;
+    }
+    ProcessPackage(stage, ticket, std::move(data.value()));
+    ScheduleIfReady(stage);
     return true;
   }
 
+  /**
+   * @brief Stop the shared stages serving the stages, and wait for the packages being processed
+   * by them.
+   *
+   */
+  void DetachSharedStages()
+  {
+    for (const auto &stage : stages_)
+    {
+      if (stage->shared_stage != nullptr)
+      {
+        stage->shared_stage->Detach(stage.get());
+      }
+    }
+  }
+
+  void ProcessPackage(_StageRuntime &stage, size_t ticket, InnerParsingType package)
+  {
+    const auto &pipeline_block = stage.block;
+    bool        valid          = true;
+    if (package->finished.load(std::memory_order_relaxed))
+    {
+      valid = false;
+    } else if (package->cancel_token.IsCancelled())
+    {
+      // skip the rest blocks, the package releases its buffers once completed
+      LOG_DEBUG("[AsyncPipelineInstance] {%s}, package is cancelled, skip the rest blocks.",
+                pipeline_block.GetName().c_str());
+      Complete(package.get(), PackageStatus::CANCELLED);
+      valid = false;
+    } else if (!stage.children.empty() && package->deadline != kPipelineNoDeadline &&
+               PipelineClock::now() > package->deadline)
+    {
+      // expired packages skip the rest blocks, but the finished result still goes to the callback
+      LOG_DEBUG("[AsyncPipelineInstance] {%s}, package expired its deadline, Drop package.",
+                pipeline_block.GetName().c_str());
+      Complete(package.get(), PackageStatus::TIMEOUT);
+      valid = false;
+    } else
+    {
+      try
+      {
+        auto start = PipelineClock::now();
+        valid      = pipeline_block(package.get());
+        auto end   = PipelineClock::now();
+        stage.load.Record(ToNanoseconds(end - start), 1);
+        if (package->trace_id != 0)
+        {
+          PipelineTracer::RecordCompute(stage.trace_name, package->trace_id, start, end);
+        }
+        if (package->latency != nullptr)
+        {
+          package->latency->RecordCompute(stage.index, start, end);
+        }
+        if (IsServiceTimeTracked())
+        {
+          UpdateServiceTime(stage, end - start, 1);
+        }
+        LOG_DEBUG("[AsyncPipelineInstance] Block name: {%s}, cost(us): %ld",
+                  pipeline_block.GetName().c_str(),
+                  std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        if (!valid)
+        {
+          LOG_WARN("[AsyncPipelineInstance] {%s}, block function returned false, skip the rest "
+                   "blocks.",
+                   pipeline_block.GetName().c_str());
+        }
+      } catch (const std::exception &e)
+      {
+        LOG_ERROR(
+            "[AsyncPipelineInstance] {%s}, excute block function failed! Got exception : %s, skip "
+            "the rest blocks.",
+            pipeline_block.GetName().c_str(), e.what());
+        valid = false;
+      }
+      // fail fast, the package releases its buffers once completed
+      if (!valid)
+      {
+        Complete(package.get(), PackageStatus::FAILED);
+      }
+    }
+
+    if (stage.parallelism == 1)
+    {
+      if (valid)
+      {
+        Forward(stage, std::move(package));
+      }
+    } else if (!stage.keep_order)
+    {
+      if (valid)
+      {
+        // serialize the producers in case of a single-producer output queue
+        std::lock_guard<std::mutex> lk(stage.emit_mtx);
+        Forward(stage, std::move(package));
+      }
+    } else
+    {
+      // dropped package still takes its ticket, so the following ones will not wait for it
+      EmitInOrder(stage, ticket, valid ? std::move(package) : InnerParsingType());
+    }
+  }
+
+  /**
+   * @brief Collect a batch starting with `first` and process it by one call of the batch block.
+   * Expired packages are completed before the call and do not take part in the batch.
+   *
+   */
+  void ProcessBatch(_StageRuntime &stage, InnerParsingType first)
+  {
+    const auto &pipeline_block = stage.block;
+    const auto  max_batch_size = static_cast<size_t>(pipeline_block.GetMaxBatchSize());
+    // the input queue of a batch block is always a `PriorityBlockQueue`
+    auto &input = static_cast<InnerPriorityQueue_t &>(*stage.input);
+    auto &batch = stage.batch;
+
+    batch.push_back(std::move(first));
+    const auto wait_until =
+        PipelineClock::now() + std::chrono::microseconds(pipeline_block.GetMaxBatchWaitUs());
+    while (batch.size() < max_batch_size)
+    {
+      auto data = input.TakeUntil(wait_until);
+      if (!data.has_value())
+      {
+        break;
+      }
+      batch.push_back(std::move(data.value()));
+      ResumeBlockedParents(stage);
+    }
+
+    const auto now = PipelineClock::now();
+    for (auto &package : batch)
+    {
+      if (package->finished.load(std::memory_order_relaxed))
+      {
+        package.reset();
+      } else if (package->cancel_token.IsCancelled())
+      {
+        LOG_DEBUG("[AsyncPipelineInstance] {%s}, package is cancelled, skip the rest blocks.",
+                  pipeline_block.GetName().c_str());
+        Complete(package.get(), PackageStatus::CANCELLED);
+        package.reset();
+      } else if (package->deadline != kPipelineNoDeadline && now > package->deadline)
+      {
+        LOG_DEBUG("[AsyncPipelineInstance] {%s}, package expired its deadline, Drop package.",
+                  pipeline_block.GetName().c_str());
+        Complete(package.get(), PackageStatus::TIMEOUT);
+        package.reset();
+      } else
+      {
+        stage.batch_units.push_back(package.get());
+      }
+    }
+
+    bool valid = true;
+    if (!stage.batch_units.empty())
+    {
+      try
+      {
+        auto start = PipelineClock::now();
+        valid      = pipeline_block(stage.batch_units);
+        auto end   = PipelineClock::now();
+        stage.load.Record(ToNanoseconds(end - start), stage.batch_units.size());
+        for (auto unit : stage.batch_units)
+        {
+          if (unit->trace_id != 0)
+          {
+            PipelineTracer::RecordCompute(stage.trace_name, unit->trace_id, start, end);
+          }
+          if (unit->latency != nullptr)
+          {
+            unit->latency->RecordCompute(stage.index, start, end);
+          }
+        }
+        if (IsServiceTimeTracked())
+        {
+          UpdateServiceTime(stage, end - start, stage.batch_units.size());
+        }
+        LOG_DEBUG("[AsyncPipelineInstance] Block name: {%s}, batch size: %zu, cost(us): %ld",
+                  pipeline_block.GetName().c_str(), stage.batch_units.size(),
+                  std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        if (!valid)
+        {
+          LOG_WARN("[AsyncPipelineInstance] {%s}, batch function returned false, %zu packages skip "
+                   "the rest blocks.",
+                   pipeline_block.GetName().c_str(), stage.batch_units.size());
+        }
+      } catch (const std::exception &e)
+      {
+        LOG_ERROR(
+            "[AsyncPipelineInstance] {%s}, excute batch function failed! Got exception : %s, "
+            "%zu packages skip the rest blocks.",
+            pipeline_block.GetName().c_str(), e.what(), stage.batch_units.size());
+        valid = false;
+      }
+      if (!valid)
+      {
+        for (auto unit : stage.batch_units)
+        {
+          Complete(unit, PackageStatus::FAILED);
+        }
+      }
+    }
+
+    for (auto &package : batch)
+    {
+      if (valid && package != nullptr)
+      {
+        Forward(stage, std::move(package));
+      }
+    }
+    // the packages left are reported as `DROPPED` on destruction
+    batch.clear();
+    stage.batch_units.clear();
+  }
+
+  /**
+   * @brief Put the package processed by one of the replicated workers into the reorder buffer,
+   * and forward all the packages in input order. A nullptr package is a dropped one.
+   *
+   * The worker which finds no emitter becomes the emitter. It takes the ready run out of the
+   * buffer under the lock and forwards it after unlocking, so the other workers keep filling the
+   * buffer while it waits on a full next stage. Then it takes the next run, until none is ready.
+   *
+   */
+  void EmitInOrder(_StageRuntime &stage, size_t ticket, InnerParsingType package)
+  {
+    std::unique_lock<std::mutex> lk(stage.emit_mtx);
+    // the reorder buffer holds at most `parallelism` tickets in flight
+    const size_t window = stage.reorder_buffer.size();
+    stage.emit_cv.wait(lk, [&] { return ticket < stage.next_emit + window; });
+
+    stage.reorder_buffer[ticket % window] = {true, std::move(package)};
+    if (stage.emitting)
+    {
+      return;
+    }
+    stage.emitting = true;
+    auto &run      = stage.emit_run;
+    while (true)
+    {
+      while (stage.reorder_buffer[stage.next_emit % window].first)
+      {
+        auto &slot = stage.reorder_buffer[stage.next_emit % window];
+        slot.first = false;
+        if (slot.second != nullptr)
+        {
+          run.push_back(std::move(slot.second));
+        }
+        stage.next_emit++;
+      }
+      if (run.empty())
+      {
+        break;
+      }
+      // the slots of the run are free, wake up the workers waiting for the window
+      stage.emit_cv.notify_all();
+      lk.unlock();
+      for (auto &output : run)
+      {
+        Forward(stage, std::move(output));
+      }
+      run.clear();
+      lk.lock();
+    }
+    stage.emitting = false;
+    stage.emit_cv.notify_all();
+    lk.unlock();
+    // the executor tasks do not wait for the window, schedule them once it moves
+    ScheduleIfReady(stage);
+  }
+
+  bool IsServiceTimeTracked() const
+  {
+    return target_latency_ns_.load(std::memory_order_relaxed) > 0 ||
+           admission_slo_ns_.load(std::memory_order_relaxed) > 0;
+  }
+
+  /**
+   * @brief Update the moving average of the service time of `stage` with `package_num` packages
+   * processed in `cost`, and adapt the queue depth periodically if enabled.
+   *
+   */
+  void UpdateServiceTime(_StageRuntime &stage, PipelineClock::duration cost, size_t package_num)
+  {
+    const int64_t sample = ToNanoseconds(cost) / static_cast<int64_t>(package_num);
+    // the replicated workers may lose some samples of each other, which is fine for an average
+    const int64_t average = stage.service_ns.load(std::memory_order_relaxed);
+    stage.service_ns.store(average == 0 ? sample : average + (sample - average) / 8,
+                           std::memory_order_relaxed);
+    if (target_latency_ns_.load(std::memory_order_relaxed) > 0 &&
+        adapt_counter_.fetch_add(1, std::memory_order_relaxed) % kAdaptInterval == 0)
+    {
+      AdaptQueueDepth();
+    }
+  }
+
+  /**
+   * @brief Estimate the latency of a package pushed now. In a saturated pipeline the packages in
+   * flight pass the slowest block one by one, so the new package waits for them at the interval of
+   * the slowest block, and then takes the service time of all blocks. It overestimates a DAG
+   * pipeline whose branches run concurrently, which errs on the side of rejecting.
+   *
+   */
+  int64_t EstimateLatencyNs() const
+  {
+    int64_t total_service_ns    = 0;
+    int64_t bottleneck_interval = 0;
+    for (const auto &stage : stages_)
+    {
+      const int64_t service = stage->service_ns.load(std::memory_order_relaxed);
+      total_service_ns += service;
+      bottleneck_interval = std::max(bottleneck_interval, service / stage->parallelism);
+    }
+    return total_service_ns + static_cast<int64_t>(in_flight_.load()) * bottleneck_interval;
+  }
+
+  /**
+   * @brief Called after entering admission, see `Admit`.
+   *
+   */
+  bool IsAdmissible(const PipelineClock::time_point deadline) const
+  {
+    const int64_t slo_ns = admission_slo_ns_.load(std::memory_order_relaxed);
+    if (slo_ns == 0)
+    {
+      return true;
+    }
+    const int64_t estimate = EstimateLatencyNs();
+    if (estimate > slo_ns)
+    {
+      return false;
+    }
+    return deadline == kPipelineNoDeadline ||
+           PipelineClock::now() + std::chrono::nanoseconds(estimate) <= deadline;
+  }
+
+  /**
+   * @brief Resize the bounded queues for `target_latency_ms`. In a saturated pipeline every
+   * bounded queue drains at the pace of the slowest block, so the depth of each one is its share
+   * of the latency budget left by the service time, divided by the interval of the slowest block.
+   *
+   */
+  void AdaptQueueDepth()
+  {
+    std::unique_lock<std::mutex> lk(adapt_mtx_, std::try_to_lock);
+    if (!lk.owns_lock())
+    {
+      return;
+    }
+    int64_t total_service_ns    = 0;
+    int64_t bottleneck_interval = 0;
+    for (const auto &stage : stages_)
+    {
+      const int64_t service = stage->service_ns.load(std::memory_order_relaxed);
+      total_service_ns += service;
+      bottleneck_interval = std::max(bottleneck_interval, service / stage->parallelism);
+    }
+    if (bottleneck_interval == 0)
+    {
+      return;
+    }
+    const int64_t queue_num = stages_.size();
+    const int64_t budget    = std::max<int64_t>(
+        target_latency_ns_.load(std::memory_order_relaxed) - total_service_ns, 0);
+    const int64_t depth     = std::clamp<int64_t>(budget / queue_num / bottleneck_interval,
+                                                  min_queue_size_, max_queue_size_);
+    for (auto &stage : stages_)
+    {
+      // a batch block still needs a full batch in its queue
+      const int64_t stage_depth = std::max<int64_t>(depth, stage->block.GetMaxBatchSize());
+      if (stage->input->GetMaxSize() != static_cast<size_t>(stage_depth))
+      {
+        LOG_DEBUG("[AsyncPipelineInstance] {%s} queue depth adapted to %ld",
+                  stage->block.GetName().c_str(), stage_depth);
+        stage->input->SetMaxSize(stage_depth);
+      }
+    }
+  }
+
+  void Forward(_StageRuntime &stage, InnerParsingType package)
+  {
+    if (stage.children.empty())
+    {
+      Complete(package.get(), PackageStatus::SUCCESS);
+      return;
+    }
+    // fan out, every branch holds one reference of the package
+    for (size_t i = 1; i < stage.children.size(); ++i)
+    {
+      package->refs.fetch_add(1);
+      Output(stage, *stage.children[i], InnerParsingType(package.get()));
+    }
+    Output(stage, *stage.children[0], std::move(package));
+  }
+
+  void Output(_StageRuntime &stage, _StageRuntime &child, InnerParsingType package)
+  {
+    if (stage.dedicated)
+    {
+      Deliver(child, std::move(package));
+    } else
+    {
+      DeliverOutput(stage, child, std::move(package));
+    }
+  }
+
 private:
   Context_t context_;
+  // config of the running pipeline, restored if `Reconfigure` fails
+  AsyncPipelineConfig config_;
+  // the first auto-assigned cpu of the pipeline, taken again by `Reconfigure`
+  size_t auto_cpu_cursor_ = 0;
 
   InnerContext_t inner_context_;
+  // parent inner block indices of each inner block, -1 is the input of pipeline
+  std::vector<std::vector<int>> inner_parents_;
+
+  // should outlive the packages held by stages
+  FixedBlockPool package_pool_{sizeof(_InnerPackage), kPackagePoolSlabSize};
+
+  // adaptive queue depth, disabled if `target_latency_ns_` is 0
+  std::atomic<int64_t>  target_latency_ns_{0};
+  int                   min_queue_size_ = 1;
+  int                   max_queue_size_ = 1;
+  std::atomic<uint32_t> adapt_counter_{0};
+  std::mutex            adapt_mtx_;
+  // admission control, disabled if 0. atomic as `Admit` may read it during `Reconfigure`
+  std::atomic<int64_t> admission_slo_ns_{0};
+
+  // packages pushed but not released yet
+  std::atomic<size_t>     in_flight_{0};
+  std::mutex              drain_mtx_;
+  std::condition_variable drain_cv_;
+
+  // the pushes wait at the admission gate while the pipeline is drained
+  std::atomic<bool>       admission_open_{false};
+  std::atomic<int>        active_pushes_{0};
+  std::mutex              admission_mtx_;
+  std::condition_variable admission_cv_;
+  // guarded by `admission_mtx_`, the pushes from the callbacks of the packages dropped by
+  // `ClosePipeline` return instead of waiting for the close, which is calling them
+  bool                    admission_closing_ = false;
+
+  // guards `stages_` against the statistics readers, the stages themselves only change while the
+  // pipeline is stopped
+  mutable std::mutex                          stages_mtx_;
+  std::vector<std::unique_ptr<_StageRuntime>> stages_;
+  std::vector<std::future<bool>>              async_futures_;
+  // names of the blocks without the output stage, shared by the latency records
+  std::shared_ptr<const std::vector<std::string>> block_names_;
+
+  std::shared_ptr<IPipelineExecutor> executor_;
+  std::mutex                         task_mtx_;
+  std::condition_variable            task_cv_;
+  int                                running_tasks_ = 0;
 
-  std::vector<std::shared_ptr<BlockQueue<InnerParsingType>>> block_queue_;
-  std::vector<std::future<bool>>                             async_futures_;
+  // background sampler of `GetBottleneckReport`
+  std::thread             sampler_thread_;
+  std::mutex              sampler_mtx_;
+  std::condition_variable sampler_cv_;
+  bool                    sampler_stop_ = false;
 
   std::atomic<bool> pipeline_close_flag_{true};
   std::atomic<bool> pipeline_no_more_input_{true};
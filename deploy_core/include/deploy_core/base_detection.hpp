@@ -7,6 +7,7 @@
 
 #include <opencv2/opencv.hpp>
 
+#include "deploy_core/async_awaitable.hpp"
 #include "deploy_core/async_pipeline.hpp"
 #include "deploy_core/base_infer_core.hpp"
 #include "common_utils/pipeline_image.hpp"
@@ -106,7 +107,18 @@ class BaseDetectionModel : public IDetectionModel,
   typedef std::shared_ptr<IPipelinePackage> ParsingType;
 
 public:
-  BaseDetectionModel(std::shared_ptr<BaseInferCore> infer_core);
+  /**
+   * @brief Construct `BaseDetectionModel`. `PreProcess` and `PostProcess` could be executed by
+   * multiple worker threads in the async pipeline, make sure they are thread-safe before setting
+   * parallelism > 1. The results are still returned in submission order.
+   *
+   * @param infer_core
+   * @param preprocess_parallelism number of `PreProcess` workers in async pipeline. default=1.
+   * @param postprocess_parallelism number of `PostProcess` workers in async pipeline. default=1.
+   */
+  BaseDetectionModel(std::shared_ptr<BaseInferCore> infer_core,
+                     int                            preprocess_parallelism  = 1,
+                     int                            postprocess_parallelism = 1);
 
   /**
    * @brief Run the detection processing in synchronous mode.
@@ -124,19 +136,65 @@ public:
               bool                 isRGB = false) noexcept;
 
   /**
-   * @brief Run the detection processing in asynchronous mode.
+   * @brief Run the detection processing in asynchronous mode. With admission control enabled, see
+   * `AsyncPipelineConfig::admission_slo_ms`, a request which could not be finished in time is
+   * rejected at once, and the `future` throws `AsyncPipelineException` with `REJECTED` status.
    *
    * @param input_image input image in cv::Mat format.
    * @param conf_thresh confidence threshold
    * @param isRGB if the input is rgb format. Will flip channels if `isRGB` == false. default=false.
-   * @param cover_oldest whether cover the oldest package if the pipeline queue is full.
-   * default=false.
+   * @param cover_oldest latest-frame-wins mode. If the pipeline is full, drop the oldest pending
+   * package instead of blocking, whose `future` throws `AsyncPipelineException` with `DROPPED`
+   * status. default=false.
+   * @param deadline the `future` throws `AsyncPipelineException` with `TIMEOUT` status if the
+   * processing is not finished by then, the rest blocks are skipped. default=kPipelineNoDeadline.
+   * @param priority the package is processed before those of lower priority, e.g. use
+   * `PRIORITY_HIGH` for interactive requests and `PRIORITY_LOW` for background jobs.
+   * default=PRIORITY_NORMAL.
+   * @param cancel_token once cancelled, the request skips the rest blocks and releases its blobs
+   * buffer, and the `future` throws `AsyncPipelineException` with `CANCELLED` status.
+   * default=empty token.
+   * @param latency filled with the latency breakdown of the request before the result is
+   * delivered, see `PipelineLatencyRecord`. default=nullptr, not recorded.
    * @return std::future<std::vector<BBox2D>>
    */
-  [[nodiscard]] std::future<std::vector<BBox2D>> DetectAsync(const cv::Mat &input_image,
-                                                             float          conf_thresh,
-                                                             bool           isRGB = false,
-                                                             bool cover_oldest    = false) noexcept;
+  [[nodiscard]] std::future<std::vector<BBox2D>> DetectAsync(
+      const cv::Mat                  &input_image,
+      float                           conf_thresh,
+      bool                            isRGB        = false,
+      bool                            cover_oldest = false,
+      const PipelineClock::time_point deadline     = kPipelineNoDeadline,
+      PackagePriority                 priority     = PackagePriority::PRIORITY_NORMAL,
+      const AsyncCancelToken         &cancel_token = AsyncCancelToken(),
+      const PipelineLatencyRecordPtr &latency      = nullptr) noexcept;
+
+  /**
+   * @brief Run the detection processing in asynchronous mode, the results are delivered to
+   * `completion` instead of a `std::future`, e.g. a callback or an `AsyncCompletionQueue` polled
+   * by an event loop. The other arguments are the same as above.
+   *
+   * @param input_image input image in cv::Mat format.
+   * @param conf_thresh confidence threshold
+   * @param completion called exactly once with the final status if the request is pushed.
+   * @param isRGB default=false.
+   * @param cover_oldest default=false.
+   * @param deadline default=kPipelineNoDeadline.
+   * @param priority default=PRIORITY_NORMAL.
+   * @param cancel_token default=empty token.
+   * @param latency default=nullptr.
+   * @return true
+   * @return false if the request is not pushed, `completion` is not called.
+   */
+  bool DetectAsync(
+      const cv::Mat                              &input_image,
+      float                                       conf_thresh,
+      const AsyncCompletion<std::vector<BBox2D>> &completion,
+      bool                                        isRGB        = false,
+      bool                                        cover_oldest = false,
+      const PipelineClock::time_point             deadline     = kPipelineNoDeadline,
+      PackagePriority                             priority     = PackagePriority::PRIORITY_NORMAL,
+      const AsyncCancelToken                     &cancel_token = AsyncCancelToken(),
+      const PipelineLatencyRecordPtr             &latency      = nullptr) noexcept;
 
 protected:
   // forbidden the access from outside to `BaseAsyncPipeline::PushPipeline`
@@ -144,6 +202,12 @@ protected:
 
   virtual ~BaseDetectionModel();
 
+  // check the pipeline and create the package of an async request, return nullptr on failure
+  ParsingType CreateAsyncPackage(const cv::Mat &input_image,
+                                 float          conf_thresh,
+                                 bool           isRGB,
+                                 bool           cover_oldest) noexcept;
+
   std::shared_ptr<BaseInferCore> infer_core_{nullptr};
 
   static std::string detection_pipeline_name_;
@@ -158,4 +222,43 @@ public:
   virtual std::shared_ptr<BaseDetectionModel> Create() = 0;
 };
 
+#ifdef EASY_DEPLOY_HAS_COROUTINE
+/**
+ * @brief Awaitable version of `DetectAsync`, e.g. `co_await DetectAwait(*model, image, 0.4)`.
+ * Only available with C++20.
+ *
+ * @param model
+ * @param input_image
+ * @param conf_thresh
+ * @param executor the coroutine is resumed on it, or on the pipeline thread if nullptr.
+ * @param isRGB default=false.
+ * @param cover_oldest default=false.
+ * @param deadline default=kPipelineNoDeadline.
+ * @param priority default=PRIORITY_NORMAL.
+ * @param cancel_token default=empty token.
+ * @param latency default=nullptr.
+ * @return AsyncResultAwaitable<std::vector<BBox2D>>
+ */
+inline AsyncResultAwaitable<std::vector<BBox2D>> DetectAwait(
+    BaseDetectionModel                &model,
+    const cv::Mat                     &input_image,
+    float                              conf_thresh,
+    std::shared_ptr<IPipelineExecutor> executor     = nullptr,
+    bool                               isRGB        = false,
+    bool                               cover_oldest = false,
+    const PipelineClock::time_point    deadline     = kPipelineNoDeadline,
+    PackagePriority                    priority     = PackagePriority::PRIORITY_NORMAL,
+    const AsyncCancelToken            &cancel_token = AsyncCancelToken(),
+    const PipelineLatencyRecordPtr    &latency      = nullptr)
+{
+  return AsyncResultAwaitable<std::vector<BBox2D>>(
+      [&model, input_image, conf_thresh, isRGB, cover_oldest, deadline, priority,
+       cancel_token, latency](const AsyncCompletion<std::vector<BBox2D>> &completion) {
+        return model.DetectAsync(input_image, conf_thresh, completion, isRGB, cover_oldest,
+                                 deadline, priority, cancel_token, latency);
+      },
+      std::move(executor));
+}
+#endif
+
 } // namespace easy_deploy
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cstring>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 #include <unordered_set>
@@ -96,12 +99,24 @@ protected:
  */
 class MemBufferPool {
 public:
-  MemBufferPool(IRotInferCore *infer_core, const size_t pool_size)
+  /**
+   * @brief Construct the pool.
+   *
+   * @param infer_core
+   * @param pool_size
+   * @param first_touch write the host memory of the buffers once allocated, so on NUMA machines
+   * the pages are placed on the node of the constructing thread. default=false.
+   */
+  MemBufferPool(IRotInferCore *infer_core, const size_t pool_size, bool first_touch = false)
       : pool_size_(pool_size), dynamic_pool_(pool_size)
   {
     for (size_t i = 0; i < pool_size; ++i)
     {
       auto blobs_tensor = infer_core->AllocBlobsBuffer();
+      if (first_touch)
+      {
+        FirstTouch(blobs_tensor.get());
+      }
       dynamic_pool_.BlockPush(blobs_tensor.get());
       static_pool_.emplace(std::move(blobs_tensor));
     }
@@ -133,11 +148,28 @@ public:
     return dynamic_pool_.Size();
   }
 
+  size_t GetPoolSize() const noexcept
+  {
+    return pool_size_;
+  }
+
   ~MemBufferPool()
   {
     Release();
   }
 
+private:
+  static void FirstTouch(BlobsTensor *blobs_tensor)
+  {
+    for (const auto &name : blobs_tensor->GetTensorNames())
+    {
+      auto tensor = blobs_tensor->GetTensor(name);
+      tensor->SetBufferLocation(DataLocation::HOST);
+      memset(tensor->RawPtr(), 0, tensor->GetBufferMaxByteSize());
+    }
+    blobs_tensor->Reset();
+  }
+
 private:
   const size_t                                     pool_size_;
   BlockQueue<BlobsTensor *>                        dynamic_pool_;
@@ -199,6 +231,75 @@ public:
    */
   std::shared_ptr<BlobsTensor> GetBuffer(bool block);
 
+  /**
+   * @brief Re-allocate the blobs buffer pool on a thread pinned to `cpus`, and first-touch the
+   * host memory there. On NUMA machines, pass the cpus of the blocks consuming the buffers, see
+   * `PipelinePlacementPolicy`, so the buffers are local to them. The old pool is released after
+   * the new one is allocated, and kept if the allocation fails. Return false if some buffer is
+   * still in use, or the allocation failed.
+   *
+   * @warning The pool is replaced without any lock against `GetBuffer`. Call it before any
+   * pipeline using the core is initialized, and not concurrently with `GetBuffer`.
+   *
+   * @param cpus
+   * @return true
+   * @return false
+   */
+  bool PlaceBufferPool(const std::vector<int> &cpus);
+
+  /**
+   * @brief Same as `PlaceBufferPool` with the cpus of the `Inference` block, named
+   * "BaseInferCore Inference", in `placement.block_cpus`. Return false if it is not listed there.
+   *
+   * @param placement
+   * @return true
+   * @return false
+   */
+  bool PlaceBufferPool(const PipelinePlacementPolicy &placement);
+
+  /**
+   * @brief Enable dynamic micro-batching in the pipeline context. The `PreProcess`, `Inference`
+   * and `PostProcess` blocks are replaced by one batch block, which collects up to
+   * `max_batch_size` packages or as many as arrived within `max_wait_us`, gathers their input
+   * blobs into one batched blobs buffer, calls `SyncInfer` once and scatters the output blobs back
+   * to the packages.
+   *
+   * The first dimension of every blob is the batch dimension and should be no less than
+   * `max_batch_size`, i.e. the model is exported with a fixed batch. Each package keeps its
+   * sample at index 0 of its own blobs buffer. The blobs are gathered and scattered on host.
+   * A partial batch costs as much as a full one, its unused samples are zeroed and inferred too.
+   * Return false if the pipeline of the core is already initialized.
+   *
+   * @warning Call it before the core is used to construct algorithms, they copy the pipeline
+   * context on construction.
+   *
+   * @param max_batch_size
+   * @param max_wait_us
+   * @param input_blob_names blobs gathered into the batch. default={}, all blobs.
+   * @param output_blob_names blobs scattered back to the packages. default={}, all blobs.
+   * @return true
+   * @return false
+   */
+  bool EnableDynamicBatching(int                             max_batch_size,
+                             int                             max_wait_us,
+                             const std::vector<std::string> &input_blob_names  = {},
+                             const std::vector<std::string> &output_blob_names = {});
+
+  /**
+   * @brief Run the `Inference` block of all the algorithm pipelines using this core on one shared
+   * worker thread, which serves the pipelines in round-robin, instead of every pipeline running
+   * its own inference workers on the same engine. See `SharedPipelineStage`. Return false if the
+   * pipeline of the core is already initialized, or dynamic batching is enabled, whose batch block
+   * is already shared by the pipelines.
+   *
+   * @warning Call it before the core is used to construct algorithms, they copy the pipeline
+   * context on construction.
+   *
+   * @return true
+   * @return false
+   */
+  bool EnableSharedInferenceStage();
+
   /**
    * @brief Release the sources in base class.
    *
@@ -224,8 +325,46 @@ protected:
    */
   void Init(size_t mem_buf_size = 5);
 
+  /**
+   * @brief Mark the `PreProcess`/`PostProcess` stages as trivial if they do nothing in the derived
+   * core, so they are removed from the algorithm pipelines and cost no queue hop. Call it in the
+   * construct function of the derived class.
+   *
+   * @param trivial_preprocess
+   * @param trivial_postprocess
+   */
+  void SetTrivialStages(bool trivial_preprocess, bool trivial_postprocess);
+
+private:
+  /**
+   * @brief Configure the pipeline of `PreProcess`, `Inference` and `PostProcess` blocks. Return
+   * false if the pipeline is already initialized.
+   *
+   * @return true
+   * @return false
+   */
+  bool ConfigInferCorePipeline();
+
+  /**
+   * @brief The function of the batch block, see `EnableDynamicBatching`.
+   *
+   */
+  bool BatchInference(const std::vector<ParsingType> &packages);
+
 private:
   std::unique_ptr<MemBufferPool> mem_buf_pool_{nullptr};
+
+  bool trivial_preprocess_{false};
+  bool trivial_postprocess_{false};
+
+  // the inference stage shared by pipelines of several algorithms, see `EnableSharedInferenceStage`
+  std::shared_ptr<SharedPipelineStage> shared_stage_{nullptr};
+
+  // the batch block could be shared by pipelines of several algorithms
+  std::mutex                   batch_mtx_;
+  std::unique_ptr<BlobsTensor> batch_buffer_{nullptr};
+  std::vector<std::string>     batch_input_names_;
+  std::vector<std::string>     batch_output_names_;
 };
 
 /**
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "deploy_core/async_awaitable.hpp"
 #include "deploy_core/base_infer_core.hpp"
 #include "common_utils/pipeline_image.hpp"
 
@@ -184,7 +185,9 @@ public:
                     bool                       isRGB = false);
 
   /**
-   * @brief Generate the mask with points as prompts in async mode.
+   * @brief Generate the mask with points as prompts in async mode. The request is rejected at once
+   * with `REJECTED` status if the pipeline is overloaded, see
+   * `AsyncPipelineConfig::admission_slo_ms`.
    *
    * @warning The returned `std::future<>` instance could be invalid. Please make sure it is
    * valid before you call `get()`.
@@ -193,8 +196,17 @@ public:
    * @param points points coords
    * @param labels points labels, 0 - background; 1 - foreground
    * @param isRGB if the input image is RGB format. default=false
-   * @param cover_oldest whether cover the oldest package if the pipeline queue is full.
-   * default=false.
+   * @param cover_oldest latest-frame-wins mode. If the pipeline is full, drop the oldest pending
+   * package instead of blocking, whose `future` throws `AsyncPipelineException` with `DROPPED`
+   * status. default=false.
+   * @param priority the package is processed before those of lower priority, e.g. use
+   * `PRIORITY_HIGH` for interactive clicks and `PRIORITY_LOW` for background segmentation jobs.
+   * default=PRIORITY_NORMAL.
+   * @param cancel_token once cancelled, e.g. the user abandoned the interaction, the request skips
+   * the rest blocks and releases its blobs buffers, and the `future` throws
+   * `AsyncPipelineException` with `CANCELLED` status. default=empty token.
+   * @param latency filled with the latency breakdown of the request before the result is
+   * delivered, see `PipelineLatencyRecord`. default=nullptr, not recorded.
    * @return std::future<cv::Mat> A std::future instance of the result.
    */
   [[nodiscard]] std::future<cv::Mat> GenerateMaskAsync(
@@ -202,7 +214,10 @@ public:
       const std::vector<std::pair<int, int>> &points,
       const std::vector<int>                 &labels,
       bool                                    isRGB        = false,
-      bool                                    cover_oldest = false);
+      bool                                    cover_oldest = false,
+      PackagePriority                         priority     = PackagePriority::PRIORITY_NORMAL,
+      const AsyncCancelToken                 &cancel_token = AsyncCancelToken(),
+      const PipelineLatencyRecordPtr         &latency      = nullptr);
 
   /**
    * @brief Generate the mask with boxes as prompts in async mode.
@@ -217,19 +232,95 @@ public:
    * @param boxes boxes coords
    * @param callback callback function if needed. default=nullptr.
    * @param isRGB if the input image is RGB format. default=false
-   * @param cover_oldest whether cover the oldest package if the pipeline queue is full.
-   * default=false.
+   * @param cover_oldest latest-frame-wins mode. If the pipeline is full, drop the oldest pending
+   * package instead of blocking, whose `future` throws `AsyncPipelineException` with `DROPPED`
+   * status. default=false.
+   * @param priority the package is processed before those of lower priority, e.g. use
+   * `PRIORITY_HIGH` for interactive clicks and `PRIORITY_LOW` for background segmentation jobs.
+   * default=PRIORITY_NORMAL.
+   * @param cancel_token once cancelled, e.g. the user abandoned the interaction, the request skips
+   * the rest blocks and releases its blobs buffers, and the `future` throws
+   * `AsyncPipelineException` with `CANCELLED` status. default=empty token.
+   * @param latency filled with the latency breakdown of the request before the result is
+   * delivered, see `PipelineLatencyRecord`. default=nullptr, not recorded.
    * @return std::future<cv::Mat> A std::future instance of the result.
    */
-  [[nodiscard]] std::future<cv::Mat> GenerateMaskAsync(const cv::Mat             &image,
-                                                       const std::vector<BBox2D> &boxes,
-                                                       bool                       isRGB = false,
-                                                       bool cover_oldest                = false);
+  [[nodiscard]] std::future<cv::Mat> GenerateMaskAsync(
+      const cv::Mat                  &image,
+      const std::vector<BBox2D>      &boxes,
+      bool                            isRGB        = false,
+      bool                            cover_oldest = false,
+      PackagePriority                 priority     = PackagePriority::PRIORITY_NORMAL,
+      const AsyncCancelToken         &cancel_token = AsyncCancelToken(),
+      const PipelineLatencyRecordPtr &latency      = nullptr);
+
+  /**
+   * @brief Generate the mask with points as prompts in async mode, the result is delivered to
+   * `completion` instead of a `std::future`, e.g. a callback or an `AsyncCompletionQueue` polled by
+   * an event loop. The other arguments are the same as above.
+   *
+   * @param image input image
+   * @param points points coords
+   * @param labels points labels, 0 - background; 1 - foreground
+   * @param completion called exactly once with the final status if the request is pushed.
+   * @param isRGB default=false
+   * @param cover_oldest default=false.
+   * @param priority default=PRIORITY_NORMAL.
+   * @param cancel_token default=empty token.
+   * @param latency default=nullptr.
+   * @return true
+   * @return false if the request is not pushed, `completion` is not called.
+   */
+  bool GenerateMaskAsync(const cv::Mat                          &image,
+                         const std::vector<std::pair<int, int>> &points,
+                         const std::vector<int>                 &labels,
+                         const AsyncCompletion<cv::Mat>         &completion,
+                         bool                                    isRGB        = false,
+                         bool                                    cover_oldest = false,
+                         PackagePriority priority = PackagePriority::PRIORITY_NORMAL,
+                         const AsyncCancelToken &cancel_token = AsyncCancelToken(),
+                         const PipelineLatencyRecordPtr &latency = nullptr);
+
+  /**
+   * @brief Generate the mask with boxes as prompts in async mode, the result is delivered to
+   * `completion` instead of a `std::future`. The other arguments are the same as above.
+   *
+   * @param image input image
+   * @param boxes boxes coords
+   * @param completion called exactly once with the final status if the request is pushed.
+   * @param isRGB default=false
+   * @param cover_oldest default=false.
+   * @param priority default=PRIORITY_NORMAL.
+   * @param cancel_token default=empty token.
+   * @param latency default=nullptr.
+   * @return true
+   * @return false if the request is not pushed, `completion` is not called.
+   */
+  bool GenerateMaskAsync(const cv::Mat                  &image,
+                         const std::vector<BBox2D>      &boxes,
+                         const AsyncCompletion<cv::Mat> &completion,
+                         bool                            isRGB        = false,
+                         bool                            cover_oldest = false,
+                         PackagePriority priority = PackagePriority::PRIORITY_NORMAL,
+                         const AsyncCancelToken &cancel_token = AsyncCancelToken(),
+                         const PipelineLatencyRecordPtr &latency = nullptr);
 
 private:
   // forbidden the access from outside to `BaseAsyncPipeline::PushPipeline`
   using BaseAsyncPipeline::PushPipeline;
 
+  // check the arguments and create the package of an async request, return nullptr on failure
+  ParsingType CreateAsyncPackage(const cv::Mat                          &image,
+                                 const std::vector<std::pair<int, int>> &points,
+                                 const std::vector<int>                 &labels,
+                                 bool                                    isRGB,
+                                 bool                                    cover_oldest);
+
+  ParsingType CreateAsyncPackage(const cv::Mat             &image,
+                                 const std::vector<BBox2D> &boxes,
+                                 bool                       isRGB,
+                                 bool                       cover_oldest);
+
   void ConfigureBoxPipeline();
 
   void ConfigurePointPipeline();
@@ -253,4 +344,59 @@ public:
   virtual std::shared_ptr<BaseSamModel> Create() = 0;
 };
 
+#ifdef EASY_DEPLOY_HAS_COROUTINE
+/**
+ * @brief Awaitable version of `GenerateMaskAsync` with points as prompts. Only available with
+ * C++20.
+ *
+ * @param executor the coroutine is resumed on it, or on the pipeline thread if nullptr.
+ */
+inline AsyncResultAwaitable<cv::Mat> GenerateMaskAwait(
+    BaseSamModel                           &model,
+    const cv::Mat                          &image,
+    const std::vector<std::pair<int, int>> &points,
+    const std::vector<int>                 &labels,
+    std::shared_ptr<IPipelineExecutor>      executor     = nullptr,
+    bool                                    isRGB        = false,
+    bool                                    cover_oldest = false,
+    PackagePriority                         priority     = PackagePriority::PRIORITY_NORMAL,
+    const AsyncCancelToken                 &cancel_token = AsyncCancelToken(),
+    const PipelineLatencyRecordPtr         &latency      = nullptr)
+{
+  return AsyncResultAwaitable<cv::Mat>(
+      [&model, image, points, labels, isRGB, cover_oldest, priority,
+       cancel_token, latency](const AsyncCompletion<cv::Mat> &completion) {
+        return model.GenerateMaskAsync(image, points, labels, completion, isRGB, cover_oldest,
+                                       priority, cancel_token, latency);
+      },
+      std::move(executor));
+}
+
+/**
+ * @brief Awaitable version of `GenerateMaskAsync` with boxes as prompts. Only available with
+ * C++20.
+ *
+ * @param executor the coroutine is resumed on it, or on the pipeline thread if nullptr.
+ */
+inline AsyncResultAwaitable<cv::Mat> GenerateMaskAwait(
+    BaseSamModel                      &model,
+    const cv::Mat                     &image,
+    const std::vector<BBox2D>         &boxes,
+    std::shared_ptr<IPipelineExecutor> executor     = nullptr,
+    bool                               isRGB        = false,
+    bool                               cover_oldest = false,
+    PackagePriority                    priority     = PackagePriority::PRIORITY_NORMAL,
+    const AsyncCancelToken            &cancel_token = AsyncCancelToken(),
+    const PipelineLatencyRecordPtr    &latency      = nullptr)
+{
+  return AsyncResultAwaitable<cv::Mat>(
+      [&model, image, boxes, isRGB, cover_oldest, priority,
+       cancel_token, latency](const AsyncCompletion<cv::Mat> &completion) {
+        return model.GenerateMaskAsync(image, boxes, completion, isRGB, cover_oldest, priority,
+                                       cancel_token, latency);
+      },
+      std::move(executor));
+}
+#endif
+
 } // namespace easy_deploy
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "deploy_core/async_awaitable.hpp"
 #include "deploy_core/base_infer_core.hpp"
 #include "common_utils/pipeline_image.hpp"
 
@@ -56,8 +57,51 @@ protected:
 public:
   bool ComputeDisp(const cv::Mat &left_image, const cv::Mat &right_image, cv::Mat &disp_output);
 
-  [[nodiscard]] std::future<cv::Mat> ComputeDispAsync(const cv::Mat &left_image,
-                                                      const cv::Mat &right_image);
+  /**
+   * @brief Compute the disparity in asynchronous mode. The request is rejected at once with
+   * `REJECTED` status if the pipeline is overloaded, see `AsyncPipelineConfig::admission_slo_ms`.
+   *
+   * @param left_image
+   * @param right_image
+   * @param deadline the `future` throws `AsyncPipelineException` with `TIMEOUT` status if the
+   * processing is not finished by then, the rest blocks are skipped. default=kPipelineNoDeadline.
+   * @param priority the package is processed before those of lower priority.
+   * default=PRIORITY_NORMAL.
+   * @param cancel_token once cancelled, the request skips the rest blocks and the `future` throws
+   * `AsyncPipelineException` with `CANCELLED` status. default=empty token.
+   * @param latency filled with the latency breakdown of the request before the result is
+   * delivered, see `PipelineLatencyRecord`. default=nullptr, not recorded.
+   * @return std::future<cv::Mat>
+   */
+  [[nodiscard]] std::future<cv::Mat> ComputeDispAsync(
+      const cv::Mat                  &left_image,
+      const cv::Mat                  &right_image,
+      const PipelineClock::time_point deadline     = kPipelineNoDeadline,
+      PackagePriority                 priority     = PackagePriority::PRIORITY_NORMAL,
+      const AsyncCancelToken         &cancel_token = AsyncCancelToken(),
+      const PipelineLatencyRecordPtr &latency      = nullptr);
+
+  /**
+   * @brief Compute the disparity in asynchronous mode, the result is delivered to `completion`
+   * instead of a `std::future`, e.g. a callback or an `AsyncCompletionQueue`.
+   *
+   * @param left_image
+   * @param right_image
+   * @param completion called exactly once with the final status if the request is pushed.
+   * @param deadline default=kPipelineNoDeadline.
+   * @param priority default=PRIORITY_NORMAL.
+   * @param cancel_token default=empty token.
+   * @param latency default=nullptr.
+   * @return true
+   * @return false if the request is not pushed, `completion` is not called.
+   */
+  bool ComputeDispAsync(const cv::Mat                  &left_image,
+                        const cv::Mat                  &right_image,
+                        const AsyncCompletion<cv::Mat> &completion,
+                        const PipelineClock::time_point deadline = kPipelineNoDeadline,
+                        PackagePriority priority = PackagePriority::PRIORITY_NORMAL,
+                        const AsyncCancelToken &cancel_token = AsyncCancelToken(),
+                        const PipelineLatencyRecordPtr &latency = nullptr);
 
 protected:
   virtual bool PreProcess(std::shared_ptr<IPipelinePackage> pipeline_unit) = 0;
@@ -67,6 +111,9 @@ protected:
 private:
   using BaseAsyncPipeline::PushPipeline;
 
+  // check the inputs and create the package of an async request, return nullptr on failure
+  ParsingType CreateAsyncPackage(const cv::Mat &left_image, const cv::Mat &right_image);
+
 protected:
   std::shared_ptr<BaseInferCore> inference_core_;
 
@@ -119,7 +166,47 @@ protected:
 public:
   bool ComputeDepth(const cv::Mat &input_image, cv::Mat &depth_output);
 
-  [[nodiscard]] std::future<cv::Mat> ComputeDepthAsync(const cv::Mat &input_image);
+  /**
+   * @brief Compute the depth in asynchronous mode. The request is rejected at once with
+   * `REJECTED` status if the pipeline is overloaded, see `AsyncPipelineConfig::admission_slo_ms`.
+   *
+   * @param input_image
+   * @param deadline the `future` throws `AsyncPipelineException` with `TIMEOUT` status if the
+   * processing is not finished by then, the rest blocks are skipped. default=kPipelineNoDeadline.
+   * @param priority the package is processed before those of lower priority.
+   * default=PRIORITY_NORMAL.
+   * @param cancel_token once cancelled, the request skips the rest blocks and the `future` throws
+   * `AsyncPipelineException` with `CANCELLED` status. default=empty token.
+   * @param latency filled with the latency breakdown of the request before the result is
+   * delivered, see `PipelineLatencyRecord`. default=nullptr, not recorded.
+   * @return std::future<cv::Mat>
+   */
+  [[nodiscard]] std::future<cv::Mat> ComputeDepthAsync(
+      const cv::Mat                  &input_image,
+      const PipelineClock::time_point deadline     = kPipelineNoDeadline,
+      PackagePriority                 priority     = PackagePriority::PRIORITY_NORMAL,
+      const AsyncCancelToken         &cancel_token = AsyncCancelToken(),
+      const PipelineLatencyRecordPtr &latency      = nullptr);
+
+  /**
+   * @brief Compute the depth in asynchronous mode, the result is delivered to `completion`
+   * instead of a `std::future`, e.g. a callback or an `AsyncCompletionQueue`.
+   *
+   * @param input_image
+   * @param completion called exactly once with the final status if the request is pushed.
+   * @param deadline default=kPipelineNoDeadline.
+   * @param priority default=PRIORITY_NORMAL.
+   * @param cancel_token default=empty token.
+   * @param latency default=nullptr.
+   * @return true
+   * @return false if the request is not pushed, `completion` is not called.
+   */
+  bool ComputeDepthAsync(const cv::Mat                  &input_image,
+                         const AsyncCompletion<cv::Mat> &completion,
+                         const PipelineClock::time_point deadline = kPipelineNoDeadline,
+                         PackagePriority priority = PackagePriority::PRIORITY_NORMAL,
+                         const AsyncCancelToken &cancel_token = AsyncCancelToken(),
+                         const PipelineLatencyRecordPtr &latency = nullptr);
 
 protected:
   virtual bool PreProcess(std::shared_ptr<IPipelinePackage> pipeline_unit) = 0;
@@ -129,10 +216,62 @@ protected:
 private:
   using BaseAsyncPipeline::PushPipeline;
 
+  // check the input and create the package of an async request, return nullptr on failure
+  ParsingType CreateAsyncPackage(const cv::Mat &input_image);
+
 protected:
   std::shared_ptr<BaseInferCore> inference_core_;
 
   static const std::string mono_stereo_pipeline_name_;
 };
 
+#ifdef EASY_DEPLOY_HAS_COROUTINE
+/**
+ * @brief Awaitable version of `ComputeDispAsync`. Only available with C++20.
+ *
+ * @param executor the coroutine is resumed on it, or on the pipeline thread if nullptr.
+ */
+inline AsyncResultAwaitable<cv::Mat> ComputeDispAwait(
+    BaseStereoMatchingModel           &model,
+    const cv::Mat                     &left_image,
+    const cv::Mat                     &right_image,
+    std::shared_ptr<IPipelineExecutor> executor     = nullptr,
+    const PipelineClock::time_point    deadline     = kPipelineNoDeadline,
+    PackagePriority                    priority     = PackagePriority::PRIORITY_NORMAL,
+    const AsyncCancelToken            &cancel_token = AsyncCancelToken(),
+    const PipelineLatencyRecordPtr    &latency      = nullptr)
+{
+  return AsyncResultAwaitable<cv::Mat>(
+      [&model, left_image, right_image, deadline, priority,
+       cancel_token, latency](const AsyncCompletion<cv::Mat> &completion) {
+        return model.ComputeDispAsync(left_image, right_image, completion, deadline, priority,
+                                      cancel_token, latency);
+      },
+      std::move(executor));
+}
+
+/**
+ * @brief Awaitable version of `ComputeDepthAsync`. Only available with C++20.
+ *
+ * @param executor the coroutine is resumed on it, or on the pipeline thread if nullptr.
+ */
+inline AsyncResultAwaitable<cv::Mat> ComputeDepthAwait(
+    BaseMonoStereoModel               &model,
+    const cv::Mat                     &input_image,
+    std::shared_ptr<IPipelineExecutor> executor     = nullptr,
+    const PipelineClock::time_point    deadline     = kPipelineNoDeadline,
+    PackagePriority                    priority     = PackagePriority::PRIORITY_NORMAL,
+    const AsyncCancelToken            &cancel_token = AsyncCancelToken(),
+    const PipelineLatencyRecordPtr    &latency      = nullptr)
+{
+  return AsyncResultAwaitable<cv::Mat>(
+      [&model, input_image, deadline, priority, cancel_token,
+       latency](const AsyncCompletion<cv::Mat> &completion) {
+        return model.ComputeDepthAsync(input_image, completion, deadline, priority, cancel_token,
+                                       latency);
+      },
+      std::move(executor));
+}
+#endif
+
 } // namespace easy_deploy
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "common_utils/types.hpp"
@@ -73,6 +75,17 @@ public:
     return tensor_map_.size();
   }
 
+  std::vector<std::string> GetTensorNames() const
+  {
+    std::vector<std::string> names;
+    names.reserve(tensor_map_.size());
+    for (const auto &p_name_tensor : tensor_map_)
+    {
+      names.push_back(p_name_tensor.first);
+    }
+    return names;
+  }
+
   void Reset()
   {
     for (auto &p_name_tensor : tensor_map_)
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace easy_deploy {
+
+/**
+ * @brief Histogram of the service time of one block, with 4 buckets per power of two from 1us
+ * to about 17s, so the percentiles are within 25% of the real ones.
+ *
+ */
+struct ServiceTimeHistogram {
+  static constexpr int kOctaveNum = 24;
+  static constexpr int kBucketNum = 1 + kOctaveNum * 4;
+
+  std::array<uint64_t, kBucketNum> counts{};
+
+  /**
+   * @brief Return the bucket of `ns`, the first bucket holds everything below 1us and the last
+   * one everything above the range.
+   *
+   */
+  static int BucketOf(int64_t ns) noexcept
+  {
+    if (ns < 1024)
+    {
+      return 0;
+    }
+    const int msb    = 63 - __builtin_clzll(static_cast<uint64_t>(ns));
+    const int bucket = 1 + (msb - 10) * 4 + static_cast<int>((ns >> (msb - 2)) & 3);
+    return bucket < kBucketNum ? bucket : kBucketNum - 1;
+  }
+
+  /**
+   * @brief Return the upper bound of `bucket` in nanoseconds.
+   *
+   */
+  static int64_t UpperBoundOf(int bucket) noexcept
+  {
+    if (bucket == 0)
+    {
+      return 1024;
+    }
+    const int msb = (bucket - 1) / 4 + 10;
+    const int sub = (bucket - 1) % 4;
+    return static_cast<int64_t>(4 + sub + 1) << (msb - 2);
+  }
+
+  /**
+   * @brief Return the upper bound of the bucket holding quantile `q` in nanoseconds, 0 if empty.
+   *
+   */
+  int64_t Percentile(double q) const noexcept
+  {
+    uint64_t total = 0;
+    for (auto count : counts)
+    {
+      total += count;
+    }
+    if (total == 0)
+    {
+      return 0;
+    }
+    const auto rank = static_cast<uint64_t>(q * (total - 1)) + 1;
+    uint64_t   seen = 0;
+    for (int i = 0; i < kBucketNum; ++i)
+    {
+      seen += counts[i];
+      if (seen >= rank)
+      {
+        return UpperBoundOf(i);
+      }
+    }
+    return UpperBoundOf(kBucketNum - 1);
+  }
+};
+
+/**
+ * @brief Cumulative load of one block, i.e. how long its workers were inside the block function
+ * and how many packages they processed.
+ *
+ */
+struct StageLoadSnapshot {
+  int64_t              busy_ns   = 0;
+  uint64_t             processed = 0;
+  ServiceTimeHistogram service;
+};
+
+/**
+ * @brief Counters of `StageLoadSnapshot` updated by the workers of one block with relaxed atomics.
+ *
+ */
+class StageLoadCounters {
+public:
+  /**
+   * @brief Record one call of the block function which processed `package_num` packages in
+   * `cost_ns`.
+   *
+   */
+  void Record(int64_t cost_ns, size_t package_num) noexcept
+  {
+    busy_ns_.fetch_add(cost_ns, std::memory_order_relaxed);
+    processed_.fetch_add(package_num, std::memory_order_relaxed);
+    const int bucket = ServiceTimeHistogram::BucketOf(cost_ns / static_cast<int64_t>(package_num));
+    service_[bucket].fetch_add(package_num, std::memory_order_relaxed);
+  }
+
+  StageLoadSnapshot GetSnapshot() const noexcept
+  {
+    StageLoadSnapshot snapshot;
+    snapshot.busy_ns   = busy_ns_.load(std::memory_order_relaxed);
+    snapshot.processed = processed_.load(std::memory_order_relaxed);
+    for (int i = 0; i < ServiceTimeHistogram::kBucketNum; ++i)
+    {
+      snapshot.service.counts[i] = service_[i].load(std::memory_order_relaxed);
+    }
+    return snapshot;
+  }
+
+private:
+  std::atomic<int64_t>  busy_ns_{0};
+  std::atomic<uint64_t> processed_{0};
+  std::atomic<uint64_t> service_[ServiceTimeHistogram::kBucketNum]{};
+};
+
+/**
+ * @brief Load of one block over the sampling window of the bottleneck sampler.
+ *
+ */
+struct StageLoadStats {
+  std::string name;
+  int         parallelism = 1;
+  // mean and max number of packages waiting in the input queue at the samples
+  double queue_depth     = 0;
+  size_t max_queue_depth = 0;
+  // max size of the input queue, `SIZE_MAX` if unbounded
+  size_t queue_capacity = 0;
+  // fraction of the worker time spent in the block function, 1 means saturated
+  double busy_ratio = 0;
+  // fraction of the worker time left, i.e. `1 - busy_ratio`
+  double headroom = 1;
+  // packages processed per second, and the packages per second it could process if saturated
+  double throughput = 0;
+  double capacity   = 0;
+  // percentiles of the service time of one package, in microseconds
+  double service_p50_us = 0;
+  double service_p90_us = 0;
+  double service_p99_us = 0;
+};
+
+/**
+ * @brief Report of the bottleneck sampler, see `AsyncPipelineConfig::bottleneck_sample_ms`.
+ *
+ * The bottleneck is the block with the highest busy ratio. A block blocked by a full queue after
+ * it only waits and is not busy, so the saturated block is the one the packages pile up before.
+ * The blocks before it show full input queues with headroom left, adding workers there does not
+ * help, while adding workers (or inference threads, or blobs buffers) to the bottleneck does.
+ *
+ */
+struct PipelineBottleneckReport {
+  // time covered by the samples, 0 if there are not enough samples yet
+  double window_ms = 0;
+  // index of the bottleneck in `stages`, -1 if unknown
+  int bottleneck = -1;
+  // the busy ratio of the bottleneck is at least `kSaturatedBusyRatio`
+  bool saturated = false;
+  // all blocks in pipeline order, the last one is the output stage running the callbacks
+  std::vector<StageLoadStats> stages;
+
+  static constexpr double kSaturatedBusyRatio = 0.9;
+};
+
+} // namespace easy_deploy
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common_utils/ring_buffer.hpp"
+
+namespace easy_deploy {
+
+/**
+ * @brief `IPipelineExecutor` is the abstract interface of the executor which runs the tasks of
+ * async pipeline blocks. Multiple pipelines could share one executor, so the number of threads
+ * does not grow with the number of blocks.
+ *
+ */
+class IPipelineExecutor {
+public:
+  /**
+   * @brief Submit a task to the executor. The task should not block for a long time waiting on
+   * other tasks of the same executor.
+   *
+   * @param task
+   */
+  virtual void Submit(std::function<void()> task) = 0;
+
+  /**
+   * @brief Return the number of worker threads.
+   *
+   * @return size_t
+   */
+  virtual size_t GetThreadNum() const noexcept = 0;
+
+  virtual ~IPipelineExecutor() = default;
+};
+
+/**
+ * @brief A work-stealing thread pool. Every worker owns a task deque. Tasks submitted by a worker
+ * go into its own deque and are taken LIFO, which keeps the package data hot in cache. Idle
+ * workers steal tasks FIFO from the other deques, and park if there is nothing to do.
+ *
+ */
+class WorkStealingThreadPool : public IPipelineExecutor {
+public:
+  /**
+   * @brief Construct the thread pool.
+   *
+   * @param thread_num number of worker threads. Use `std::thread::hardware_concurrency()` if 0.
+   * @param cpus if not empty, the workers are pinned to one of them each in turn.
+   */
+  explicit WorkStealingThreadPool(size_t thread_num = 0, const std::vector<int> &cpus = {});
+
+  WorkStealingThreadPool(const WorkStealingThreadPool &)            = delete;
+  WorkStealingThreadPool &operator=(const WorkStealingThreadPool &) = delete;
+
+  ~WorkStealingThreadPool() override;
+
+  void Submit(std::function<void()> task) override;
+
+  size_t GetThreadNum() const noexcept override
+  {
+    return workers_.size();
+  }
+
+private:
+  struct Worker {
+    std::mutex                        mtx;
+    RingBuffer<std::function<void()>> tasks;
+    std::thread                       thread;
+  };
+
+  void WorkerEntry(size_t index, int cpu);
+
+  bool PopTask(size_t index, std::function<void()> &task);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  std::atomic<size_t> next_worker_{0};
+  std::atomic<size_t> pending_tasks_{0};
+  std::atomic<size_t> parked_workers_{0};
+  std::atomic<bool>   stop_{false};
+
+  std::mutex              park_mtx_;
+  std::condition_variable park_cv_;
+};
+
+/**
+ * @brief Get the process-wide default executor, a `WorkStealingThreadPool` with one worker per
+ * cpu core. It is created on the first call.
+ *
+ * @return std::shared_ptr<IPipelineExecutor>
+ */
+std::shared_ptr<IPipelineExecutor> GetDefaultPipelineExecutor();
+
+} // namespace easy_deploy
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace easy_deploy {
+
+/**
+ * @brief Latency of one request in one block of the pipeline.
+ *
+ */
+struct BlockLatency {
+  std::string name;
+  // false if the block function was not called on the request, e.g. it failed in an earlier block
+  bool reached = false;
+  // from entering the input queue of the block to the start of the block function
+  int64_t queue_wait_ns = 0;
+  // time inside the block function, i.e. the whole batch for a batch block
+  int64_t compute_ns = 0;
+};
+
+/**
+ * @brief Latency breakdown of one request, filled by the pipeline as the request goes through the
+ * blocks, which costs a few clock reads per block. Pass it when pushing the request, and read it
+ * once the result is delivered, i.e. after the `future` is ready or in the completion callback.
+ * Different from `PipelineTracer` which traces all the requests of the process, it gives the
+ * attribution of the tail latency of the requests picked by the caller, e.g. to log it per frame.
+ *
+ * One record serves one request at a time, it could be reused once the last one is delivered.
+ *
+ * Usage:
+ *    auto latency = std::make_shared<PipelineLatencyRecord>();
+ *    auto future  = model->DetectAsync(image, 0.4, ..., latency);
+ *    auto result  = future.get();
+ *    for (const auto &block : latency->GetBlocks()) { ... }
+ *
+ */
+class PipelineLatencyRecord {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  PipelineLatencyRecord() = default;
+
+  PipelineLatencyRecord(const PipelineLatencyRecord &)            = delete;
+  PipelineLatencyRecord &operator=(const PipelineLatencyRecord &) = delete;
+
+  /**
+   * @brief Return the time the request was pushed.
+   *
+   */
+  Clock::time_point GetSubmitTime() const noexcept
+  {
+    return submit_time_;
+  }
+
+  /**
+   * @brief Return the latency in each block, in pipeline order. The fused blocks are reported as
+   * one block named "A + B".
+   *
+   */
+  const std::vector<BlockLatency> &GetBlocks() const noexcept
+  {
+    return blocks_;
+  }
+
+  /**
+   * @brief Return the time from the end of the last block to the start of the completion callback,
+   * i.e. the wait in the output stage. From the push if no block was reached.
+   *
+   */
+  int64_t GetCallbackDelayNs() const noexcept
+  {
+    return callback_delay_ns_;
+  }
+
+  /**
+   * @brief Return the time from the push to the start of the completion callback.
+   *
+   */
+  int64_t GetTotalNs() const noexcept
+  {
+    return total_ns_;
+  }
+
+  /**
+   * @brief Start recording a request pushed at `submit_time` into a pipeline with `block_names`.
+   * Called by the pipeline.
+   *
+   */
+  void Reset(Clock::time_point                                     submit_time,
+             const std::shared_ptr<const std::vector<std::string>> &block_names);
+
+  /**
+   * @brief Record that the request enters the input queue of block `index`. Called by the
+   * pipeline, thread-safe.
+   *
+   */
+  void RecordEnqueue(size_t index, Clock::time_point time) noexcept
+  {
+    if (index < stamp_num_)
+    {
+      stamps_[index].enqueue_ns.store(ToOffset(time), std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * @brief Record that block `index` processes the request during [`begin`, `end`]. Called by the
+   * pipeline, thread-safe.
+   *
+   */
+  void RecordCompute(size_t index, Clock::time_point begin, Clock::time_point end) noexcept
+  {
+    if (index < stamp_num_)
+    {
+      stamps_[index].begin_ns.store(ToOffset(begin), std::memory_order_relaxed);
+      stamps_[index].end_ns.store(ToOffset(end), std::memory_order_release);
+    }
+  }
+
+  /**
+   * @brief Build the breakdown right before the completion callback is called at `time`. Called by
+   * the pipeline once per request.
+   *
+   */
+  void Finish(Clock::time_point time);
+
+private:
+  int64_t ToOffset(Clock::time_point time) const noexcept
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time - submit_time_).count();
+  }
+
+  // offsets from `submit_time_` in nanoseconds, -1 if not recorded. The branches of a DAG pipeline
+  // write different blocks concurrently.
+  struct _Stamp {
+    std::atomic<int64_t> enqueue_ns{-1};
+    std::atomic<int64_t> begin_ns{-1};
+    std::atomic<int64_t> end_ns{-1};
+  };
+
+  Clock::time_point                               submit_time_;
+  std::shared_ptr<const std::vector<std::string>> block_names_;
+  std::unique_ptr<_Stamp[]>                       stamps_;
+  size_t                                          stamp_num_      = 0;
+  size_t                                          stamp_capacity_ = 0;
+
+  std::vector<BlockLatency> blocks_;
+  int64_t                   callback_delay_ns_ = 0;
+  int64_t                   total_ns_          = 0;
+};
+
+using PipelineLatencyRecordPtr = std::shared_ptr<PipelineLatencyRecord>;
+
+} // namespace easy_deploy
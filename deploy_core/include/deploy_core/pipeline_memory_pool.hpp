@@ -0,0 +1,175 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace easy_deploy {
+
+/**
+ * @brief A thread-safe pool of fixed-size memory blocks, used by async pipeline to hold the
+ * per-request objects without touching the heap in steady state.
+ *
+ * Blocks are carved from slabs and recycled through free lists. The free lists are sharded, each
+ * thread allocates from and recycles to its own shard, so the producers and the pipeline workers
+ * rarely contend on the same lock. A thread steals from the other shards when its shard is
+ * empty, and the pool grows by a slab when all shards are empty. Requests larger than
+ * `block_size` fall back to `operator new`. Both heap allocations are counted by
+ * `GetHeapAllocationCount()`.
+ */
+class FixedBlockPool {
+public:
+  /**
+   * @brief Construct the pool.
+   *
+   * @param block_size size of each block in bytes, aligned up to `alignof(std::max_align_t)`.
+   * @param slab_block_num number of blocks allocated at construction and at each growth.
+   */
+  FixedBlockPool(size_t block_size, size_t slab_block_num);
+
+  FixedBlockPool(const FixedBlockPool &)            = delete;
+  FixedBlockPool &operator=(const FixedBlockPool &) = delete;
+
+  ~FixedBlockPool();
+
+  /**
+   * @brief Get a block of at least `size` bytes.
+   *
+   * @param size
+   * @return void*
+   */
+  void *Allocate(size_t size);
+
+  /**
+   * @brief Return a block got from `Allocate` with the same `size`.
+   *
+   * @param ptr
+   * @param size
+   */
+  void Deallocate(void *ptr, size_t size) noexcept;
+
+  /**
+   * @brief Construct a `T` in a block.
+   *
+   */
+  template <typename T, typename... Args>
+  T *New(Args &&...args)
+  {
+    void *ptr = Allocate(sizeof(T));
+    try
+    {
+      return new (ptr) T(std::forward<Args>(args)...);
+    } catch (...)
+    {
+      Deallocate(ptr, sizeof(T));
+      throw;
+    }
+  }
+
+  /**
+   * @brief Destroy a `T` constructed by `New` and recycle its block.
+   *
+   */
+  template <typename T>
+  void Delete(T *obj) noexcept
+  {
+    obj->~T();
+    Deallocate(obj, sizeof(T));
+  }
+
+  size_t GetBlockSize() const noexcept
+  {
+    return block_size_;
+  }
+
+  /**
+   * @brief Return the number of heap allocations made by the pool, i.e. slab growths and
+   * oversized requests.
+   *
+   * @return size_t
+   */
+  size_t GetHeapAllocationCount() const noexcept
+  {
+    return heap_allocations_.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct FreeNode {
+    FreeNode *next;
+  };
+
+  struct alignas(64) Shard {
+    std::mutex mtx;
+    FreeNode  *free_list = nullptr;
+  };
+
+  static constexpr size_t kShardNum = 8;
+
+  // index of the shard used by current thread
+  static size_t GetShardIndex() noexcept;
+
+  // returns the first block of a new slab, the rest are pushed into `shard`
+  void *Grow(Shard &shard);
+
+  const size_t block_size_;
+  const size_t slab_block_num_;
+
+  Shard shards_[kShardNum];
+
+  std::mutex                                    slab_mtx_;
+  std::vector<std::unique_ptr<unsigned char[]>> slabs_;
+
+  std::atomic<size_t> heap_allocations_{0};
+};
+
+/**
+ * @brief Standard allocator on a `FixedBlockPool`, e.g. for the shared state of `std::promise`.
+ * It shares the ownership of the pool, so the pool outlives every object allocated by it.
+ *
+ * @tparam T
+ */
+template <typename T>
+class PoolAllocator {
+  template <typename U>
+  friend class PoolAllocator;
+
+public:
+  using value_type = T;
+
+  explicit PoolAllocator(std::shared_ptr<FixedBlockPool> pool) noexcept : pool_(std::move(pool))
+  {}
+
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U> &other) noexcept : pool_(other.pool_)
+  {}
+
+  T *allocate(size_t n)
+  {
+    return static_cast<T *>(pool_->Allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T *ptr, size_t n) noexcept
+  {
+    pool_->Deallocate(ptr, n * sizeof(T));
+  }
+
+  template <typename U>
+  bool operator==(const PoolAllocator<U> &other) const noexcept
+  {
+    return pool_ == other.pool_;
+  }
+
+  template <typename U>
+  bool operator!=(const PoolAllocator<U> &other) const noexcept
+  {
+    return pool_ != other.pool_;
+  }
+
+private:
+  std::shared_ptr<FixedBlockPool> pool_;
+};
+
+} // namespace easy_deploy
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace easy_deploy {
+
+/**
+ * @brief CPU placement policy of the dedicated threads of pipeline blocks, used in
+ * `AsyncPipelineConfig`. Pinned threads do not migrate between big and little cores or across
+ * sockets, which keeps their cache state and reduces the latency jitter.
+ *
+ * The blocks running on the shared executor are not pinned by the policy. To pin them, construct a
+ * `WorkStealingThreadPool` with the cpus and pass it by `AsyncPipelineConfig::executor`. In the
+ * default `SHARED_EXECUTOR` mode the policy only applies to the blocks marked by
+ * `SetDedicatedThread` and the batch blocks.
+ *
+ */
+struct PipelinePlacementPolicy {
+  // cpu set of the dedicated threads of each block, keyed by block name. All threads of a
+  // replicated block share the cpu set. Fused blocks are named like "A + B".
+  std::unordered_map<std::string, std::vector<int>> block_cpus;
+  // pin each dedicated thread not listed in `block_cpus` to one cpu, assigned round-robin from the
+  // cpus available to the process except `reserved_cpus`.
+  bool auto_assign = false;
+  // cpus left to the others in auto assignment, e.g. the intra-op threads of onnxruntime.
+  std::vector<int> reserved_cpus;
+
+  /**
+   * @brief Return the cpus used by auto assignment.
+   *
+   * @return std::vector<int>
+   */
+  std::vector<int> GetAutoAssignCpus() const;
+};
+
+/**
+ * @brief Return the cpus which the process is allowed to run on.
+ *
+ * @return std::vector<int>
+ */
+std::vector<int> GetAvailableCpus();
+
+/**
+ * @brief Pin the calling thread to `cpus`. Do nothing if `cpus` is empty. Return false if it
+ * failed or is not supported on this platform.
+ *
+ * @param cpus
+ * @return true
+ * @return false
+ */
+bool SetCurrentThreadAffinity(const std::vector<int> &cpus);
+
+} // namespace easy_deploy
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace easy_deploy {
+
+/**
+ * @brief A block of one pipeline served by `SharedPipelineStage`. Its packages wait in the input
+ * queue of the block, and the shared stage calls `RunOne` once the block is notified.
+ *
+ */
+class ISharedStageClient {
+public:
+  /**
+   * @brief Process one package waiting in the input queue, and notify again if more can be
+   * processed. Return false if there is none, e.g. it was dropped after being notified, or if the
+   * block can not take one now, e.g. its outputs are blocked. The block is skipped then until it
+   * is notified again.
+   *
+   */
+  virtual bool RunOne() = 0;
+
+protected:
+  virtual ~ISharedStageClient() = default;
+};
+
+/**
+ * @brief A stage shared by the blocks of several pipelines which use one engine, e.g. the image
+ * encoder inference of SAM used by both its box and point pipelines. Instead of every pipeline
+ * running its own threads on the same engine, one worker thread serves the blocks in round-robin,
+ * one package per turn, so the engine runs one request at a time and no pipeline starves the
+ * others. See `AsyncPipelineBlock::SetSharedStage`.
+ *
+ */
+class SharedPipelineStage {
+public:
+  explicit SharedPipelineStage(const std::string &name);
+
+  SharedPipelineStage(const SharedPipelineStage &)            = delete;
+  SharedPipelineStage &operator=(const SharedPipelineStage &) = delete;
+
+  ~SharedPipelineStage();
+
+  /**
+   * @brief Start serving `client`, called by the pipeline when it starts.
+   *
+   */
+  void Attach(ISharedStageClient *client);
+
+  /**
+   * @brief Stop serving `client`, and wait until its package being processed is done. The
+   * notifications of it are discarded. Called by the pipeline when it shuts down.
+   *
+   */
+  void Detach(ISharedStageClient *client);
+
+  /**
+   * @brief Tell the worker that `client` has packages to process. Thread-safe. Ignored if `client`
+   * is not attached.
+   *
+   */
+  void Notify(ISharedStageClient *client);
+
+  const std::string &GetName() const noexcept
+  {
+    return name_;
+  }
+
+  /**
+   * @brief Return the number of attached clients.
+   *
+   */
+  size_t GetClientNum();
+
+private:
+  void WorkerEntry();
+
+  const std::string name_;
+
+  std::mutex              mtx_;
+  std::condition_variable worker_cv_;
+  std::condition_variable idle_cv_;
+  // attached clients and if they are notified since their last turn, served from `next_client_`
+  std::vector<std::pair<ISharedStageClient *, bool>> clients_;
+  size_t                                             next_client_ = 0;
+  ISharedStageClient                                *running_     = nullptr;
+  bool                                               stop_        = false;
+
+  std::thread worker_;
+};
+
+} // namespace easy_deploy
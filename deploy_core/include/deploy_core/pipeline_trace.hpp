@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace easy_deploy {
+
+/**
+ * @brief Process-wide tracer of the async pipelines, which records when each package enters the
+ * input queue of a block and when the block starts and finishes it. The records could be exported
+ * as Chrome trace JSON, and opened by chrome://tracing or https://ui.perfetto.dev to see the
+ * compute of every block on each thread, and the queue wait of every package before each block.
+ *
+ * Every thread writes its own fixed-size buffer without locking. Once the buffer is full, the
+ * later records of the thread are dropped and counted. When tracing is stopped, the pipelines
+ * only pay one relaxed atomic load per package.
+ *
+ * Usage:
+ *    PipelineTracer::Start();
+ *    ... // push packages to pipelines
+ *    PipelineTracer::Stop();
+ *    PipelineTracer::ExportChromeTrace("pipeline_trace.json");
+ *
+ */
+class PipelineTracer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * @brief Start a new tracing session, the records of the last session are discarded.
+   *
+   * @param events_per_thread capacity of the buffer of each thread.
+   */
+  static void Start(size_t events_per_thread = 1 << 16);
+
+  /**
+   * @brief Stop recording, the records are kept until the next `Start`.
+   *
+   */
+  static void Stop() noexcept;
+
+  static bool IsEnabled() noexcept
+  {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Export the records of the current session as Chrome trace JSON. Better call it after
+   * `Stop`, the packages in flight would have incomplete records.
+   *
+   * @return std::string
+   */
+  static std::string ExportChromeTrace();
+
+  /**
+   * @brief Export the records of the current session as Chrome trace JSON file.
+   *
+   * @param path
+   * @return true
+   * @return false if failed to write the file.
+   */
+  static bool ExportChromeTrace(const std::string &path);
+
+  /**
+   * @brief Return the number of records dropped because of full buffers in the current session.
+   *
+   * @return size_t
+   */
+  static size_t GetDroppedCount();
+
+  /**
+   * @brief Return the id of a block name used by the records. The same name always gets the same
+   * id, so it is registered once when the pipeline starts.
+   *
+   * @param name
+   * @return uint32_t
+   */
+  static uint32_t RegisterName(const std::string &name);
+
+  /**
+   * @brief Return a new package id, which is never 0.
+   *
+   * @return uint64_t
+   */
+  static uint64_t NewPackageId() noexcept;
+
+  /**
+   * @brief Record that the package enters the input queue of block `name_id`.
+   *
+   */
+  static void RecordEnqueue(uint32_t name_id, uint64_t package_id) noexcept;
+
+  /**
+   * @brief Record that block `name_id` processes the package on the calling thread during
+   * [`begin`, `end`].
+   *
+   */
+  static void RecordCompute(uint32_t          name_id,
+                            uint64_t          package_id,
+                            Clock::time_point begin,
+                            Clock::time_point end) noexcept;
+
+private:
+  static std::atomic<bool> enabled_;
+};
+
+} // namespace easy_deploy
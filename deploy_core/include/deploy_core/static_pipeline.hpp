@@ -0,0 +1,242 @@
+#pragma once
+
+#include <array>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "common_utils/block_queue.hpp"
+#include "common_utils/log.hpp"
+#include "common_utils/spsc_queue.hpp"
+#include "deploy_core/async_pipeline_impl.hpp"
+
+namespace easy_deploy {
+
+/**
+ * @brief A pipeline whose package type and stages are known at compile time, an alternative to
+ * `BaseAsyncPipeline` for the hot models where every microsecond counts.
+ *
+ * Each stage is a functor `bool(Package &)` held by value and running on its own thread. The
+ * packages move between stages as `std::unique_ptr` through lock-free `SpscQueue`s, so the stage
+ * calls are inlined, and there is no `std::function`, `dynamic_pointer_cast` or `shared_ptr`
+ * refcount on the way. A stage returning false or throwing makes the package skip the rest stages
+ * with `FAILED` status. The packages leave the pipeline in push order.
+ *
+ * Usage:
+ *    StaticPipeline<DetPackage, Pre, Infer, Post> pipeline(Pre(), Infer(engine), Post());
+ *    pipeline.Init();
+ *    pipeline.Push(std::make_unique<DetPackage>(image));
+ *    auto output = pipeline.Take();
+ *
+ * @tparam Package
+ * @tparam Stages
+ */
+template <typename Package, typename... Stages>
+class StaticPipeline {
+  static_assert(sizeof...(Stages) > 0, "StaticPipeline needs at least one stage");
+
+public:
+  using PackagePtr = std::unique_ptr<Package>;
+
+  /**
+   * @brief A package leaving the pipeline, with `SUCCESS` or `FAILED` status.
+   *
+   */
+  struct Output {
+    PackagePtr    package;
+    PackageStatus status = PackageStatus::SUCCESS;
+  };
+
+  explicit StaticPipeline(Stages... stages) : stages_(std::move(stages)...)
+  {}
+
+  StaticPipeline(const StaticPipeline &)            = delete;
+  StaticPipeline &operator=(const StaticPipeline &) = delete;
+
+  ~StaticPipeline()
+  {
+    Close();
+  }
+
+  /**
+   * @brief Start one thread for each stage.
+   *
+   * @param queue_size max size of the input queue and the queues between stages.
+   * @return true
+   * @return false if the pipeline is already initialized.
+   */
+  bool Init(size_t queue_size = 100)
+  {
+    if (!threads_.empty())
+    {
+      LOG_WARN("[StaticPipeline] pipeline is already initialized!");
+      return false;
+    }
+    input_ = std::make_unique<BlockQueue<Output>>(queue_size);
+    for (auto &link : links_)
+    {
+      link = std::make_unique<SpscQueue<Output>>(queue_size);
+    }
+    // the outputs wait for `Take`, so `Close` never blocks on a full output queue
+    output_ = std::make_unique<BlockQueue<Output>>(std::numeric_limits<size_t>::max());
+    StartStages(std::index_sequence_for<Stages...>{});
+    return true;
+  }
+
+  /**
+   * @brief Push a package into the pipeline, block if the input queue is full. Thread-safe.
+   *
+   * @param package
+   * @return true
+   * @return false if the pipeline is not initialized or closed.
+   */
+  bool Push(PackagePtr package)
+  {
+    if (input_ == nullptr || package == nullptr)
+    {
+      return false;
+    }
+    return input_->BlockPush({std::move(package), PackageStatus::SUCCESS});
+  }
+
+  /**
+   * @brief Take the next package leaving the pipeline, block until there is one. Return
+   * std::nullopt once the pipeline is closed and all packages are taken.
+   *
+   */
+  std::optional<Output> Take()
+  {
+    return output_ == nullptr ? std::nullopt : output_->Take();
+  }
+
+  /**
+   * @brief Take the next package leaving the pipeline if any; else return std::nullopt.
+   *
+   */
+  std::optional<Output> TryTake()
+  {
+    return output_ == nullptr ? std::nullopt : output_->TryTake();
+  }
+
+  /**
+   * @brief Run all stages on the calling thread, without any queue or thread switch. Should not be
+   * called while the pipeline is initialized, the stages are not shared between threads.
+   *
+   * @param package
+   * @return true
+   * @return false once some stage returned false.
+   */
+  bool Run(Package &package)
+  {
+    return RunInline(package, std::index_sequence_for<Stages...>{});
+  }
+
+  /**
+   * @brief Stop accepting packages, wait for the packages in flight to go through all stages and
+   * join the threads. The outputs could still be taken after it.
+   *
+   */
+  void Close()
+  {
+    if (threads_.empty())
+    {
+      return;
+    }
+    input_->DisablePush();
+    input_->SetNoMoreInput();
+    for (auto &thread : threads_)
+    {
+      thread.join();
+    }
+    threads_.clear();
+  }
+
+private:
+  static constexpr size_t kStageNum = sizeof...(Stages);
+
+  template <size_t... I>
+  void StartStages(std::index_sequence<I...>)
+  {
+    (threads_.emplace_back(&StaticPipeline::StageEntry<I>, this), ...);
+  }
+
+  template <size_t... I>
+  bool RunInline(Package &package, std::index_sequence<I...>)
+  {
+    return (std::get<I>(stages_)(package) && ...);
+  }
+
+  template <size_t I>
+  auto &InputOf()
+  {
+    if constexpr (I == 0)
+    {
+      return *input_;
+    } else
+    {
+      return *links_[I - 1];
+    }
+  }
+
+  template <size_t I>
+  auto &OutputOf()
+  {
+    if constexpr (I + 1 == kStageNum)
+    {
+      return *output_;
+    } else
+    {
+      return *links_[I];
+    }
+  }
+
+  template <size_t I>
+  void StageEntry()
+  {
+    auto &stage  = std::get<I>(stages_);
+    auto &input  = InputOf<I>();
+    auto &output = OutputOf<I>();
+    while (true)
+    {
+      auto data = input.Take();
+      if (!data.has_value())
+      {
+        break;
+      }
+      // failed packages still go through the queues to keep the order, but skip the stages
+      if (data->status == PackageStatus::SUCCESS)
+      {
+        try
+        {
+          if (!stage(*data->package))
+          {
+            data->status = PackageStatus::FAILED;
+          }
+        } catch (const std::exception &e)
+        {
+          LOG_ERROR("[StaticPipeline] stage %d got exception : %s", static_cast<int>(I), e.what());
+          data->status = PackageStatus::FAILED;
+        }
+      }
+      if (!output.BlockPush(std::move(data.value())))
+      {
+        break;
+      }
+    }
+    output.SetNoMoreInput();
+  }
+
+  std::tuple<Stages...> stages_;
+
+  std::unique_ptr<BlockQueue<Output>>                           input_;
+  std::array<std::unique_ptr<SpscQueue<Output>>, kStageNum - 1> links_;
+  std::unique_ptr<BlockQueue<Output>>                           output_;
+
+  std::vector<std::thread> threads_;
+};
+
+} // namespace easy_deploy
@@ -32,7 +32,9 @@ static std::shared_ptr<DetectionPipelinePackage> CreateDetectionPipelineUnit(
   return package;
 }
 
-BaseDetectionModel::BaseDetectionModel(std::shared_ptr<BaseInferCore> infer_core)
+BaseDetectionModel::BaseDetectionModel(std::shared_ptr<BaseInferCore> infer_core,
+                                       int                            preprocess_parallelism,
+                                       int                            postprocess_parallelism)
     : infer_core_(infer_core)
 {
   // 1. check infer_core
@@ -43,12 +45,14 @@ BaseDetectionModel::BaseDetectionModel(std::shared_ptr<BaseInferCore> infer_core
 
   // 2. configure pipeline
   auto preprocess_block = BaseAsyncPipeline::BuildPipelineBlock(
-      [=](ParsingType unit) -> bool { return PreProcess(unit); }, "BaseDet PreProcess");
+      [=](ParsingType unit) -> bool { return PreProcess(unit); }, "BaseDet PreProcess",
+      preprocess_parallelism);
 
   auto infer_core_context = infer_core->GetPipelineContext();
 
   auto postprocess_block = BaseAsyncPipeline::BuildPipelineBlock(
-      [=](ParsingType unit) -> bool { return PostProcess(unit); }, "BaseDet PostProcess");
+      [=](ParsingType unit) -> bool { return PostProcess(unit); }, "BaseDet PostProcess",
+      postprocess_parallelism);
 
   BaseAsyncPipeline::ConfigPipeline(detection_pipeline_name_,
                                     {preprocess_block, infer_core_context, postprocess_block});
@@ -88,31 +92,79 @@ bool BaseDetectionModel::Detect(const cv::Mat       &input_image,
   return true;
 }
 
-std::future<std::vector<BBox2D>> BaseDetectionModel::DetectAsync(const cv::Mat &input_image,
-                                                                 float          conf_thresh,
-                                                                 bool           isRGB,
-                                                                 bool cover_oldest) noexcept
+std::future<std::vector<BBox2D>> BaseDetectionModel::DetectAsync(
+    const cv::Mat                  &input_image,
+    float                           conf_thresh,
+    bool                            isRGB,
+    bool                            cover_oldest,
+    const PipelineClock::time_point deadline,
+    PackagePriority                 priority,
+    const AsyncCancelToken         &cancel_token,
+    const PipelineLatencyRecordPtr &latency) noexcept
+{
+  // reject at once instead of blocking on the blobs buffer if the pipeline is overloaded
+  if (!cover_oldest && !AdmitRequest(detection_pipeline_name_, deadline))
+  {
+    return RejectRequest();
+  }
+  auto package = CreateAsyncPackage(input_image, conf_thresh, isRGB, cover_oldest);
+  if (package == nullptr)
+  {
+    return std::future<std::vector<BBox2D>>();
+  }
+
+  // push package into pipeline and return `std::future`
+  return PushPipeline(detection_pipeline_name_, package, cover_oldest, deadline, priority,
+                      cancel_token, latency);
+}
+
+bool BaseDetectionModel::DetectAsync(const cv::Mat                              &input_image,
+                                     float                                       conf_thresh,
+                                     const AsyncCompletion<std::vector<BBox2D>> &completion,
+                                     bool                                        isRGB,
+                                     bool                                        cover_oldest,
+                                     const PipelineClock::time_point             deadline,
+                                     PackagePriority                             priority,
+                                     const AsyncCancelToken                     &cancel_token,
+                                     const PipelineLatencyRecordPtr             &latency) noexcept
+{
+  if (!cover_oldest && !AdmitRequest(detection_pipeline_name_, deadline))
+  {
+    return RejectRequest(completion);
+  }
+  auto package = CreateAsyncPackage(input_image, conf_thresh, isRGB, cover_oldest);
+  if (package == nullptr)
+  {
+    return false;
+  }
+
+  // push package into pipeline, the results go to `completion`
+  return PushPipeline(detection_pipeline_name_, package, completion, cover_oldest, deadline,
+                      priority, cancel_token, latency);
+}
+
+std::shared_ptr<IPipelinePackage> BaseDetectionModel::CreateAsyncPackage(
+    const cv::Mat &input_image, float conf_thresh, bool isRGB, bool cover_oldest) noexcept
 {
   // 1. check if the pipeline is initialized
   if (!IsPipelineInitialized(detection_pipeline_name_))
   {
     LOG_ERROR("[BaseDetectionModel] Async Pipeline is not init yet!!!");
-    return std::future<std::vector<BBox2D>>();
+    return nullptr;
   }
 
-  // 2. get blob buffer
-  auto blob_buffers = infer_core_->GetBuffer(true);
+  // 2. get blob buffer, drop the oldest pending packages to release buffers if `cover_oldest`
+  auto blob_buffers =
+      AllocOrCoverOldest(detection_pipeline_name_, cover_oldest,
+                         [this](bool block) { return infer_core_->GetBuffer(block); });
   if (blob_buffers == nullptr)
   {
     LOG_ERROR("[BaseDetectionModel] Failed to get buffer from inference core!!!");
-    return std::future<std::vector<BBox2D>>();
+    return nullptr;
   }
 
   // 3. create a pipeline package
-  auto package = CreateDetectionPipelineUnit(input_image, conf_thresh, isRGB, blob_buffers);
-
-  // 4. push package into pipeline and return `std::future`
-  return PushPipeline(detection_pipeline_name_, package);
+  return CreateDetectionPipelineUnit(input_image, conf_thresh, isRGB, blob_buffers);
 }
 
 BaseDetectionModel::~BaseDetectionModel()
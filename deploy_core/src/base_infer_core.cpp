@@ -1,7 +1,13 @@
 #include "deploy_core/base_infer_core.hpp"
 
+#include <algorithm>
+#include <cstring>
+
 namespace easy_deploy {
 
+static const std::string kInferCorePipelineName = "InferCore Pipieline";
+static const std::string kInferenceBlockName    = "BaseInferCore Inference";
+
 // used in sync infer
 struct _InnerSyncInferPackage : public IPipelinePackage {
 public:
@@ -14,13 +20,34 @@ public:
 
 BaseInferCore::BaseInferCore()
 {
+  ConfigInferCorePipeline();
+}
+
+bool BaseInferCore::ConfigInferCorePipeline()
+{
+  if (IsPipelineInitialized(kInferCorePipelineName))
+  {
+    LOG_ERROR("[BaseInferCore] the pipeline should be configured before it is initialized!");
+    return false;
+  }
   auto preprocess_block = BuildPipelineBlock(
       [&](ParsingType unit) -> bool { return PreProcess(unit); }, "BaseInferCore PreProcess");
   auto inference_block = BuildPipelineBlock(
-      [&](ParsingType unit) -> bool { return Inference(unit); }, "BaseInferCore Inference");
+      [&](ParsingType unit) -> bool { return Inference(unit); }, kInferenceBlockName);
   auto postprocess_block = BuildPipelineBlock(
       [&](ParsingType unit) -> bool { return PostProcess(unit); }, "BaseInferCore PostProcess");
-  ConfigPipeline("InferCore Pipieline", {preprocess_block, inference_block, postprocess_block});
+  preprocess_block.SetTrivial(trivial_preprocess_);
+  postprocess_block.SetTrivial(trivial_postprocess_);
+  inference_block.SetSharedStage(shared_stage_);
+  ConfigPipeline(kInferCorePipelineName, {preprocess_block, inference_block, postprocess_block});
+  return true;
+}
+
+void BaseInferCore::SetTrivialStages(bool trivial_preprocess, bool trivial_postprocess)
+{
+  trivial_preprocess_  = trivial_preprocess;
+  trivial_postprocess_ = trivial_postprocess;
+  ConfigInferCorePipeline();
 }
 
 bool BaseInferCore::SyncInfer(BlobsTensor *tensors, const int batch_size)
@@ -38,10 +65,189 @@ std::shared_ptr<BlobsTensor> BaseInferCore::GetBuffer(bool block)
   return mem_buf_pool_->Alloc(block);
 }
 
+bool BaseInferCore::PlaceBufferPool(const std::vector<int> &cpus)
+{
+  if (mem_buf_pool_ == nullptr ||
+      static_cast<size_t>(mem_buf_pool_->RemainSize()) != mem_buf_pool_->GetPoolSize())
+  {
+    LOG_ERROR("[BaseInferCore] `PlaceBufferPool` should be called when all buffers are in pool!");
+    return false;
+  }
+  const size_t pool_size = mem_buf_pool_->GetPoolSize();
+
+  std::unique_ptr<MemBufferPool> placed_pool;
+  std::thread                    placer([&] {
+    if (!SetCurrentThreadAffinity(cpus))
+    {
+      LOG_WARN("[BaseInferCore] `PlaceBufferPool` failed to pin thread, buffers are not placed.");
+    }
+    try
+    {
+      placed_pool = std::make_unique<MemBufferPool>(this, pool_size, true);
+    } catch (const std::exception &e)
+    {
+      LOG_ERROR("[BaseInferCore] `PlaceBufferPool` failed to allocate buffers : %s", e.what());
+    }
+  });
+  placer.join();
+  if (placed_pool == nullptr)
+  {
+    return false;
+  }
+  mem_buf_pool_ = std::move(placed_pool);
+  LOG_DEBUG("[BaseInferCore] placed mem buf pool with pool_size : %zu", pool_size);
+  return true;
+}
+
+bool BaseInferCore::PlaceBufferPool(const PipelinePlacementPolicy &placement)
+{
+  auto iter = placement.block_cpus.find(kInferenceBlockName);
+  if (iter == placement.block_cpus.end())
+  {
+    LOG_ERROR("[BaseInferCore] `PlaceBufferPool` got no cpus of block {%s} in placement!",
+              kInferenceBlockName.c_str());
+    return false;
+  }
+  return PlaceBufferPool(iter->second);
+}
+
+bool BaseInferCore::EnableDynamicBatching(int                             max_batch_size,
+                                          int                             max_wait_us,
+                                          const std::vector<std::string> &input_blob_names,
+                                          const std::vector<std::string> &output_blob_names)
+{
+  if (IsPipelineInitialized(kInferCorePipelineName))
+  {
+    LOG_ERROR("[BaseInferCore] `EnableDynamicBatching` should be called before the pipeline is "
+              "initialized!");
+    return false;
+  }
+  auto batch_buffer = AllocBlobsBuffer();
+  auto input_names  = input_blob_names.empty() ? batch_buffer->GetTensorNames() : input_blob_names;
+  auto output_names =
+      output_blob_names.empty() ? batch_buffer->GetTensorNames() : output_blob_names;
+  for (const auto &names : {input_names, output_names})
+  {
+    for (const auto &name : names)
+    {
+      const auto &shape = batch_buffer->GetTensor(name)->GetDefaultShape();
+      if (shape.empty() || shape[0] < static_cast<size_t>(max_batch_size))
+      {
+        throw std::invalid_argument("[BaseInferCore] blob " + name +
+                                    " could not hold a batch of size " +
+                                    std::to_string(max_batch_size));
+      }
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lk(batch_mtx_);
+    batch_buffer_       = std::move(batch_buffer);
+    batch_input_names_  = std::move(input_names);
+    batch_output_names_ = std::move(output_names);
+  }
+
+  auto batch_block = BuildPipelineBatchBlock(
+      [&](const std::vector<ParsingType> &units) -> bool { return BatchInference(units); },
+      "BaseInferCore BatchInference", max_batch_size, max_wait_us);
+  ConfigPipeline(kInferCorePipelineName, {batch_block});
+  LOG_DEBUG("[BaseInferCore] enable dynamic batching, max_batch_size : %d, max_wait_us : %d",
+            max_batch_size, max_wait_us);
+  return true;
+}
+
+bool BaseInferCore::EnableSharedInferenceStage()
+{
+  if (IsPipelineInitialized(kInferCorePipelineName))
+  {
+    LOG_ERROR("[BaseInferCore] `EnableSharedInferenceStage` should be called before the pipeline "
+              "is initialized!");
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lk(batch_mtx_);
+    if (batch_buffer_ != nullptr)
+    {
+      LOG_WARN("[BaseInferCore] dynamic batching is enabled, shared inference stage is ignored.");
+      return false;
+    }
+  }
+  if (shared_stage_ == nullptr)
+  {
+    const auto name = GetName().empty() ? std::string("BaseInferCore") : GetName();
+    shared_stage_   = std::make_shared<SharedPipelineStage>(name + " Inference");
+  }
+  ConfigInferCorePipeline();
+  LOG_DEBUG("[BaseInferCore] enable shared inference stage {%s}", shared_stage_->GetName().c_str());
+  return true;
+}
+
+// make the host buffer of `tensor` accessible by `RawPtr`
+static void *GetHostPtr(ITensor *tensor)
+{
+  if (tensor->GetBufferLocation() != DataLocation::HOST)
+  {
+    tensor->ToLocation(DataLocation::HOST);
+    tensor->SetBufferLocation(DataLocation::HOST);
+  }
+  return tensor->RawPtr();
+}
+
+bool BaseInferCore::BatchInference(const std::vector<ParsingType> &packages)
+{
+  std::lock_guard<std::mutex> lk(batch_mtx_);
+  batch_buffer_->Reset();
+
+  // 1. gather the input blobs of packages, the unused samples of the batch are zeroed instead of
+  // running on the stale ones of the last batch
+  for (const auto &name : batch_input_names_)
+  {
+    auto         batch_tensor = batch_buffer_->GetTensor(name);
+    const size_t batch        = batch_tensor->GetShape()[0];
+    const size_t sample_size  = batch_tensor->GetTensorByteSize() / batch;
+    auto         batch_ptr    = static_cast<char *>(GetHostPtr(batch_tensor));
+    for (size_t i = 0; i < packages.size(); ++i)
+    {
+      auto blobs_tensor = packages[i]->GetInferBuffer();
+      CHECK_STATE_THROW(blobs_tensor != nullptr,
+                        "[BaseInferCore] BatchInference got invalid blobs_tensor!");
+      auto tensor = blobs_tensor->GetTensor(name);
+      memcpy(batch_ptr + i * sample_size, GetHostPtr(tensor),
+             std::min(sample_size, tensor->GetTensorByteSize()));
+    }
+    if (packages.size() < batch)
+    {
+      memset(batch_ptr + packages.size() * sample_size, 0,
+             (batch - packages.size()) * sample_size);
+    }
+  }
+
+  // 2. one inference for the whole batch
+  CHECK_STATE_THROW(SyncInfer(batch_buffer_.get(), packages.size()),
+                    "[BaseInferCore] BatchInference SyncInfer Failed!!!");
+
+  // 3. scatter the output blobs back to packages
+  for (const auto &name : batch_output_names_)
+  {
+    auto         batch_tensor = batch_buffer_->GetTensor(name);
+    const size_t sample_size  = batch_tensor->GetTensorByteSize() / batch_tensor->GetShape()[0];
+    auto         batch_ptr    = static_cast<const char *>(GetHostPtr(batch_tensor));
+    for (size_t i = 0; i < packages.size(); ++i)
+    {
+      auto tensor = packages[i]->GetInferBuffer()->GetTensor(name);
+      tensor->SetBufferLocation(DataLocation::HOST);
+      memcpy(tensor->RawPtr(), batch_ptr + i * sample_size,
+             std::min(sample_size, tensor->GetTensorByteSize()));
+    }
+  }
+  return true;
+}
+
 void BaseInferCore::Release()
 {
   BaseAsyncPipeline::ClosePipeline();
   mem_buf_pool_.reset();
+  batch_buffer_.reset();
 }
 
 void BaseInferCore::Init(size_t mem_buf_size)
@@ -44,12 +44,55 @@ bool BaseMonoStereoModel::ComputeDepth(const cv::Mat &input_image, cv::Mat &disp
   return true;
 }
 
-std::future<cv::Mat> BaseMonoStereoModel::ComputeDepthAsync(const cv::Mat &input_image)
+std::future<cv::Mat> BaseMonoStereoModel::ComputeDepthAsync(
+    const cv::Mat                  &input_image,
+    const PipelineClock::time_point deadline,
+    PackagePriority                 priority,
+    const AsyncCancelToken         &cancel_token,
+    const PipelineLatencyRecordPtr &latency)
+{
+  if (!AdmitRequest(mono_stereo_pipeline_name_, deadline))
+  {
+    return RejectRequest();
+  }
+  auto package = CreateAsyncPackage(input_image);
+  if (package == nullptr)
+  {
+    return std::future<cv::Mat>();
+  }
+
+  return BaseAsyncPipeline::PushPipeline(mono_stereo_pipeline_name_, package, false, deadline,
+                                         priority, cancel_token, latency);
+}
+
+bool BaseMonoStereoModel::ComputeDepthAsync(const cv::Mat                  &input_image,
+                                            const AsyncCompletion<cv::Mat> &completion,
+                                            const PipelineClock::time_point deadline,
+                                            PackagePriority                 priority,
+                                            const AsyncCancelToken         &cancel_token,
+                                            const PipelineLatencyRecordPtr &latency)
+{
+  if (!AdmitRequest(mono_stereo_pipeline_name_, deadline))
+  {
+    return RejectRequest(completion);
+  }
+  auto package = CreateAsyncPackage(input_image);
+  if (package == nullptr)
+  {
+    return false;
+  }
+
+  return BaseAsyncPipeline::PushPipeline(mono_stereo_pipeline_name_, package, completion, false,
+                                         deadline, priority, cancel_token, latency);
+}
+
+BaseMonoStereoModel::ParsingType BaseMonoStereoModel::CreateAsyncPackage(
+    const cv::Mat &input_image)
 {
   if (input_image.empty())
   {
     LOG_ERROR("[BaseMonoStereoModel] `ComputeDepthAsync` Got invalid input images !!!");
-    return std::future<cv::Mat>();
+    return nullptr;
   }
 
   auto package              = std::make_shared<MonoStereoPipelinePackage>();
@@ -59,10 +102,9 @@ std::future<cv::Mat> BaseMonoStereoModel::ComputeDepthAsync(const cv::Mat &input
   {
     LOG_ERROR(
         "[BaseMonoStereoModel] `ComputeDepthAsync` Got invalid inference core buffer ptr !!!");
-    return std::future<cv::Mat>();
+    return nullptr;
   }
-
-  return BaseAsyncPipeline::PushPipeline(mono_stereo_pipeline_name_, package);
+  return package;
 }
 
 } // namespace easy_deploy
@@ -88,6 +88,13 @@ BaseSamModel::BaseSamModel(const std::string             &model_name,
     throw std::invalid_argument("one of `point/box` decoder should be non-nullptr");
   }
 
+  // the point and box pipelines run the encoder on one worker instead of competing for it
+  if (mask_points_decoder_core_ != nullptr && mask_boxes_decoder_core_ != nullptr &&
+      !image_encoder_core_->EnableSharedInferenceStage())
+  {
+    LOG_WARN("[BaseSamModel] the point and box pipelines run the image encoder separately.");
+  }
+
   if (mask_points_decoder_core_ != nullptr)
   {
     ConfigurePointPipeline();
@@ -250,23 +257,122 @@ std::future<cv::Mat> BaseSamModel::GenerateMaskAsync(const cv::Mat
                                                      const std::vector<std::pair<int, int>> &points,
                                                      const std::vector<int>                 &labels,
                                                      bool                                    isRGB,
-                                                     bool cover_oldest)
+                                                     bool                    cover_oldest,
+                                                     PackagePriority         priority,
+                                                     const AsyncCancelToken &cancel_token,
+                                                     const PipelineLatencyRecordPtr &latency)
+{
+  // reject at once instead of blocking on the encoder and decoder buffers when overloaded
+  if (!cover_oldest && !AdmitRequest(point_pipeline_name_))
+  {
+    return RejectRequest();
+  }
+  auto package = CreateAsyncPackage(image, points, labels, isRGB, cover_oldest);
+  if (package == nullptr)
+  {
+    return std::future<cv::Mat>();
+  }
+
+  // return `std::future` instance
+  return BaseAsyncPipeline::PushPipeline(point_pipeline_name_, package, cover_oldest,
+                                         kPipelineNoDeadline, priority, cancel_token, latency);
+}
+
+std::future<cv::Mat> BaseSamModel::GenerateMaskAsync(const cv::Mat                  &image,
+                                                     const std::vector<BBox2D>      &boxes,
+                                                     bool                            isRGB,
+                                                     bool                            cover_oldest,
+                                                     PackagePriority                 priority,
+                                                     const AsyncCancelToken         &cancel_token,
+                                                     const PipelineLatencyRecordPtr &latency)
+{
+  if (!cover_oldest && !AdmitRequest(box_pipeline_name_))
+  {
+    return RejectRequest();
+  }
+  auto package = CreateAsyncPackage(image, boxes, isRGB, cover_oldest);
+  if (package == nullptr)
+  {
+    return std::future<cv::Mat>();
+  }
+
+  // return `std::future` instance
+  return BaseAsyncPipeline::PushPipeline(box_pipeline_name_, package, cover_oldest,
+                                         kPipelineNoDeadline, priority, cancel_token, latency);
+}
+
+bool BaseSamModel::GenerateMaskAsync(const cv::Mat                          &image,
+                                     const std::vector<std::pair<int, int>> &points,
+                                     const std::vector<int>                 &labels,
+                                     const AsyncCompletion<cv::Mat>         &completion,
+                                     bool                                    isRGB,
+                                     bool                                    cover_oldest,
+                                     PackagePriority                         priority,
+                                     const AsyncCancelToken                 &cancel_token,
+                                     const PipelineLatencyRecordPtr         &latency)
+{
+  if (!cover_oldest && !AdmitRequest(point_pipeline_name_))
+  {
+    return RejectRequest(completion);
+  }
+  auto package = CreateAsyncPackage(image, points, labels, isRGB, cover_oldest);
+  if (package == nullptr)
+  {
+    return false;
+  }
+
+  return BaseAsyncPipeline::PushPipeline(point_pipeline_name_, package, completion, cover_oldest,
+                                         kPipelineNoDeadline, priority, cancel_token, latency);
+}
+
+bool BaseSamModel::GenerateMaskAsync(const cv::Mat                  &image,
+                                     const std::vector<BBox2D>      &boxes,
+                                     const AsyncCompletion<cv::Mat> &completion,
+                                     bool                            isRGB,
+                                     bool                            cover_oldest,
+                                     PackagePriority                 priority,
+                                     const AsyncCancelToken         &cancel_token,
+                                     const PipelineLatencyRecordPtr &latency)
+{
+  if (!cover_oldest && !AdmitRequest(box_pipeline_name_))
+  {
+    return RejectRequest(completion);
+  }
+  auto package = CreateAsyncPackage(image, boxes, isRGB, cover_oldest);
+  if (package == nullptr)
+  {
+    return false;
+  }
+
+  return BaseAsyncPipeline::PushPipeline(box_pipeline_name_, package, completion, cover_oldest,
+                                         kPipelineNoDeadline, priority, cancel_token, latency);
+}
+
+BaseSamModel::ParsingType BaseSamModel::CreateAsyncPackage(
+    const cv::Mat                          &image,
+    const std::vector<std::pair<int, int>> &points,
+    const std::vector<int>                 &labels,
+    bool                                    isRGB,
+    bool                                    cover_oldest)
 {
   // 0. Check
   if (!CheckValidArguments(image, mask_points_decoder_core_, points, labels))
   {
     LOG_ERROR("[BaseSamModel] `GenerateMask` with points got invalid arguments");
-    return std::future<cv::Mat>();
+    return nullptr;
   }
   if (!BaseAsyncPipeline::IsPipelineInitialized(point_pipeline_name_))
   {
     LOG_ERROR("[BaseSamModel] Async pipeline with points as prompt is not initialized yet!!!");
-    return std::future<cv::Mat>();
+    return nullptr;
   }
 
-  // 1. Get blobs buffers
-  auto encoder_blob_buffers = image_encoder_core_->GetBuffer(true);
-  auto decoder_blob_buffers = mask_points_decoder_core_->GetBuffer(true);
+  // 1. Get blobs buffers, drop the oldest pending packages to release buffers if `cover_oldest`
+  auto encoder_alloc = [this](bool block) { return image_encoder_core_->GetBuffer(block); };
+  auto decoder_alloc = [this](bool block) { return mask_points_decoder_core_->GetBuffer(block); };
+
+  auto encoder_blob_buffers = AllocOrCoverOldest(point_pipeline_name_, cover_oldest, encoder_alloc);
+  auto decoder_blob_buffers = AllocOrCoverOldest(point_pipeline_name_, cover_oldest, decoder_alloc);
 
   // 2. Construct `SamPipelinePackage`
   auto package                        = std::make_shared<SamPipelinePackage>();
@@ -275,32 +381,33 @@ std::future<cv::Mat> BaseSamModel::GenerateMaskAsync(const cv::Mat
   package->labels                     = labels;
   package->image_encoder_blobs_buffer = encoder_blob_buffers;
   package->mask_decoder_blobs_buffer  = decoder_blob_buffers;
-
-  // 3. return `std::future` instance
-  return BaseAsyncPipeline::PushPipeline(point_pipeline_name_, package);
+  return package;
 }
 
-std::future<cv::Mat> BaseSamModel::GenerateMaskAsync(const cv::Mat             &image,
-                                                     const std::vector<BBox2D> &boxes,
-                                                     bool                       isRGB,
-                                                     bool                       cover_oldest)
+BaseSamModel::ParsingType BaseSamModel::CreateAsyncPackage(const cv::Mat             &image,
+                                                           const std::vector<BBox2D> &boxes,
+                                                           bool                       isRGB,
+                                                           bool cover_oldest)
 {
   // 0. check
   if (!CheckValidArguments(image, mask_boxes_decoder_core_, boxes))
   {
     LOG_ERROR("[BaseSamModel] `GenerateMask` with boxes got invalid arguments");
-    return std::future<cv::Mat>();
+    return nullptr;
   }
 
   if (!BaseAsyncPipeline::IsPipelineInitialized(box_pipeline_name_))
   {
     LOG_ERROR("[BaseSamModel] Async pipeline with boxes as prompt is not initialized yet!!!");
-    return std::future<cv::Mat>();
+    return nullptr;
   }
 
-  // 1. Get blobs buffers
-  auto encoder_blob_buffers = image_encoder_core_->GetBuffer(true);
-  auto decoder_blob_buffers = mask_boxes_decoder_core_->GetBuffer(true);
+  // 1. Get blobs buffers, drop the oldest pending packages to release buffers if `cover_oldest`
+  auto encoder_alloc = [this](bool block) { return image_encoder_core_->GetBuffer(block); };
+  auto decoder_alloc = [this](bool block) { return mask_boxes_decoder_core_->GetBuffer(block); };
+
+  auto encoder_blob_buffers = AllocOrCoverOldest(box_pipeline_name_, cover_oldest, encoder_alloc);
+  auto decoder_blob_buffers = AllocOrCoverOldest(box_pipeline_name_, cover_oldest, decoder_alloc);
 
   // 2. Construct `SamPipelinePackage`
   auto package                        = std::make_shared<SamPipelinePackage>();
@@ -308,9 +415,7 @@ std::future<cv::Mat> BaseSamModel::GenerateMaskAsync(const cv::Mat             &
   package->boxes                      = boxes;
   package->image_encoder_blobs_buffer = encoder_blob_buffers;
   package->mask_decoder_blobs_buffer  = decoder_blob_buffers;
-
-  // 3. return `std::future` instance
-  return BaseAsyncPipeline::PushPipeline(box_pipeline_name_, package);
+  return package;
 }
 
 } // namespace easy_deploy
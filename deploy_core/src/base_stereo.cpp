@@ -49,13 +49,57 @@ bool BaseStereoMatchingModel::ComputeDisp(const cv::Mat &left_image,
   return true;
 }
 
-std::future<cv::Mat> BaseStereoMatchingModel::ComputeDispAsync(const cv::Mat &left_image,
-                                                               const cv::Mat &right_image)
+std::future<cv::Mat> BaseStereoMatchingModel::ComputeDispAsync(
+    const cv::Mat                  &left_image,
+    const cv::Mat                  &right_image,
+    const PipelineClock::time_point deadline,
+    PackagePriority                 priority,
+    const AsyncCancelToken         &cancel_token,
+    const PipelineLatencyRecordPtr &latency)
+{
+  if (!AdmitRequest(stereo_pipeline_name_, deadline))
+  {
+    return RejectRequest();
+  }
+  auto package = CreateAsyncPackage(left_image, right_image);
+  if (package == nullptr)
+  {
+    return std::future<cv::Mat>();
+  }
+
+  return BaseAsyncPipeline::PushPipeline(stereo_pipeline_name_, package, false, deadline,
+                                         priority, cancel_token, latency);
+}
+
+bool BaseStereoMatchingModel::ComputeDispAsync(const cv::Mat                  &left_image,
+                                               const cv::Mat                  &right_image,
+                                               const AsyncCompletion<cv::Mat> &completion,
+                                               const PipelineClock::time_point deadline,
+                                               PackagePriority                 priority,
+                                               const AsyncCancelToken         &cancel_token,
+                                               const PipelineLatencyRecordPtr &latency)
+{
+  if (!AdmitRequest(stereo_pipeline_name_, deadline))
+  {
+    return RejectRequest(completion);
+  }
+  auto package = CreateAsyncPackage(left_image, right_image);
+  if (package == nullptr)
+  {
+    return false;
+  }
+
+  return BaseAsyncPipeline::PushPipeline(stereo_pipeline_name_, package, completion, false,
+                                         deadline, priority, cancel_token, latency);
+}
+
+BaseStereoMatchingModel::ParsingType BaseStereoMatchingModel::CreateAsyncPackage(
+    const cv::Mat &left_image, const cv::Mat &right_image)
 {
   if (left_image.empty() || right_image.empty())
   {
     LOG_ERROR("[BaseStereoMatchingModel] `ComputeDispAsync` Got invalid input images !!!");
-    return std::future<cv::Mat>();
+    return nullptr;
   }
 
   auto package              = std::make_shared<StereoPipelinePackage>();
@@ -66,10 +110,9 @@ std::future<cv::Mat> BaseStereoMatchingModel::ComputeDispAsync(const cv::Mat &le
   {
     LOG_ERROR(
         "[BaseStereoMatchingModel] `ComputeDispAsync` Got invalid inference core buffer ptr !!!");
-    return std::future<cv::Mat>();
+    return nullptr;
   }
-
-  return BaseAsyncPipeline::PushPipeline(stereo_pipeline_name_, package);
+  return package;
 }
 
 } // namespace easy_deploy
@@ -0,0 +1,138 @@
+#include "deploy_core/pipeline_executor.hpp"
+
+#include "common_utils/log.hpp"
+#include "deploy_core/pipeline_placement.hpp"
+
+namespace easy_deploy {
+
+// the pool and the worker index of the current thread, tasks submitted by a worker go into its
+// own deque.
+static thread_local const WorkStealingThreadPool *tls_current_pool  = nullptr;
+static thread_local size_t                        tls_current_index = 0;
+
+WorkStealingThreadPool::WorkStealingThreadPool(size_t thread_num, const std::vector<int> &cpus)
+{
+  if (thread_num == 0)
+  {
+    thread_num = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < thread_num; ++i)
+  {
+    workers_.emplace_back(std::make_unique<Worker>());
+  }
+  for (size_t i = 0; i < thread_num; ++i)
+  {
+    const int cpu       = cpus.empty() ? -1 : cpus[i % cpus.size()];
+    workers_[i]->thread = std::thread(&WorkStealingThreadPool::WorkerEntry, this, i, cpu);
+  }
+  LOG_DEBUG("[WorkStealingThreadPool] started with %zu workers", thread_num);
+}
+
+WorkStealingThreadPool::~WorkStealingThreadPool()
+{
+  stop_.store(true);
+  {
+    std::lock_guard<std::mutex> lk(park_mtx_);
+    park_cv_.notify_all();
+  }
+  for (auto &worker : workers_)
+  {
+    if (worker->thread.joinable())
+    {
+      worker->thread.join();
+    }
+  }
+}
+
+void WorkStealingThreadPool::Submit(std::function<void()> task)
+{
+  const size_t index = tls_current_pool == this ? tls_current_index
+                                                 : next_worker_.fetch_add(1) % workers_.size();
+  // counted before it is published, or a worker could pop it and take the unsigned counter below
+  // zero. It also pairs with `parked_workers_` increment in `WorkerEntry`, either the worker sees
+  // the pending task or we see the parked worker.
+  pending_tasks_.fetch_add(1);
+  {
+    std::lock_guard<std::mutex> lk(workers_[index]->mtx);
+    workers_[index]->tasks.push_back(std::move(task));
+  }
+  if (parked_workers_.load() > 0)
+  {
+    std::lock_guard<std::mutex> lk(park_mtx_);
+    park_cv_.notify_one();
+  }
+}
+
+bool WorkStealingThreadPool::PopTask(size_t index, std::function<void()> &task)
+{
+  // 1. the latest task of its own
+  {
+    auto                       &worker = *workers_[index];
+    std::lock_guard<std::mutex> lk(worker.mtx);
+    if (!worker.tasks.empty())
+    {
+      task = std::move(worker.tasks.back());
+      worker.tasks.pop_back();
+      pending_tasks_.fetch_sub(1);
+      return true;
+    }
+  }
+
+  // 2. steal the oldest task of the others
+  for (size_t k = 1; k < workers_.size(); ++k)
+  {
+    auto                       &victim = *workers_[(index + k) % workers_.size()];
+    std::lock_guard<std::mutex> lk(victim.mtx);
+    if (!victim.tasks.empty())
+    {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      pending_tasks_.fetch_sub(1);
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingThreadPool::WorkerEntry(size_t index, int cpu)
+{
+  tls_current_pool  = this;
+  tls_current_index = index;
+  if (cpu >= 0)
+  {
+    SetCurrentThreadAffinity({cpu});
+  }
+
+  while (true)
+  {
+    std::function<void()> task;
+    if (PopTask(index, task))
+    {
+      try
+      {
+        task();
+      } catch (const std::exception &e)
+      {
+        LOG_ERROR("[WorkStealingThreadPool] task got exception : %s", e.what());
+      }
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lk(park_mtx_);
+    parked_workers_.fetch_add(1);
+    park_cv_.wait(lk, [this] { return pending_tasks_.load() > 0 || stop_.load(); });
+    parked_workers_.fetch_sub(1);
+    if (stop_.load() && pending_tasks_.load() == 0)
+    {
+      break;
+    }
+  }
+}
+
+std::shared_ptr<IPipelineExecutor> GetDefaultPipelineExecutor()
+{
+  static std::shared_ptr<IPipelineExecutor> executor = std::make_shared<WorkStealingThreadPool>();
+  return executor;
+}
+
+} // namespace easy_deploy
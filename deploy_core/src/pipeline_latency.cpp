@@ -0,0 +1,56 @@
+#include "deploy_core/pipeline_latency.hpp"
+
+#include <algorithm>
+
+namespace easy_deploy {
+
+void PipelineLatencyRecord::Reset(
+    Clock::time_point                                     submit_time,
+    const std::shared_ptr<const std::vector<std::string>> &block_names)
+{
+  submit_time_ = submit_time;
+  block_names_ = block_names;
+  stamp_num_   = block_names == nullptr ? 0 : block_names->size();
+  if (stamp_num_ > stamp_capacity_)
+  {
+    stamps_.reset(new _Stamp[stamp_num_]);
+    stamp_capacity_ = stamp_num_;
+  }
+  for (size_t i = 0; i < stamp_num_; ++i)
+  {
+    stamps_[i].enqueue_ns.store(-1, std::memory_order_relaxed);
+    stamps_[i].begin_ns.store(-1, std::memory_order_relaxed);
+    stamps_[i].end_ns.store(-1, std::memory_order_relaxed);
+  }
+  blocks_.clear();
+  callback_delay_ns_ = 0;
+  total_ns_          = 0;
+}
+
+void PipelineLatencyRecord::Finish(Clock::time_point time)
+{
+  total_ns_ = ToOffset(time);
+
+  int64_t last_end = 0;
+  blocks_.resize(stamp_num_);
+  for (size_t i = 0; i < stamp_num_; ++i)
+  {
+    // `begin_ns` is written before `end_ns`
+    const int64_t end     = stamps_[i].end_ns.load(std::memory_order_acquire);
+    const int64_t begin   = stamps_[i].begin_ns.load(std::memory_order_relaxed);
+    const int64_t enqueue = stamps_[i].enqueue_ns.load(std::memory_order_relaxed);
+
+    auto &block         = blocks_[i];
+    block.name          = (*block_names_)[i];
+    block.reached       = end >= 0;
+    block.queue_wait_ns = block.reached && enqueue >= 0 ? begin - enqueue : 0;
+    block.compute_ns    = block.reached ? end - begin : 0;
+    if (block.reached)
+    {
+      last_end = std::max(last_end, end);
+    }
+  }
+  callback_delay_ns_ = total_ns_ - last_end;
+}
+
+} // namespace easy_deploy
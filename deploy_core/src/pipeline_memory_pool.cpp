@@ -0,0 +1,101 @@
+#include "deploy_core/pipeline_memory_pool.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+
+namespace easy_deploy {
+
+static size_t AlignBlockSize(size_t block_size)
+{
+  constexpr size_t align = alignof(std::max_align_t);
+  block_size             = std::max(block_size, sizeof(void *));
+  return (block_size + align - 1) / align * align;
+}
+
+FixedBlockPool::FixedBlockPool(size_t block_size, size_t slab_block_num)
+    : block_size_(AlignBlockSize(block_size)), slab_block_num_(std::max<size_t>(slab_block_num, 1))
+{
+  auto                       &shard = shards_[GetShardIndex()];
+  std::lock_guard<std::mutex> lk(shard.mtx);
+  auto                        node = static_cast<FreeNode *>(Grow(shard));
+  node->next                       = shard.free_list;
+  shard.free_list                  = node;
+}
+
+FixedBlockPool::~FixedBlockPool() = default;
+
+size_t FixedBlockPool::GetShardIndex() noexcept
+{
+  // threads are assigned to shards in turn
+  static std::atomic<size_t> next_index{0};
+  static thread_local size_t index = next_index.fetch_add(1, std::memory_order_relaxed) % kShardNum;
+  return index;
+}
+
+void *FixedBlockPool::Grow(Shard &shard)
+{
+  // `new[]` of unsigned char is aligned to `__STDCPP_DEFAULT_NEW_ALIGNMENT__`
+  std::unique_ptr<unsigned char[]> slab(new unsigned char[block_size_ * slab_block_num_]);
+  for (size_t i = 1; i < slab_block_num_; ++i)
+  {
+    auto node       = reinterpret_cast<FreeNode *>(slab.get() + i * block_size_);
+    node->next      = shard.free_list;
+    shard.free_list = node;
+  }
+  void *first = slab.get();
+  {
+    std::lock_guard<std::mutex> lk(slab_mtx_);
+    slabs_.push_back(std::move(slab));
+  }
+  heap_allocations_.fetch_add(1, std::memory_order_relaxed);
+  return first;
+}
+
+void *FixedBlockPool::Allocate(size_t size)
+{
+  if (size > block_size_)
+  {
+    heap_allocations_.fetch_add(1, std::memory_order_relaxed);
+    return ::operator new(size);
+  }
+
+  // 1. take from the shard of current thread, then steal from the others
+  const size_t index = GetShardIndex();
+  for (size_t k = 0; k < kShardNum; ++k)
+  {
+    auto                       &shard = shards_[(index + k) % kShardNum];
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    if (shard.free_list != nullptr)
+    {
+      FreeNode *node  = shard.free_list;
+      shard.free_list = node->next;
+      return node;
+    }
+  }
+
+  // 2. all shards are empty, grow the pool
+  auto                       &shard = shards_[index];
+  std::lock_guard<std::mutex> lk(shard.mtx);
+  return Grow(shard);
+}
+
+void FixedBlockPool::Deallocate(void *ptr, size_t size) noexcept
+{
+  if (ptr == nullptr)
+  {
+    return;
+  }
+  if (size > block_size_)
+  {
+    ::operator delete(ptr);
+    return;
+  }
+  auto                       &shard = shards_[GetShardIndex()];
+  std::lock_guard<std::mutex> lk(shard.mtx);
+  auto node       = static_cast<FreeNode *>(ptr);
+  node->next      = shard.free_list;
+  shard.free_list = node;
+}
+
+} // namespace easy_deploy
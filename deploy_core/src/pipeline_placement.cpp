@@ -0,0 +1,91 @@
+#include "deploy_core/pipeline_placement.hpp"
+
+#include <algorithm>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "common_utils/log.hpp"
+
+namespace easy_deploy {
+
+std::vector<int> PipelinePlacementPolicy::GetAutoAssignCpus() const
+{
+  std::vector<int> cpus;
+  for (int cpu : GetAvailableCpus())
+  {
+    if (std::find(reserved_cpus.begin(), reserved_cpus.end(), cpu) == reserved_cpus.end())
+    {
+      cpus.push_back(cpu);
+    }
+  }
+  if (cpus.empty())
+  {
+    LOG_WARN("[PipelinePlacementPolicy] all cpus are reserved, auto assignment is disabled.");
+  }
+  return cpus;
+}
+
+std::vector<int> GetAvailableCpus()
+{
+  std::vector<int> cpus;
+#ifdef __linux__
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0)
+  {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+      if (CPU_ISSET(cpu, &cpu_set))
+      {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+#endif
+  if (cpus.empty())
+  {
+    const int cpu_num = std::max(1u, std::thread::hardware_concurrency());
+    for (int cpu = 0; cpu < cpu_num; ++cpu)
+    {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+bool SetCurrentThreadAffinity(const std::vector<int> &cpus)
+{
+  if (cpus.empty())
+  {
+    return true;
+  }
+#ifdef __linux__
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (int cpu : cpus)
+  {
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+      LOG_ERROR("[PipelinePlacement] Got invalid cpu index : %d", cpu);
+      return false;
+    }
+    CPU_SET(cpu, &cpu_set);
+  }
+  const int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+  if (ret != 0)
+  {
+    LOG_ERROR("[PipelinePlacement] `pthread_setaffinity_np` failed, error code : %d", ret);
+    return false;
+  }
+  return true;
+#else
+  LOG_WARN("[PipelinePlacement] thread affinity is not supported on this platform.");
+  return false;
+#endif
+}
+
+} // namespace easy_deploy
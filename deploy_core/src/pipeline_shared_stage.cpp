@@ -0,0 +1,117 @@
+#include "deploy_core/pipeline_shared_stage.hpp"
+
+#include <algorithm>
+
+#include "common_utils/log.hpp"
+
+namespace easy_deploy {
+
+SharedPipelineStage::SharedPipelineStage(const std::string &name) : name_(name)
+{
+  worker_ = std::thread(&SharedPipelineStage::WorkerEntry, this);
+}
+
+SharedPipelineStage::~SharedPipelineStage()
+{
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (!clients_.empty())
+    {
+      LOG_ERROR("[SharedPipelineStage] {%s} destroyed with %zu clients attached!", name_.c_str(),
+                clients_.size());
+    }
+    stop_ = true;
+  }
+  worker_cv_.notify_all();
+  worker_.join();
+}
+
+void SharedPipelineStage::Attach(ISharedStageClient *client)
+{
+  std::lock_guard<std::mutex> lk(mtx_);
+  clients_.emplace_back(client, false);
+  LOG_DEBUG("[SharedPipelineStage] {%s} attached, %zu clients", name_.c_str(), clients_.size());
+}
+
+void SharedPipelineStage::Detach(ISharedStageClient *client)
+{
+  std::unique_lock<std::mutex> lk(mtx_);
+  auto iter = std::find_if(clients_.begin(), clients_.end(),
+                           [client](const auto &entry) { return entry.first == client; });
+  if (iter != clients_.end())
+  {
+    const size_t index = iter - clients_.begin();
+    clients_.erase(iter);
+    // keep the turn of the client after the removed one
+    if (next_client_ > index)
+    {
+      next_client_--;
+    }
+  }
+  idle_cv_.wait(lk, [this, client] { return running_ != client; });
+}
+
+void SharedPipelineStage::Notify(ISharedStageClient *client)
+{
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    auto iter = std::find_if(clients_.begin(), clients_.end(),
+                             [client](const auto &entry) { return entry.first == client; });
+    if (iter == clients_.end())
+    {
+      return;
+    }
+    iter->second = true;
+  }
+  worker_cv_.notify_one();
+}
+
+size_t SharedPipelineStage::GetClientNum()
+{
+  std::lock_guard<std::mutex> lk(mtx_);
+  return clients_.size();
+}
+
+void SharedPipelineStage::WorkerEntry()
+{
+  std::unique_lock<std::mutex> lk(mtx_);
+  while (true)
+  {
+    // round-robin from the client after the last served one
+    ISharedStageClient *client = nullptr;
+    for (size_t i = 0; i < clients_.size() && client == nullptr; ++i)
+    {
+      auto &entry = clients_[(next_client_ + i) % clients_.size()];
+      if (entry.second)
+      {
+        entry.second = false;
+        client       = entry.first;
+        next_client_ = (next_client_ + i + 1) % clients_.size();
+      }
+    }
+    if (client == nullptr)
+    {
+      if (stop_)
+      {
+        break;
+      }
+      worker_cv_.wait(lk);
+      continue;
+    }
+
+    running_ = client;
+    lk.unlock();
+    try
+    {
+      client->RunOne();
+    } catch (const std::exception &e)
+    {
+      LOG_ERROR("[SharedPipelineStage] {%s} got exception : %s", name_.c_str(), e.what());
+    }
+    lk.lock();
+    running_ = nullptr;
+    idle_cv_.notify_all();
+  }
+}
+
+} // namespace easy_deploy
@@ -0,0 +1,290 @@
+#include "deploy_core/pipeline_trace.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common_utils/log.hpp"
+
+namespace easy_deploy {
+
+namespace {
+
+// `end_ns` of an enqueue record
+constexpr int64_t kEnqueueEvent = -1;
+
+struct TraceEvent {
+  uint64_t package_id;
+  int64_t  begin_ns;
+  int64_t  end_ns;
+  uint32_t name_id;
+};
+
+// written only by its owner thread, `size` publishes the records to the exporter
+struct ThreadTraceBuffer {
+  ThreadTraceBuffer(uint64_t _session, int _tid, size_t _capacity)
+      : session(_session), tid(_tid), capacity(_capacity), events(new TraceEvent[_capacity])
+  {}
+
+  const uint64_t                session;
+  const int                     tid;
+  const size_t                  capacity;
+  std::unique_ptr<TraceEvent[]> events;
+  std::atomic<size_t>           size{0};
+  std::atomic<size_t>           dropped{0};
+};
+
+struct TraceState {
+  std::mutex mtx;
+  // id of the current session, the buffers of the former sessions are not used any more
+  std::atomic<uint64_t>                           session{0};
+  size_t                                          capacity = 0;
+  PipelineTracer::Clock::time_point               epoch;
+  std::vector<std::shared_ptr<ThreadTraceBuffer>> buffers;
+  // block names live across sessions
+  std::vector<std::string>                  names;
+  std::unordered_map<std::string, uint32_t> name_ids;
+  std::atomic<uint64_t>                     package_id{0};
+};
+
+TraceState &GetTraceState()
+{
+  static TraceState state;
+  return state;
+}
+
+thread_local std::shared_ptr<ThreadTraceBuffer> tls_trace_buffer = nullptr;
+
+ThreadTraceBuffer *GetThreadTraceBuffer() noexcept
+{
+  auto          &state   = GetTraceState();
+  const uint64_t session = state.session.load(std::memory_order_acquire);
+  if (tls_trace_buffer != nullptr && tls_trace_buffer->session == session)
+  {
+    return tls_trace_buffer.get();
+  }
+  std::lock_guard<std::mutex> lk(state.mtx);
+  try
+  {
+    const int tid    = static_cast<int>(state.buffers.size()) + 1;
+    tls_trace_buffer = std::make_shared<ThreadTraceBuffer>(state.session.load(), tid,
+                                                           state.capacity);
+    state.buffers.push_back(tls_trace_buffer);
+  } catch (const std::exception &e)
+  {
+    LOG_ERROR("[PipelineTracer] failed to alloc trace buffer : %s", e.what());
+    tls_trace_buffer = nullptr;
+  }
+  return tls_trace_buffer.get();
+}
+
+void AppendEvent(const TraceEvent &event) noexcept
+{
+  auto buffer = GetThreadTraceBuffer();
+  if (buffer == nullptr)
+  {
+    return;
+  }
+  const size_t size = buffer->size.load(std::memory_order_relaxed);
+  if (size == buffer->capacity)
+  {
+    buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  buffer->events[size] = event;
+  buffer->size.store(size + 1, std::memory_order_release);
+}
+
+int64_t ToNanoseconds(PipelineTracer::Clock::time_point time)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+std::string EscapeJson(const std::string &str)
+{
+  std::string ret;
+  for (char c : str)
+  {
+    if (c == '"' || c == '\\')
+    {
+      ret.push_back('\\');
+      ret.push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20)
+    {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      ret += buf;
+    } else
+    {
+      ret.push_back(c);
+    }
+  }
+  return ret;
+}
+
+} // namespace
+
+std::atomic<bool> PipelineTracer::enabled_{false};
+
+void PipelineTracer::Start(size_t events_per_thread)
+{
+  auto                       &state = GetTraceState();
+  std::lock_guard<std::mutex> lk(state.mtx);
+  state.capacity = std::max<size_t>(events_per_thread, 1);
+  state.epoch    = Clock::now();
+  state.buffers.clear();
+  state.session.fetch_add(1, std::memory_order_release);
+  enabled_.store(true);
+  LOG_DEBUG("[PipelineTracer] tracing started, %zu events per thread", state.capacity);
+}
+
+void PipelineTracer::Stop() noexcept
+{
+  enabled_.store(false);
+}
+
+std::string PipelineTracer::ExportChromeTrace()
+{
+  auto                                           &state = GetTraceState();
+  std::vector<std::shared_ptr<ThreadTraceBuffer>> buffers;
+  std::vector<std::string>                        names;
+  int64_t                                         epoch_ns;
+  {
+    std::lock_guard<std::mutex> lk(state.mtx);
+    buffers  = state.buffers;
+    names    = state.names;
+    epoch_ns = ToNanoseconds(state.epoch);
+  }
+
+  // the queue wait lasts from the enqueue to the compute begin of the same package and block
+  std::vector<size_t>                                              sizes;
+  std::map<std::pair<uint32_t, uint64_t>, std::pair<int64_t, int>> enqueue_times;
+  for (const auto &buffer : buffers)
+  {
+    const size_t size = buffer->size.load(std::memory_order_acquire);
+    sizes.push_back(size);
+    for (size_t i = 0; i < size; ++i)
+    {
+      const auto &event = buffer->events[i];
+      if (event.end_ns == kEnqueueEvent)
+      {
+        enqueue_times[{event.name_id, event.package_id}] = {event.begin_ns, buffer->tid};
+      }
+    }
+  }
+
+  std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  json += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"async "
+          "pipelines\"}}";
+  char buf[256];
+  for (size_t b = 0; b < buffers.size(); ++b)
+  {
+    const auto &buffer = buffers[b];
+    snprintf(buf, sizeof(buf),
+             ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":"
+             "\"pipeline thread %d\"}}",
+             buffer->tid, buffer->tid);
+    json += buf;
+
+    for (size_t i = 0; i < sizes[b]; ++i)
+    {
+      const auto &event = buffer->events[i];
+      if (event.end_ns == kEnqueueEvent)
+      {
+        continue;
+      }
+      const std::string name = event.name_id < names.size() ? EscapeJson(names[event.name_id])
+                                                             : std::to_string(event.name_id);
+      const double      begin_us = (event.begin_ns - epoch_ns) / 1e3;
+      snprintf(buf, sizeof(buf),
+               "\",\"cat\":\"compute\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,"
+               "\"tid\":%d,\"args\":{\"package\":%lu}}",
+               begin_us, (event.end_ns - event.begin_ns) / 1e3, buffer->tid,
+               static_cast<unsigned long>(event.package_id));
+      json += ",\n{\"name\":\"" + name + buf;
+
+      auto iter = enqueue_times.find({event.name_id, event.package_id});
+      if (iter == enqueue_times.end())
+      {
+        continue;
+      }
+      // async slices, the package may wait on a queue filled by another thread
+      snprintf(buf, sizeof(buf),
+               "\",\"cat\":\"queue\",\"ph\":\"b\",\"id\":%lu,\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+               static_cast<unsigned long>(event.package_id),
+               (iter->second.first - epoch_ns) / 1e3, iter->second.second);
+      json += ",\n{\"name\":\"wait " + name + buf;
+      snprintf(buf, sizeof(buf),
+               "\",\"cat\":\"queue\",\"ph\":\"e\",\"id\":%lu,\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+               static_cast<unsigned long>(event.package_id), begin_us, iter->second.second);
+      json += ",\n{\"name\":\"wait " + name + buf;
+    }
+  }
+  json += "\n]}\n";
+  return json;
+}
+
+bool PipelineTracer::ExportChromeTrace(const std::string &path)
+{
+  std::ofstream file(path);
+  if (!file.is_open())
+  {
+    LOG_ERROR("[PipelineTracer] failed to open trace file : %s", path.c_str());
+    return false;
+  }
+  file << ExportChromeTrace();
+  return file.good();
+}
+
+size_t PipelineTracer::GetDroppedCount()
+{
+  auto                       &state = GetTraceState();
+  std::lock_guard<std::mutex> lk(state.mtx);
+  size_t                      dropped = 0;
+  for (const auto &buffer : state.buffers)
+  {
+    dropped += buffer->dropped.load(std::memory_order_relaxed);
+  }
+  return dropped;
+}
+
+uint32_t PipelineTracer::RegisterName(const std::string &name)
+{
+  auto                       &state = GetTraceState();
+  std::lock_guard<std::mutex> lk(state.mtx);
+  auto                        iter = state.name_ids.find(name);
+  if (iter != state.name_ids.end())
+  {
+    return iter->second;
+  }
+  const auto id = static_cast<uint32_t>(state.names.size());
+  state.names.push_back(name);
+  state.name_ids.emplace(name, id);
+  return id;
+}
+
+uint64_t PipelineTracer::NewPackageId() noexcept
+{
+  return GetTraceState().package_id.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+void PipelineTracer::RecordEnqueue(uint32_t name_id, uint64_t package_id) noexcept
+{
+  AppendEvent({package_id, ToNanoseconds(Clock::now()), kEnqueueEvent, name_id});
+}
+
+void PipelineTracer::RecordCompute(uint32_t          name_id,
+                                   uint64_t          package_id,
+                                   Clock::time_point begin,
+                                   Clock::time_point end) noexcept
+{
+  AppendEvent({package_id, ToNanoseconds(begin), ToNanoseconds(end), name_id});
+}
+
+} // namespace easy_deploy
@@ -1,19 +1,105 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <optional>
-#include <queue>
+
+#include "common_utils/ring_buffer.hpp"
+#include "common_utils/wait_strategy.hpp"
 
 namespace easy_deploy {
 
+/**
+ * @brief The common interface of blocking queues with shutdown/disable semantics. Used by the
+ * async pipeline to switch the queue implementation between pipeline blocks.
+ */
+template <typename T>
+class IBlockQueue {
+public:
+  /**
+   * @brief Push a obj into the queue. Will block the thread if the queue is full.
+   * Return false if push is disabled.
+   */
+  virtual bool BlockPush(T obj) noexcept = 0;
+
+  /**
+   * @brief Push a obj into the queue if it is not full, never blocks. Return false if the queue is
+   * full or push is disabled, `obj` is left untouched then.
+   */
+  virtual bool TryPush(T &obj) noexcept = 0;
+
+  /**
+   * @brief Remove and return the front element. Will block if empty and not disabled/no more input.
+   * Return std::nullopt if take is disabled, or no more input and queue is empty.
+   */
+  virtual std::optional<T> Take() noexcept = 0;
+
+  /**
+   * @brief Remove and return front element if any; else return std::nullopt.
+   */
+  virtual std::optional<T> TryTake() noexcept = 0;
+
+  /**
+   * @brief Return current queue size.
+   */
+  virtual size_t Size() noexcept = 0;
+
+  /**
+   * @brief Return if queue is empty.
+   */
+  virtual bool Empty() noexcept = 0;
+
+  /**
+   * @brief Disable both push and take. Wake up all threads.
+   */
+  virtual void Disable() noexcept = 0;
+
+  /**
+   * @brief Clear all elements and disable both push/take.
+   */
+  virtual void DisableAndClear() noexcept = 0;
+
+  /**
+   * @brief Set "NoMoreInput", i.e. producers不会再推送, 通知所有消费者。
+   */
+  virtual void SetNoMoreInput() noexcept = 0;
+
+  /**
+   * @brief Get max size.
+   */
+  virtual size_t GetMaxSize() const noexcept = 0;
+
+  /**
+   * @brief Change max size at runtime, at least 1. The elements over the new max size are kept,
+   * the producers block until the queue shrinks below it.
+   */
+  virtual void SetMaxSize(size_t max_size) noexcept = 0;
+
+  /**
+   * @brief Set how the producers and consumers wait. Should be called before the queue is shared
+   * by other threads. Default is `WaitStrategy::Park()` except `SpscQueue`.
+   */
+  virtual void SetWaitStrategy(const WaitStrategy &strategy) noexcept = 0;
+
+  /**
+   * @brief Return how often the waits were resolved in each phase of the wait strategy.
+   */
+  virtual QueueWaitStats GetWaitStats() const noexcept = 0;
+
+  virtual ~IBlockQueue() = default;
+};
+
 /**
  * @brief A thread-safe blocking queue with shutdown/disable semantics.
  */
 template <typename T>
-class BlockQueue {
+class BlockQueue : public IBlockQueue<T> {
 public:
-  explicit BlockQueue(size_t max_size) : max_size_(max_size)
+  explicit BlockQueue(size_t max_size)
+      : max_size_(max_size), q_(std::min<size_t>(max_size, kInitCapacity))
   {}
 
   // 禁拷贝、禁赋值
@@ -27,43 +113,68 @@ public:
   template <typename U>
   bool BlockPush(U &&obj) noexcept;
 
+  /**
+   * @brief Same as the forwarding `BlockPush`, for the callers through `IBlockQueue`.
+   */
+  bool BlockPush(T obj) noexcept override
+  {
+    return BlockPush<T>(std::move(obj));
+  }
+
+  /**
+   * @brief Push a obj into the queue if it is not full. Return false if the queue is full or push
+   * is disabled, `obj` is left untouched then.
+   */
+  bool TryPush(T &obj) noexcept override;
+
   /**
    * @brief Push a obj into the queue. If full, remove oldest and insert.
    * Return false if push is disabled.
+   *
+   * @param evicted if not nullptr, receive the removed oldest element.
    */
   template <typename U>
-  bool CoverPush(U &&obj) noexcept;
+  bool CoverPush(U &&obj, std::optional<T> *evicted = nullptr) noexcept;
 
   /**
    * @brief Remove and return the front element. Will block if empty and not disabled/no more input.
    * Return std::nullopt if take is disabled, or no more input and queue is empty.
    */
-  std::optional<T> Take() noexcept;
+  std::optional<T> Take() noexcept override;
 
   /**
    * @brief Remove and return front element if any; else return std::nullopt.
    */
-  std::optional<T> TryTake() noexcept;
+  std::optional<T> TryTake() noexcept override;
+
+  /**
+   * @brief Remove and return the front element. Will block until `timeout_time` if empty and not
+   * disabled/no more input. Return std::nullopt on timeout, or if take is disabled, or no more
+   * input and queue is empty.
+   */
+  template <typename Clock, typename Duration>
+  std::optional<T> TakeUntil(const std::chrono::time_point<Clock, Duration> &timeout_time) noexcept;
 
   /**
    * @brief Return current queue size.
    */
-  size_t Size() noexcept;
+  size_t Size() noexcept override;
 
   /**
    * @brief Return if queue is empty.
    */
-  bool Empty() noexcept;
+  bool Empty() noexcept override;
 
   /**
    * @brief Disable both push and take. Wake up all threads.
    */
-  void Disable() noexcept;
+  void Disable() noexcept override;
 
   /**
-   * @brief Clear all elements and disable both push/take.
+   * @brief Clear all elements and disable both push/take. The elements are destroyed after the
+   * lock is released, so their destructors may call back into the queue.
    */
-  void DisableAndClear() noexcept;
+  void DisableAndClear() noexcept override;
 
   /**
    * @brief Disable push only. Wake up producers.
@@ -88,30 +199,76 @@ public:
   /**
    * @brief Set "NoMoreInput", i.e. producers不会再推送, 通知所有消费者。
    */
-  void SetNoMoreInput() noexcept;
+  void SetNoMoreInput() noexcept override;
 
   /**
    * @brief Get max size.
    */
-  size_t GetMaxSize() const noexcept
+  size_t GetMaxSize() const noexcept override
+  {
+    return max_size_.load(std::memory_order_relaxed);
+  }
+
+  void SetMaxSize(size_t max_size) noexcept override;
+
+  void SetWaitStrategy(const WaitStrategy &strategy) noexcept override
+  {
+    strategy_ = strategy;
+  }
+
+  QueueWaitStats GetWaitStats() const noexcept override
   {
-    return max_size_;
+    return {consumer_waits_.GetStats(), producer_waits_.GetStats()};
   }
 
-  ~BlockQueue() noexcept
+  ~BlockQueue() noexcept override
   {
     Disable();
   }
 
 private:
-  size_t                  max_size_;
-  std::queue<T>           q_;
+  // the ring buffer grows on demand, so unbounded queues do not reserve memory up front
+  static constexpr size_t kInitCapacity = 64;
+
+  // should be called with `mtx_` locked after `q_` changes
+  void UpdateSize() noexcept
+  {
+    size_.store(q_.size(), std::memory_order_relaxed);
+  }
+
+  // spin before locking as `strategy_` tells
+  void SpinUntilNotFull() noexcept
+  {
+    if (size_.load(std::memory_order_relaxed) >= GetMaxSize())
+    {
+      producer_waits_.SpinUntil(
+          strategy_, [this] { return size_.load(std::memory_order_relaxed) < GetMaxSize(); });
+    }
+  }
+
+  void SpinUntilNotEmpty() noexcept
+  {
+    if (size_.load(std::memory_order_relaxed) == 0)
+    {
+      consumer_waits_.SpinUntil(strategy_,
+                                [this] { return size_.load(std::memory_order_relaxed) > 0; });
+    }
+  }
+
+  std::atomic<size_t>     max_size_;
+  RingBuffer<T>           q_;
   bool                    push_enabled_{true};
   bool                    take_enabled_{true};
   bool                    no_more_input_{false};
   std::mutex              mtx_;
   std::condition_variable cv_producer_;
   std::condition_variable cv_consumer_;
+
+  // mirror of `q_.size()` for spinning without lock
+  std::atomic<size_t> size_{0};
+  WaitStrategy        strategy_;
+  WaitPhaseCounters   consumer_waits_;
+  WaitPhaseCounters   producer_waits_;
 };
 
 // ========== Implementation ==========
@@ -120,25 +277,44 @@ template <typename T>
 template <typename U>
 bool BlockQueue<T>::BlockPush(U &&obj) noexcept
 {
+  SpinUntilNotFull();
   std::unique_lock<std::mutex> lk(mtx_);
-  cv_producer_.wait(lk, [this] { return q_.size() < max_size_ || !push_enabled_; });
+  cv_producer_.wait(lk, [this] { return q_.size() < GetMaxSize() || !push_enabled_; });
   if (!push_enabled_)
     return false;
-  q_.push(std::forward<U>(obj));
+  q_.push_back(std::forward<U>(obj));
+  UpdateSize();
+  cv_consumer_.notify_one();
+  return true;
+}
+
+template <typename T>
+bool BlockQueue<T>::TryPush(T &obj) noexcept
+{
+  std::unique_lock<std::mutex> lk(mtx_);
+  if (!push_enabled_ || q_.size() >= GetMaxSize())
+    return false;
+  q_.push_back(std::move(obj));
+  UpdateSize();
   cv_consumer_.notify_one();
   return true;
 }
 
 template <typename T>
 template <typename U>
-bool BlockQueue<T>::CoverPush(U &&obj) noexcept
+bool BlockQueue<T>::CoverPush(U &&obj, std::optional<T> *evicted) noexcept
 {
   std::unique_lock<std::mutex> lk(mtx_);
   if (!push_enabled_)
     return false;
-  if (q_.size() == max_size_)
-    q_.pop();
-  q_.push(std::forward<U>(obj));
+  if (q_.size() >= GetMaxSize())
+  {
+    if (evicted != nullptr)
+      *evicted = std::move(q_.front());
+    q_.pop_front();
+  }
+  q_.push_back(std::forward<U>(obj));
+  UpdateSize();
   cv_consumer_.notify_one();
   return true;
 }
@@ -146,12 +322,14 @@ bool BlockQueue<T>::CoverPush(U &&obj) noexcept
 template <typename T>
 std::optional<T> BlockQueue<T>::Take() noexcept
 {
+  SpinUntilNotEmpty();
   std::unique_lock<std::mutex> lk(mtx_);
   cv_consumer_.wait(lk, [this] { return !q_.empty() || !take_enabled_ || no_more_input_; });
   if (!take_enabled_ || (no_more_input_ && q_.empty()))
     return std::nullopt;
   T obj = std::move(q_.front());
-  q_.pop();
+  q_.pop_front();
+  UpdateSize();
   cv_producer_.notify_one();
   return obj;
 }
@@ -163,7 +341,26 @@ std::optional<T> BlockQueue<T>::TryTake() noexcept
   if (q_.empty())
     return std::nullopt;
   T obj = std::move(q_.front());
-  q_.pop();
+  q_.pop_front();
+  UpdateSize();
+  cv_producer_.notify_one();
+  return obj;
+}
+
+template <typename T>
+template <typename Clock, typename Duration>
+std::optional<T> BlockQueue<T>::TakeUntil(
+    const std::chrono::time_point<Clock, Duration> &timeout_time) noexcept
+{
+  SpinUntilNotEmpty();
+  std::unique_lock<std::mutex> lk(mtx_);
+  cv_consumer_.wait_until(lk, timeout_time,
+                          [this] { return !q_.empty() || !take_enabled_ || no_more_input_; });
+  if (!take_enabled_ || q_.empty())
+    return std::nullopt;
+  T obj = std::move(q_.front());
+  q_.pop_front();
+  UpdateSize();
   cv_producer_.notify_one();
   return obj;
 }
@@ -196,13 +393,19 @@ void BlockQueue<T>::Disable() noexcept
 template <typename T>
 void BlockQueue<T>::DisableAndClear() noexcept
 {
-  std::lock_guard<std::mutex> lk(mtx_);
-  push_enabled_  = false;
-  take_enabled_  = false;
-  no_more_input_ = true;
-  while (!q_.empty()) q_.pop();
-  cv_producer_.notify_all();
-  cv_consumer_.notify_all();
+  // the elements are destroyed after unlocking, their destructors may call back into the queue,
+  // e.g. a dropped package completing a callback which pushes again
+  RingBuffer<T> cleared(1);
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    push_enabled_  = false;
+    take_enabled_  = false;
+    no_more_input_ = true;
+    q_.swap(cleared);
+    UpdateSize();
+    cv_producer_.notify_all();
+    cv_consumer_.notify_all();
+  }
 }
 
 template <typename T>
@@ -239,6 +442,14 @@ void BlockQueue<T>::EnableTake() noexcept
   cv_consumer_.notify_all();
 }
 
+template <typename T>
+void BlockQueue<T>::SetMaxSize(size_t max_size) noexcept
+{
+  std::lock_guard<std::mutex> lk(mtx_);
+  max_size_.store(std::max<size_t>(max_size, 1), std::memory_order_relaxed);
+  cv_producer_.notify_all();
+}
+
 template <typename T>
 void BlockQueue<T>::SetNoMoreInput() noexcept
 {
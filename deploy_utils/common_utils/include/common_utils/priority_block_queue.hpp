@@ -0,0 +1,401 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "common_utils/block_queue.hpp"
+#include "common_utils/ring_buffer.hpp"
+#include "common_utils/wait_strategy.hpp"
+
+namespace easy_deploy {
+
+/**
+ * @brief A thread-safe blocking queue with multiple priority lanes, lane 0 has the highest
+ * priority. Take always serves the highest priority lane first, except that an element which
+ * waited longer than `aging_time` is served before the higher lanes, so the low priority lanes
+ * never starve. Each lane keeps FIFO order. The queue holds at most `max_size` elements in total,
+ * and a lane leaves one slot free for each higher lane, so the low priority elements can not fill
+ * up the queue in front of the high priority ones.
+ *
+ * @tparam T
+ * @tparam LaneOf functor `size_t(const T &)` which returns the lane of an element. Lanes out of
+ * range go to the last lane.
+ */
+template <typename T, typename LaneOf>
+class PriorityBlockQueue : public IBlockQueue<T> {
+  using Clock = std::chrono::steady_clock;
+
+public:
+  PriorityBlockQueue(size_t max_size, size_t lane_num, Clock::duration aging_time,
+                     LaneOf lane_of = LaneOf())
+      : max_size_(max_size),
+        lane_num_(std::max<size_t>(lane_num, 1)),
+        aging_time_(aging_time),
+        lane_of_(std::move(lane_of)),
+        lanes_(new Lane[lane_num_])
+  {}
+
+  PriorityBlockQueue(const PriorityBlockQueue &)            = delete;
+  PriorityBlockQueue &operator=(const PriorityBlockQueue &) = delete;
+
+  /**
+   * @brief Push a obj into its lane. Will block the thread if the queue is full for the lane.
+   * Return false if push is disabled.
+   */
+  bool BlockPush(T obj) noexcept override;
+
+  /**
+   * @brief Push a obj into its lane if the queue is not full for the lane. Return false if it is
+   * full or push is disabled, `obj` is left untouched then.
+   */
+  bool TryPush(T &obj) noexcept override;
+
+  /**
+   * @brief Push a obj into its lane. If the queue is full for the lane, remove the oldest element
+   * of the lowest priority lane not higher than it and insert. If all the elements are of higher
+   * lanes, `obj` itself is removed instead. Return false if push is disabled.
+   *
+   * @param evicted if not nullptr, receive the removed element.
+   */
+  template <typename U>
+  bool CoverPush(U &&obj, std::optional<T> *evicted = nullptr) noexcept;
+
+  /**
+   * @brief Remove and return the next element to serve. Will block if empty and not disabled/no
+   * more input. Return std::nullopt if take is disabled, or no more input and queue is empty.
+   */
+  std::optional<T> Take() noexcept override;
+
+  /**
+   * @brief Remove and return the next element to serve if any; else return std::nullopt.
+   */
+  std::optional<T> TryTake() noexcept override;
+
+  /**
+   * @brief Same as `Take`, but wait until `timeout_time` at most. Return std::nullopt on timeout.
+   */
+  template <typename TimeoutClock, typename Duration>
+  std::optional<T> TakeUntil(
+      const std::chrono::time_point<TimeoutClock, Duration> &timeout_time) noexcept;
+
+  /**
+   * @brief Remove and return the oldest element of the lowest priority non-empty lane if any;
+   * else return std::nullopt.
+   */
+  std::optional<T> TryTakeLowest() noexcept;
+
+  size_t Size() noexcept override
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return size_;
+  }
+
+  bool Empty() noexcept override
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return size_ == 0;
+  }
+
+  void Disable() noexcept override;
+
+  void DisableAndClear() noexcept override;
+
+  void SetNoMoreInput() noexcept override;
+
+  /**
+   * @brief Get max total size of the lanes.
+   */
+  size_t GetMaxSize() const noexcept override
+  {
+    return max_size_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Change max total size of the lanes at runtime, at least 1.
+   */
+  void SetMaxSize(size_t max_size) noexcept override;
+
+  void SetWaitStrategy(const WaitStrategy &strategy) noexcept override
+  {
+    strategy_ = strategy;
+  }
+
+  QueueWaitStats GetWaitStats() const noexcept override
+  {
+    return {consumer_waits_.GetStats(), producer_waits_.GetStats()};
+  }
+
+  size_t GetLaneNum() const noexcept
+  {
+    return lane_num_;
+  }
+
+  ~PriorityBlockQueue() noexcept override
+  {
+    Disable();
+  }
+
+private:
+  using LaneQueue = RingBuffer<std::pair<T, Clock::time_point>>;
+
+  struct Lane {
+    LaneQueue               q;
+    std::condition_variable cv_producer;
+  };
+
+  size_t GetLane(const T &obj) const noexcept
+  {
+    return std::min<size_t>(lane_of_(obj), lane_num_ - 1);
+  }
+
+  // max total size at which `lane` could still push, one slot is left for each higher lane
+  size_t GetLaneLimit(size_t lane) const noexcept
+  {
+    const size_t max_size = GetMaxSize();
+    return max_size > lane ? max_size - lane : 1;
+  }
+
+  bool IsFull(size_t lane) const noexcept
+  {
+    return size_.load(std::memory_order_relaxed) >= GetLaneLimit(lane);
+  }
+
+  // wake up the producers of the lanes which could push now, should be called with `mtx_` locked
+  void NotifyProducers() noexcept
+  {
+    for (size_t i = 0; i < lane_num_ && !IsFull(i); ++i) lanes_[i].cv_producer.notify_one();
+  }
+
+  // lane of the next element to serve, should be called with `mtx_` locked and `size_` > 0
+  size_t SelectLane() const noexcept;
+
+  // should be called with `mtx_` locked
+  T PopFront(size_t lane) noexcept;
+
+  // spin before locking as `strategy_` tells
+  void SpinUntilNotEmpty() noexcept
+  {
+    if (size_.load(std::memory_order_relaxed) == 0)
+    {
+      consumer_waits_.SpinUntil(strategy_,
+                                [this] { return size_.load(std::memory_order_relaxed) > 0; });
+    }
+  }
+
+  std::atomic<size_t>   max_size_;
+  const size_t          lane_num_;
+  const Clock::duration aging_time_;
+  LaneOf                lane_of_;
+
+  std::unique_ptr<Lane[]> lanes_;
+  // total size, also read without lock for spinning
+  std::atomic<size_t>     size_{0};
+  bool                    push_enabled_{true};
+  bool                    take_enabled_{true};
+  bool                    no_more_input_{false};
+  std::mutex              mtx_;
+  std::condition_variable cv_consumer_;
+
+  WaitStrategy      strategy_;
+  WaitPhaseCounters consumer_waits_;
+  WaitPhaseCounters producer_waits_;
+};
+
+// ========== Implementation ==========
+
+template <typename T, typename LaneOf>
+bool PriorityBlockQueue<T, LaneOf>::BlockPush(T obj) noexcept
+{
+  const size_t lane_index = GetLane(obj);
+  auto        &lane       = lanes_[lane_index];
+  if (IsFull(lane_index))
+  {
+    producer_waits_.SpinUntil(strategy_, [&] { return !IsFull(lane_index); });
+  }
+  std::unique_lock<std::mutex> lk(mtx_);
+  lane.cv_producer.wait(lk, [&] { return !IsFull(lane_index) || !push_enabled_; });
+  if (!push_enabled_)
+    return false;
+  lane.q.push_back({std::move(obj), Clock::now()});
+  ++size_;
+  cv_consumer_.notify_one();
+  return true;
+}
+
+template <typename T, typename LaneOf>
+bool PriorityBlockQueue<T, LaneOf>::TryPush(T &obj) noexcept
+{
+  const size_t                 lane_index = GetLane(obj);
+  std::unique_lock<std::mutex> lk(mtx_);
+  if (!push_enabled_ || IsFull(lane_index))
+    return false;
+  lanes_[lane_index].q.push_back({std::move(obj), Clock::now()});
+  ++size_;
+  cv_consumer_.notify_one();
+  return true;
+}
+
+template <typename T, typename LaneOf>
+template <typename U>
+bool PriorityBlockQueue<T, LaneOf>::CoverPush(U &&obj, std::optional<T> *evicted) noexcept
+{
+  const size_t                 lane_index = GetLane(obj);
+  std::unique_lock<std::mutex> lk(mtx_);
+  if (!push_enabled_)
+    return false;
+  if (IsFull(lane_index))
+  {
+    size_t victim = lane_num_;
+    while (victim > lane_index && lanes_[victim - 1].q.empty()) --victim;
+    if (victim == lane_index)
+    {
+      // only higher lanes hold elements, drop the new one
+      if (evicted != nullptr)
+        *evicted = T(std::forward<U>(obj));
+      return true;
+    }
+    auto &victim_q = lanes_[victim - 1].q;
+    if (evicted != nullptr)
+      *evicted = std::move(victim_q.front().first);
+    victim_q.pop_front();
+    --size_;
+  }
+  lanes_[lane_index].q.push_back({std::forward<U>(obj), Clock::now()});
+  ++size_;
+  cv_consumer_.notify_one();
+  return true;
+}
+
+template <typename T, typename LaneOf>
+std::optional<T> PriorityBlockQueue<T, LaneOf>::Take() noexcept
+{
+  SpinUntilNotEmpty();
+  std::unique_lock<std::mutex> lk(mtx_);
+  cv_consumer_.wait(lk, [this] { return size_ > 0 || !take_enabled_ || no_more_input_; });
+  if (!take_enabled_ || size_ == 0)
+    return std::nullopt;
+  return PopFront(SelectLane());
+}
+
+template <typename T, typename LaneOf>
+std::optional<T> PriorityBlockQueue<T, LaneOf>::TryTake() noexcept
+{
+  std::unique_lock<std::mutex> lk(mtx_);
+  if (size_ == 0)
+    return std::nullopt;
+  return PopFront(SelectLane());
+}
+
+template <typename T, typename LaneOf>
+template <typename TimeoutClock, typename Duration>
+std::optional<T> PriorityBlockQueue<T, LaneOf>::TakeUntil(
+    const std::chrono::time_point<TimeoutClock, Duration> &timeout_time) noexcept
+{
+  SpinUntilNotEmpty();
+  std::unique_lock<std::mutex> lk(mtx_);
+  cv_consumer_.wait_until(lk, timeout_time,
+                          [this] { return size_ > 0 || !take_enabled_ || no_more_input_; });
+  if (!take_enabled_ || size_ == 0)
+    return std::nullopt;
+  return PopFront(SelectLane());
+}
+
+template <typename T, typename LaneOf>
+std::optional<T> PriorityBlockQueue<T, LaneOf>::TryTakeLowest() noexcept
+{
+  std::unique_lock<std::mutex> lk(mtx_);
+  for (size_t i = lane_num_; i > 0; --i)
+  {
+    if (!lanes_[i - 1].q.empty())
+      return PopFront(i - 1);
+  }
+  return std::nullopt;
+}
+
+template <typename T, typename LaneOf>
+size_t PriorityBlockQueue<T, LaneOf>::SelectLane() const noexcept
+{
+  size_t selected = 0;
+  while (lanes_[selected].q.empty()) ++selected;
+
+  // among the lower lanes, the front which waited the longest over `aging_time` goes first
+  auto oldest = Clock::now() - aging_time_;
+  for (size_t i = selected + 1; i < lane_num_; ++i)
+  {
+    if (!lanes_[i].q.empty() && lanes_[i].q.front().second < oldest)
+    {
+      oldest   = lanes_[i].q.front().second;
+      selected = i;
+    }
+  }
+  return selected;
+}
+
+template <typename T, typename LaneOf>
+T PriorityBlockQueue<T, LaneOf>::PopFront(size_t lane) noexcept
+{
+  T obj = std::move(lanes_[lane].q.front().first);
+  lanes_[lane].q.pop_front();
+  --size_;
+  NotifyProducers();
+  return obj;
+}
+
+template <typename T, typename LaneOf>
+void PriorityBlockQueue<T, LaneOf>::Disable() noexcept
+{
+  std::lock_guard<std::mutex> lk(mtx_);
+  push_enabled_  = false;
+  take_enabled_  = false;
+  no_more_input_ = true;
+  for (size_t i = 0; i < lane_num_; ++i) lanes_[i].cv_producer.notify_all();
+  cv_consumer_.notify_all();
+}
+
+template <typename T, typename LaneOf>
+void PriorityBlockQueue<T, LaneOf>::DisableAndClear() noexcept
+{
+  // the elements are destroyed after unlocking, their destructors may call back into the queue,
+  // e.g. a dropped package completing a callback which pushes again
+  std::vector<LaneQueue> cleared;
+  cleared.reserve(lane_num_);
+  for (size_t i = 0; i < lane_num_; ++i) cleared.emplace_back(1);
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    push_enabled_  = false;
+    take_enabled_  = false;
+    no_more_input_ = true;
+    for (size_t i = 0; i < lane_num_; ++i)
+    {
+      lanes_[i].q.swap(cleared[i]);
+      lanes_[i].cv_producer.notify_all();
+    }
+    size_ = 0;
+    cv_consumer_.notify_all();
+  }
+}
+
+template <typename T, typename LaneOf>
+void PriorityBlockQueue<T, LaneOf>::SetMaxSize(size_t max_size) noexcept
+{
+  std::lock_guard<std::mutex> lk(mtx_);
+  max_size_.store(std::max<size_t>(max_size, 1), std::memory_order_relaxed);
+  for (size_t i = 0; i < lane_num_; ++i) lanes_[i].cv_producer.notify_all();
+}
+
+template <typename T, typename LaneOf>
+void PriorityBlockQueue<T, LaneOf>::SetNoMoreInput() noexcept
+{
+  std::lock_guard<std::mutex> lk(mtx_);
+  no_more_input_ = true;
+  cv_consumer_.notify_all();
+}
+
+} // namespace easy_deploy
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace easy_deploy {
+
+/**
+ * @brief A growable double-ended ring buffer, NOT thread-safe.
+ *
+ * Unlike `std::deque`, which allocates and frees a chunk whenever the elements cross a chunk
+ * boundary, the ring buffer only allocates when it grows over its capacity. Once it reaches the
+ * peak size, push and pop never touch the heap.
+ *
+ * @tparam T should be default constructible and movable.
+ */
+template <typename T>
+class RingBuffer {
+public:
+  explicit RingBuffer(size_t init_capacity = 16)
+  {
+    size_t capacity = 1;
+    while (capacity < init_capacity) capacity <<= 1;
+    buffer_.resize(capacity);
+  }
+
+  void push_back(T obj)
+  {
+    if (size_ == buffer_.size())
+      Grow();
+    buffer_[(head_ + size_) & (buffer_.size() - 1)] = std::move(obj);
+    ++size_;
+  }
+
+  T &front()
+  {
+    return buffer_[head_];
+  }
+
+  T &back()
+  {
+    return buffer_[(head_ + size_ - 1) & (buffer_.size() - 1)];
+  }
+
+  /**
+   * @brief Remove the front element. The slot is reset so resources held by it are released.
+   */
+  void pop_front()
+  {
+    buffer_[head_] = T();
+    head_          = (head_ + 1) & (buffer_.size() - 1);
+    --size_;
+  }
+
+  /**
+   * @brief Remove the back element. The slot is reset so resources held by it are released.
+   */
+  void pop_back()
+  {
+    back() = T();
+    --size_;
+  }
+
+  void clear()
+  {
+    while (size_ > 0) pop_front();
+    head_ = 0;
+  }
+
+  size_t size() const noexcept
+  {
+    return size_;
+  }
+
+  bool empty() const noexcept
+  {
+    return size_ == 0;
+  }
+
+  size_t capacity() const noexcept
+  {
+    return buffer_.size();
+  }
+
+  void swap(RingBuffer &other) noexcept
+  {
+    buffer_.swap(other.buffer_);
+    std::swap(head_, other.head_);
+    std::swap(size_, other.size_);
+  }
+
+private:
+  void Grow()
+  {
+    std::vector<T> buffer(buffer_.size() * 2);
+    for (size_t i = 0; i < size_; ++i)
+    {
+      buffer[i] = std::move(buffer_[(head_ + i) & (buffer_.size() - 1)]);
+    }
+    buffer_.swap(buffer);
+    head_ = 0;
+  }
+
+  std::vector<T> buffer_;
+  size_t         head_ = 0;
+  size_t         size_ = 0;
+};
+
+} // namespace easy_deploy
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "common_utils/block_queue.hpp"
+
+namespace easy_deploy {
+
+/**
+ * @brief A bounded lock-free single-producer/single-consumer ring buffer with the same
+ * shutdown/disable semantics as `BlockQueue`.
+ *
+ * Push and take only touch two atomic indices on the fast path. A thread which has to wait
+ * (queue empty for the consumer, queue full for the producer) spins for a while and then parks
+ * on a condition variable. The other side only takes the mutex to notify if a waiter is parked.
+ *
+ * @warning Only ONE thread may push and only ONE thread may take at the same time. Use
+ * `BlockQueue` if there are multiple producers or consumers.
+ */
+template <typename T>
+class SpscQueue : public IBlockQueue<T> {
+public:
+  explicit SpscQueue(size_t max_size)
+      : max_size_(max_size), buffer_(max_size + 1), limit_(max_size)
+  {}
+
+  SpscQueue(const SpscQueue &)            = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+
+  /**
+   * @brief Push a obj into the queue. Will block the thread if the queue is full.
+   * Return false if the queue is disabled.
+   */
+  bool BlockPush(T obj) noexcept override;
+
+  /**
+   * @brief Push a obj into the queue if it is not full. Return false if the queue is full or
+   * disabled, `obj` is left untouched then.
+   */
+  bool TryPush(T &obj) noexcept override;
+
+  /**
+   * @brief Remove and return the front element. Will block if empty and not disabled/no more input.
+   * Return std::nullopt if the queue is disabled, or no more input and queue is empty.
+   */
+  std::optional<T> Take() noexcept override;
+
+  /**
+   * @brief Remove and return front element if any; else return std::nullopt.
+   */
+  std::optional<T> TryTake() noexcept override;
+
+  /**
+   * @brief Return current queue size. It is a snapshot when called by neither the producer nor
+   * the consumer.
+   */
+  size_t Size() noexcept override;
+
+  /**
+   * @brief Return if queue is empty.
+   */
+  bool Empty() noexcept override;
+
+  /**
+   * @brief Disable both push and take. Wake up all threads.
+   */
+  void Disable() noexcept override;
+
+  /**
+   * @brief Disable both push and take, and clear the queue. Only the consumer is allowed to touch
+   * the elements, so they are destroyed by the next `Take` or `TryTake`, which returns
+   * std::nullopt then. Those left without a consumer are destroyed with the queue.
+   */
+  void DisableAndClear() noexcept override;
+
+  /**
+   * @brief Set "NoMoreInput", the consumer will get std::nullopt once the queue is empty.
+   */
+  void SetNoMoreInput() noexcept override;
+
+  /**
+   * @brief Get max size.
+   */
+  size_t GetMaxSize() const noexcept override
+  {
+    return limit_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Change max size at runtime, at least 1. The ring buffer is allocated once, so the max
+   * size could not grow over the one given to the constructor.
+   */
+  void SetMaxSize(size_t max_size) noexcept override;
+
+  void SetWaitStrategy(const WaitStrategy &strategy) noexcept override
+  {
+    strategy_ = strategy;
+  }
+
+  QueueWaitStats GetWaitStats() const noexcept override
+  {
+    return {consumer_waits_.GetStats(), producer_waits_.GetStats()};
+  }
+
+  ~SpscQueue() noexcept override
+  {
+    Disable();
+  }
+
+private:
+  size_t Next(size_t index) const noexcept
+  {
+    return index + 1 == buffer_.size() ? 0 : index + 1;
+  }
+
+  void Notify(std::atomic<bool> &waiting, std::condition_variable &cv) noexcept;
+
+  // destroy the elements from `head` on, should be called by the consumer
+  void Clear(size_t head) noexcept;
+
+  // yield for a while before parking by default, one side usually comes back soon
+  static constexpr int kDefaultYieldCount = 1024;
+
+  const size_t   max_size_;
+  std::vector<T> buffer_;
+  // the max size in use, no more than `max_size_`
+  std::atomic<size_t> limit_;
+
+  // written by consumer
+  alignas(64) std::atomic<size_t> head_{0};
+  // written by producer
+  alignas(64) std::atomic<size_t> tail_{0};
+
+  alignas(64) std::atomic<bool> disabled_{false};
+  std::atomic<bool>       clear_requested_{false};
+  std::atomic<bool>       no_more_input_{false};
+  std::atomic<bool>       producer_waiting_{false};
+  std::atomic<bool>       consumer_waiting_{false};
+  std::mutex              mtx_;
+  std::condition_variable cv_producer_;
+  std::condition_variable cv_consumer_;
+
+  WaitStrategy      strategy_{0, kDefaultYieldCount};
+  WaitPhaseCounters consumer_waits_;
+  WaitPhaseCounters producer_waits_;
+};
+
+// ========== Implementation ==========
+
+template <typename T>
+void SpscQueue<T>::Notify(std::atomic<bool> &waiting, std::condition_variable &cv) noexcept
+{
+  // pairs with the fence after setting `waiting` in the parking side, one of both sides must see
+  // the other one's modification.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiting.load(std::memory_order_relaxed))
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    cv.notify_one();
+  }
+}
+
+template <typename T>
+bool SpscQueue<T>::BlockPush(T obj) noexcept
+{
+  const size_t tail = tail_.load(std::memory_order_relaxed);
+  const size_t next = Next(tail);
+
+  auto is_full = [&]() {
+    const size_t head = head_.load(std::memory_order_acquire);
+    const size_t size = tail >= head ? tail - head : tail + buffer_.size() - head;
+    return next == head || size >= limit_.load(std::memory_order_relaxed);
+  };
+  if (is_full() && !disabled_.load(std::memory_order_relaxed) &&
+      !producer_waits_.SpinUntil(strategy_, [&] { return !is_full() || disabled_.load(); }))
+  {
+    std::unique_lock<std::mutex> lk(mtx_);
+    producer_waiting_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    cv_producer_.wait(lk, [&] { return !is_full() || disabled_.load(); });
+    producer_waiting_.store(false, std::memory_order_relaxed);
+  }
+  if (disabled_.load(std::memory_order_acquire))
+    return false;
+
+  buffer_[tail] = std::move(obj);
+  tail_.store(next, std::memory_order_release);
+  Notify(consumer_waiting_, cv_consumer_);
+  return true;
+}
+
+template <typename T>
+bool SpscQueue<T>::TryPush(T &obj) noexcept
+{
+  const size_t tail = tail_.load(std::memory_order_relaxed);
+  const size_t next = Next(tail);
+  const size_t head = head_.load(std::memory_order_acquire);
+  const size_t size = tail >= head ? tail - head : tail + buffer_.size() - head;
+  if (next == head || size >= limit_.load(std::memory_order_relaxed) ||
+      disabled_.load(std::memory_order_acquire))
+    return false;
+
+  buffer_[tail] = std::move(obj);
+  tail_.store(next, std::memory_order_release);
+  Notify(consumer_waiting_, cv_consumer_);
+  return true;
+}
+
+template <typename T>
+std::optional<T> SpscQueue<T>::Take() noexcept
+{
+  const size_t head = head_.load(std::memory_order_relaxed);
+
+  auto is_empty = [&]() { return head == tail_.load(std::memory_order_acquire); };
+  auto is_over  = [&]() { return disabled_.load() || no_more_input_.load(); };
+  if (is_empty() && !is_over() &&
+      !consumer_waits_.SpinUntil(strategy_, [&] { return !is_empty() || is_over(); }))
+  {
+    std::unique_lock<std::mutex> lk(mtx_);
+    consumer_waiting_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    cv_consumer_.wait(lk, [&] { return !is_empty() || is_over(); });
+    consumer_waiting_.store(false, std::memory_order_relaxed);
+  }
+  if (disabled_.load(std::memory_order_acquire))
+  {
+    Clear(head);
+    return std::nullopt;
+  }
+  if (is_empty())
+    return std::nullopt;
+
+  std::optional<T> obj = std::move(buffer_[head]);
+  buffer_[head]        = T();
+  head_.store(Next(head), std::memory_order_release);
+  Notify(producer_waiting_, cv_producer_);
+  return obj;
+}
+
+template <typename T>
+std::optional<T> SpscQueue<T>::TryTake() noexcept
+{
+  const size_t head = head_.load(std::memory_order_relaxed);
+  if (disabled_.load(std::memory_order_acquire))
+  {
+    Clear(head);
+    return std::nullopt;
+  }
+  if (head == tail_.load(std::memory_order_acquire))
+    return std::nullopt;
+
+  std::optional<T> obj = std::move(buffer_[head]);
+  buffer_[head]        = T();
+  head_.store(Next(head), std::memory_order_release);
+  Notify(producer_waiting_, cv_producer_);
+  return obj;
+}
+
+template <typename T>
+size_t SpscQueue<T>::Size() noexcept
+{
+  const size_t head = head_.load(std::memory_order_acquire);
+  const size_t tail = tail_.load(std::memory_order_acquire);
+  return tail >= head ? tail - head : tail + buffer_.size() - head;
+}
+
+template <typename T>
+bool SpscQueue<T>::Empty() noexcept
+{
+  return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+}
+
+template <typename T>
+void SpscQueue<T>::Disable() noexcept
+{
+  disabled_.store(true);
+  no_more_input_.store(true);
+  std::lock_guard<std::mutex> lk(mtx_);
+  cv_producer_.notify_all();
+  cv_consumer_.notify_all();
+}
+
+template <typename T>
+void SpscQueue<T>::DisableAndClear() noexcept
+{
+  clear_requested_.store(true);
+  Disable();
+}
+
+template <typename T>
+void SpscQueue<T>::Clear(size_t head) noexcept
+{
+  if (!clear_requested_.load(std::memory_order_acquire))
+    return;
+  const size_t tail = tail_.load(std::memory_order_acquire);
+  for (; head != tail; head = Next(head))
+  {
+    buffer_[head] = T();
+  }
+  head_.store(tail, std::memory_order_release);
+}
+
+template <typename T>
+void SpscQueue<T>::SetMaxSize(size_t max_size) noexcept
+{
+  limit_.store(std::clamp<size_t>(max_size, 1, max_size_));
+  std::lock_guard<std::mutex> lk(mtx_);
+  cv_producer_.notify_all();
+}
+
+template <typename T>
+void SpscQueue<T>::SetNoMoreInput() noexcept
+{
+  no_more_input_.store(true);
+  std::lock_guard<std::mutex> lk(mtx_);
+  cv_consumer_.notify_all();
+}
+
+} // namespace easy_deploy
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+namespace easy_deploy {
+
+/**
+ * @brief Hint the cpu that the thread is spinning, e.g. `pause` on x86.
+ */
+inline void CpuRelax() noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  asm volatile("yield" ::: "memory");
+#endif
+}
+
+/**
+ * @brief How a blocking queue waits when it is empty for the consumer or full for the producer.
+ * The waiting thread spins `spin_count` times with a pause instruction, then yields `yield_count`
+ * times, and parks on the condition variable at last. Spinning saves the futex sleep and wake up
+ * latency when the other side comes back within microseconds, at the cost of a busy core. It only
+ * pays off when the waiting threads have cores of their own, on an oversubscribed cpu the spinning
+ * threads delay the ones they wait for.
+ */
+struct WaitStrategy {
+  int spin_count  = 0;
+  int yield_count = 0;
+
+  /**
+   * @brief Park at once, the lowest cpu usage.
+   */
+  static WaitStrategy Park() noexcept
+  {
+    return {0, 0};
+  }
+
+  /**
+   * @brief Spin for a few microseconds, yield for a while, then park.
+   */
+  static WaitStrategy Hybrid() noexcept
+  {
+    return {2048, 64};
+  }
+};
+
+/**
+ * @brief Number of waits resolved in each phase of `WaitStrategy`. The waits which did not have
+ * to wait at all are not counted.
+ */
+struct WaitPhaseStats {
+  uint64_t spin  = 0;
+  uint64_t yield = 0;
+  uint64_t park  = 0;
+};
+
+/**
+ * @brief Wait statistics of a blocking queue, the consumers wait on an empty queue and the
+ * producers wait on a full one.
+ */
+struct QueueWaitStats {
+  WaitPhaseStats consumer;
+  WaitPhaseStats producer;
+};
+
+/**
+ * @brief Counters of `WaitPhaseStats` updated by the waiting threads.
+ */
+class WaitPhaseCounters {
+public:
+  /**
+   * @brief Spin and yield until `ready` returns true as `strategy` tells. Return false if the
+   * caller should park, which is counted as a parked wait.
+   *
+   * @tparam Ready functor `bool()`, checked without lock.
+   */
+  template <typename Ready>
+  bool SpinUntil(const WaitStrategy &strategy, Ready &&ready) noexcept
+  {
+    for (int i = 0; i < strategy.spin_count; ++i)
+    {
+      if (ready())
+      {
+        spin_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+      CpuRelax();
+    }
+    for (int i = 0; i < strategy.yield_count; ++i)
+    {
+      if (ready())
+      {
+        yield_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+      std::this_thread::yield();
+    }
+    park_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  WaitPhaseStats GetStats() const noexcept
+  {
+    WaitPhaseStats stats;
+    stats.spin  = spin_.load(std::memory_order_relaxed);
+    stats.yield = yield_.load(std::memory_order_relaxed);
+    stats.park  = park_.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+private:
+  std::atomic<uint64_t> spin_{0};
+  std::atomic<uint64_t> yield_{0};
+  std::atomic<uint64_t> park_{0};
+};
+
+} // namespace easy_deploy
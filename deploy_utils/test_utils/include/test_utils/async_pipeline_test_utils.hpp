@@ -0,0 +1,53 @@
+#pragma once
+
+#include "deploy_core/async_pipeline.hpp"
+
+namespace easy_deploy {
+
+void test_async_pipeline_async_correctness(const AsyncPipelineConfig &config);
+
+void test_async_pipeline_cover_oldest(const AsyncPipelineConfig &config);
+
+void test_async_pipeline_deadline(const AsyncPipelineConfig &config);
+
+void test_async_pipeline_allocation(const AsyncPipelineConfig &config);
+
+void test_async_pipeline_concurrent_producers(const AsyncPipelineConfig &config);
+
+void test_async_pipeline_priority(const AsyncPipelineConfig &config);
+
+void test_async_pipeline_compile(const AsyncPipelineConfig &config);
+
+void test_async_pipeline_reconfigure(const AsyncPipelineConfig &config);
+
+void test_async_pipeline_completion(const AsyncPipelineConfig &config);
+
+void test_async_completion_queue_correctness();
+
+void test_async_pipeline_dag(const AsyncPipelineConfig &config);
+
+void test_pipeline_trace(const AsyncPipelineConfig &config);
+
+void test_async_pipeline_adaptive_depth(const AsyncPipelineConfig &config);
+
+void test_async_pipeline_wait_stats(const AsyncPipelineConfig &config);
+
+void test_async_pipeline_failure(const AsyncPipelineConfig &config);
+
+void test_async_pipeline_bottleneck(const AsyncPipelineConfig &config);
+
+void test_async_pipeline_cancel(const AsyncPipelineConfig &config);
+
+void test_async_pipeline_shared_stage(const AsyncPipelineConfig &config);
+
+void test_async_pipeline_latency_record(const AsyncPipelineConfig &config);
+
+void test_async_pipeline_admission(const AsyncPipelineConfig &config);
+
+void test_pipeline_executor_correctness();
+
+void test_pipeline_placement();
+
+void test_static_pipeline_correctness();
+
+} // namespace easy_deploy
@@ -0,0 +1,19 @@
+#pragma once
+
+namespace easy_deploy {
+
+void test_spsc_queue_correctness();
+
+void test_ring_buffer_correctness();
+
+void test_priority_block_queue_correctness();
+
+void test_block_queue_resize();
+
+void test_block_queue_push_forwarding();
+
+void test_block_queue_wait_strategy();
+
+void test_block_queue_reentrant_clear();
+
+} // namespace easy_deploy
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "deploy_core/base_infer_core.hpp"
+
+namespace easy_deploy {
+
+void test_infer_core_dynamic_batching(const AsyncPipelineConfig &config);
+
+void test_infer_core_place_buffer_pool();
+
+void test_infer_core_shared_inference_stage(const AsyncPipelineConfig &config);
+
+} // namespace easy_deploy
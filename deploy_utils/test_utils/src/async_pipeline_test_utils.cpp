@@ -0,0 +1,1744 @@
+#include "test_utils/async_pipeline_test_utils.hpp"
+
+#include "deploy_core/static_pipeline.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <gtest/gtest.h>
+
+namespace easy_deploy {
+
+namespace {
+
+constexpr int kRequestNum = 256;
+
+// max time waiting for the results of one check
+constexpr std::chrono::seconds kWaitTimeout{10};
+
+// wait until `pred` is true, return false on timeout
+bool WaitFor(const std::function<bool()> &pred)
+{
+  const auto timeout = std::chrono::steady_clock::now() + kWaitTimeout;
+  while (!pred())
+  {
+    if (std::chrono::steady_clock::now() > timeout)
+    {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  return true;
+}
+
+// number of the branches in DAG pipelines
+constexpr int kBranchNum = 10;
+
+struct ToyPipelinePackage : public IPipelinePackage {
+  int value = 0;
+  // written by the branches of DAG pipelines, one slot each
+  int branch_values[kBranchNum] = {};
+
+  BlobsTensor *GetInferBuffer() override
+  {
+    return nullptr;
+  }
+};
+
+using ToyParsingType = std::shared_ptr<IPipelinePackage>;
+
+class ToyGenResultType {
+public:
+  int operator()(const ToyParsingType &package)
+  {
+    return std::static_pointer_cast<ToyPipelinePackage>(package)->value;
+  }
+};
+
+/**
+ * @brief Pipelines of toy blocks on integers, configured by the tests.
+ *
+ */
+class ToyAsyncPipeline : public BaseAsyncPipeline<int, ToyGenResultType> {
+public:
+  using BaseAsyncPipeline::BuildPipelineBlock;
+  using BaseAsyncPipeline::ConfigPipeline;
+
+  template <typename... Args>
+  auto Push(const std::string &pipeline_name, int value, Args &&...args)
+  {
+    auto package   = std::make_shared<ToyPipelinePackage>();
+    package->value = value;
+    return PushPipeline(pipeline_name, package, std::forward<Args>(args)...);
+  }
+};
+
+ToyPipelinePackage *Cast(const ToyParsingType &unit)
+{
+  return static_cast<ToyPipelinePackage *>(unit.get());
+}
+
+bool AddOne(ToyParsingType unit)
+{
+  Cast(unit)->value += 1;
+  return true;
+}
+
+// the replicated workers finish the packages out of order
+bool AddOneWithJitter(ToyParsingType unit)
+{
+  std::this_thread::sleep_for(std::chrono::microseconds(Cast(unit)->value % 4 * 50));
+  return AddOne(unit);
+}
+
+bool Twice(ToyParsingType unit)
+{
+  Cast(unit)->value *= 2;
+  return true;
+}
+
+/**
+ * @brief Records the values going through a block, which runs on one thread at a time.
+ *
+ */
+class ToyRecorder {
+public:
+  bool operator()(const ToyParsingType &unit)
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    values_.push_back(Cast(unit)->value);
+    return true;
+  }
+
+  std::vector<int> GetValues()
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return values_;
+  }
+
+private:
+  std::mutex       mtx_;
+  std::vector<int> values_;
+};
+
+/**
+ * @brief Holds the packages in a block until it is opened.
+ *
+ */
+class ToyGate {
+public:
+  bool operator()(const ToyParsingType &)
+  {
+    std::unique_lock<std::mutex> lk(mtx_);
+    ++arrived_;
+    cv_.notify_all();
+    cv_.wait(lk, [this] { return open_; });
+    return true;
+  }
+
+  bool WaitArrived(int arrived)
+  {
+    std::unique_lock<std::mutex> lk(mtx_);
+    return cv_.wait_for(lk, kWaitTimeout, [&] { return arrived_ >= arrived; });
+  }
+
+  void Open()
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    open_ = true;
+    cv_.notify_all();
+  }
+
+private:
+  std::mutex              mtx_;
+  std::condition_variable cv_;
+  int                     arrived_ = 0;
+  bool                    open_    = false;
+};
+
+// number of non-overlapping occurrences of `pattern` in `text`
+size_t CountOf(const std::string &text, const std::string &pattern)
+{
+  size_t count = 0;
+  for (size_t pos = text.find(pattern); pos != std::string::npos;
+       pos        = text.find(pattern, pos + pattern.size()))
+  {
+    ++count;
+  }
+  return count;
+}
+
+PackageStatus GetFutureStatus(std::future<int> &future)
+{
+  try
+  {
+    future.get();
+  } catch (const AsyncPipelineException &e)
+  {
+    return e.GetStatus();
+  }
+  return PackageStatus::SUCCESS;
+}
+
+} // namespace
+
+void test_async_pipeline_async_correctness(const AsyncPipelineConfig &config)
+{
+  ToyAsyncPipeline pipeline;
+  ToyRecorder      recorder;
+  ToyRecorder      unordered_recorder;
+  pipeline.ConfigPipeline(
+      "linear", {pipeline.BuildPipelineBlock(AddOneWithJitter, "AddOne", 4, true),
+                 pipeline.BuildPipelineBlock(Twice, "Twice"),
+                 pipeline.BuildPipelineBlock(std::ref(recorder), "Recorder")});
+  pipeline.ConfigPipeline(
+      "unordered", {pipeline.BuildPipelineBlock(AddOneWithJitter, "AddOne", 4, false),
+                    pipeline.BuildPipelineBlock(std::ref(unordered_recorder), "Recorder")});
+  pipeline.InitPipeline(config);
+
+  std::vector<std::future<int>> futures;
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    futures.push_back(pipeline.Push("linear", i));
+  }
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    ASSERT_TRUE(futures[i].valid()) << "Got invalid future from async pipeline";
+    EXPECT_EQ(futures[i].get(), (i + 1) * 2) << "Got unexpected result from async pipeline";
+  }
+
+  // the packages go through the blocks in the order they are pushed, even the replicated ones
+  const auto values = recorder.GetValues();
+  ASSERT_EQ(values.size(), static_cast<size_t>(kRequestNum));
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    EXPECT_EQ(values[i], (i + 1) * 2) << "Got package out of order at " << i;
+  }
+
+  // the replicated workers of an unordered block do not lose any package
+  futures.clear();
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    futures.push_back(pipeline.Push("unordered", i));
+  }
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    ASSERT_TRUE(futures[i].valid()) << "Got invalid future from async pipeline";
+    EXPECT_EQ(futures[i].get(), i + 1) << "Got unexpected result from async pipeline";
+  }
+  auto unordered_values = unordered_recorder.GetValues();
+  std::sort(unordered_values.begin(), unordered_values.end());
+  ASSERT_EQ(unordered_values.size(), static_cast<size_t>(kRequestNum));
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    EXPECT_EQ(unordered_values[i], i + 1);
+  }
+
+  pipeline.ClosePipeline();
+}
+
+void test_pipeline_executor_correctness()
+{
+  constexpr int    kTaskNum = 10000;
+  std::atomic<int> done{0};
+  auto             count = [&] { done.fetch_add(1); };
+
+  WorkStealingThreadPool pool(4);
+  EXPECT_EQ(pool.GetThreadNum(), 4u);
+
+  // 1. the tasks submitted from outside, and by the tasks into the deques of their workers
+  for (int i = 0; i < kTaskNum; ++i)
+  {
+    pool.Submit([&] { pool.Submit(count); });
+  }
+  ASSERT_TRUE(WaitFor([&] { return done.load() == kTaskNum; }))
+      << "Timeout waiting for executor tasks, done : " << done.load();
+
+  // 2. the tasks in the deque of a busy worker are stolen by the idle ones
+  constexpr int kSubTaskNum = 8;
+  std::atomic<bool> stolen{false};
+  done.store(0);
+  pool.Submit([&] {
+    for (int i = 0; i < kSubTaskNum; ++i)
+    {
+      pool.Submit(count);
+    }
+    stolen.store(WaitFor([&] { return done.load() == kSubTaskNum; }));
+  });
+  ASSERT_TRUE(WaitFor([&] { return stolen.load(); })) << "Tasks of a busy worker are not stolen";
+
+  // 3. a task throwing exception does not kill its worker
+  done.store(0);
+  for (size_t i = 0; i < pool.GetThreadNum(); ++i)
+  {
+    pool.Submit([] { throw std::runtime_error("toy exception"); });
+  }
+  for (int i = 0; i < kTaskNum; ++i)
+  {
+    pool.Submit(count);
+  }
+  ASSERT_TRUE(WaitFor([&] { return done.load() == kTaskNum; }))
+      << "Timeout waiting for executor tasks, done : " << done.load();
+
+  // 4. the pending tasks are finished before the pool is destroyed
+  done.store(0);
+  {
+    WorkStealingThreadPool short_lived_pool(2);
+    for (int i = 0; i < kTaskNum; ++i)
+    {
+      short_lived_pool.Submit(count);
+    }
+  }
+  EXPECT_EQ(done.load(), kTaskNum);
+}
+
+void test_async_pipeline_cover_oldest(const AsyncPipelineConfig &config)
+{
+  ToyGate          gate;
+  ToyAsyncPipeline pipeline;
+  pipeline.ConfigPipeline("gated", {pipeline.BuildPipelineBlock(std::ref(gate), "Gate"),
+                                    pipeline.BuildPipelineBlock(Twice, "Twice")});
+  pipeline.InitPipeline(config);
+
+  // the gate holds the first package, the others wait in the input queue
+  auto held = pipeline.Push("gated", 0);
+  ASSERT_TRUE(gate.WaitArrived(1)) << "Timeout waiting for the gate";
+
+  // 1. drop the oldest pending package on demand
+  auto oldest = pipeline.Push("gated", 1);
+  EXPECT_TRUE(pipeline.DropOldestPackage("gated"));
+  EXPECT_EQ(GetFutureStatus(oldest), PackageStatus::DROPPED);
+
+  // 2. pushes with `cover_oldest` never block on the full pipeline, the newest ones win
+  const int                     push_num = config.bq_max_size + 8;
+  std::vector<std::future<int>> futures;
+  std::atomic<bool>             pushed{false};
+  std::thread                   pusher([&] {
+    for (int i = 0; i < push_num; ++i)
+    {
+      futures.push_back(pipeline.Push("gated", 2 + i, true));
+    }
+    pushed.store(true);
+  });
+  const bool blocked = !WaitFor([&] { return pushed.load(); });
+  gate.Open();
+  pusher.join();
+  ASSERT_FALSE(blocked) << "Push with cover_oldest blocked on the full pipeline";
+
+  EXPECT_EQ(held.get(), 0);
+  int dropped = 0;
+  for (int i = 0; i < push_num; ++i)
+  {
+    const auto status = GetFutureStatus(futures[i]);
+    if (status == PackageStatus::DROPPED)
+    {
+      EXPECT_EQ(dropped, i) << "A newer package is dropped before an older one";
+      ++dropped;
+    } else
+    {
+      EXPECT_EQ(status, PackageStatus::SUCCESS);
+    }
+  }
+  EXPECT_GT(dropped, 0);
+  EXPECT_LT(dropped, push_num) << "The newest package is dropped";
+
+  // 3. nothing to drop in an idle pipeline
+  EXPECT_FALSE(pipeline.DropOldestPackage("gated"));
+  pipeline.ClosePipeline();
+}
+
+void test_async_pipeline_deadline(const AsyncPipelineConfig &config)
+{
+  ToyGate          gate;
+  ToyAsyncPipeline pipeline;
+  pipeline.ConfigPipeline("gated", {pipeline.BuildPipelineBlock(std::ref(gate), "Gate"),
+                                    pipeline.BuildPipelineBlock(Twice, "Twice")});
+  pipeline.InitPipeline(config);
+
+  // 1. an expired package is not processed
+  auto expired = pipeline.Push("gated", 1, false, PipelineClock::now() - std::chrono::seconds(1));
+  EXPECT_EQ(GetFutureStatus(expired), PackageStatus::TIMEOUT);
+
+  // 2. a package expires while waiting behind the gate, the one with enough time goes through
+  auto held = pipeline.Push("gated", 0);
+  EXPECT_TRUE(gate.WaitArrived(1)) << "Timeout waiting for the gate";
+  auto timeout = pipeline.Push("gated", 2, false,
+                               PipelineClock::now() + std::chrono::milliseconds(20));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  gate.Open();
+  EXPECT_EQ(held.get(), 0);
+  EXPECT_EQ(GetFutureStatus(timeout), PackageStatus::TIMEOUT);
+
+  auto in_time = pipeline.Push("gated", 3, false, PipelineClock::now() + std::chrono::seconds(60));
+  EXPECT_EQ(in_time.get(), 6);
+  pipeline.ClosePipeline();
+}
+
+void test_async_pipeline_allocation(const AsyncPipelineConfig &config)
+{
+  // 1. the pool reuses the released blocks, and grows by a slab when exhausted
+  {
+    FixedBlockPool pool(sizeof(int), 2);
+    EXPECT_EQ(pool.GetHeapAllocationCount(), 1u);
+    int *a = pool.New<int>(1);
+    int *b = pool.New<int>(2);
+    pool.Delete(a);
+    int *c = pool.New<int>(3);
+    EXPECT_EQ(c, a);
+    EXPECT_EQ(pool.GetHeapAllocationCount(), 1u);
+    int *d = pool.New<int>(4);
+    EXPECT_EQ(pool.GetHeapAllocationCount(), 2u);
+    EXPECT_EQ(*b + *c + *d, 9);
+    pool.Delete(b);
+    pool.Delete(c);
+    pool.Delete(d);
+  }
+
+  // 2. the request path does not allocate in steady state
+  ToyAsyncPipeline pipeline;
+  pipeline.ConfigPipeline("linear", {pipeline.BuildPipelineBlock(AddOne, "AddOne"),
+                                     pipeline.BuildPipelineBlock(Twice, "Twice")});
+  pipeline.InitPipeline(config);
+
+  // the requests go in windows, so the number in flight is bounded as in a soak test
+  constexpr int kWindowSize = 16;
+  auto          run_windows = [&](int window_num) {
+    for (int w = 0; w < window_num; ++w)
+    {
+      std::vector<std::future<int>> futures;
+      futures.reserve(kWindowSize);
+      for (int i = 0; i < kWindowSize; ++i)
+      {
+        futures.push_back(pipeline.Push("linear", i));
+      }
+      for (int i = 0; i < kWindowSize; ++i)
+      {
+        EXPECT_EQ(futures[i].get(), (i + 1) * 2);
+      }
+    }
+  };
+
+  // warm up to the peak number of requests in flight
+  run_windows(4);
+  const auto warm_stats = pipeline.GetAllocationStats();
+  EXPECT_EQ(warm_stats.request_count, static_cast<size_t>(4 * kWindowSize));
+
+  run_windows(kRequestNum);
+  const auto stats = pipeline.GetAllocationStats();
+  EXPECT_EQ(stats.request_count, static_cast<size_t>((4 + kRequestNum) * kWindowSize));
+  EXPECT_EQ(stats.heap_allocations, warm_stats.heap_allocations)
+      << "The request path allocates in steady state";
+  pipeline.ClosePipeline();
+}
+
+void test_async_pipeline_concurrent_producers(const AsyncPipelineConfig &config)
+{
+  constexpr int    kProducerNum = 4;
+  ToyAsyncPipeline pipeline;
+  ToyRecorder      recorder;
+  pipeline.ConfigPipeline("linear", {pipeline.BuildPipelineBlock(AddOne, "AddOne"),
+                                     pipeline.BuildPipelineBlock(std::ref(recorder), "Recorder")});
+  pipeline.InitPipeline(config);
+
+  // the producers push into one pipeline without any external lock
+  std::vector<std::thread> producers;
+  std::atomic<int>         failed{0};
+  for (int p = 0; p < kProducerNum; ++p)
+  {
+    producers.emplace_back([&, p] {
+      std::vector<std::future<int>> futures;
+      for (int i = 0; i < kRequestNum; ++i)
+      {
+        futures.push_back(pipeline.Push("linear", p * kRequestNum + i));
+      }
+      for (int i = 0; i < kRequestNum; ++i)
+      {
+        if (!futures[i].valid() || futures[i].get() != p * kRequestNum + i + 1)
+        {
+          failed.fetch_add(1);
+        }
+      }
+    });
+  }
+  for (auto &producer : producers)
+  {
+    producer.join();
+  }
+  EXPECT_EQ(failed.load(), 0) << "Got unexpected result from concurrent producers";
+  EXPECT_EQ(pipeline.GetAllocationStats().request_count,
+            static_cast<size_t>(kProducerNum * kRequestNum));
+
+  // every package goes through once, in the order its producer pushed it
+  const auto       values = recorder.GetValues();
+  std::vector<int> last(kProducerNum, 0);
+  ASSERT_EQ(values.size(), static_cast<size_t>(kProducerNum * kRequestNum));
+  for (int value : values)
+  {
+    const int p = (value - 1) / kRequestNum;
+    ASSERT_TRUE(p >= 0 && p < kProducerNum) << "Got unexpected value " << value;
+    EXPECT_LT(last[p], value) << "Got package out of order from producer " << p;
+    last[p] = value;
+  }
+  pipeline.ClosePipeline();
+}
+
+void test_async_pipeline_priority(const AsyncPipelineConfig &config)
+{
+  // the waiting requests should not age during the check
+  AsyncPipelineConfig priority_config = config;
+  priority_config.bq_max_size         = std::max(config.bq_max_size, 4);
+  priority_config.priority_aging_ms   = 60000;
+
+  ToyGate          gate;
+  ToyRecorder      recorder;
+  ToyAsyncPipeline pipeline;
+  pipeline.ConfigPipeline("gated", {pipeline.BuildPipelineBlock(std::ref(gate), "Gate"),
+                                    pipeline.BuildPipelineBlock(Twice, "Twice"),
+                                    pipeline.BuildPipelineBlock(std::ref(recorder), "Recorder")});
+  pipeline.InitPipeline(priority_config);
+
+  // the high priority request pushed behind the low priority one is served first
+  auto held = pipeline.Push("gated", 0);
+  EXPECT_TRUE(gate.WaitArrived(1)) << "Timeout waiting for the gate";
+  auto low  = pipeline.Push("gated", 1, false, kPipelineNoDeadline, PRIORITY_LOW);
+  auto high = pipeline.Push("gated", 2, false, kPipelineNoDeadline, PRIORITY_HIGH);
+  gate.Open();
+  EXPECT_EQ(held.get(), 0);
+  EXPECT_EQ(low.get(), 2);
+  EXPECT_EQ(high.get(), 4);
+
+  // the held request may be overtaken by the high priority one in the next block
+  const auto values = recorder.GetValues();
+  ASSERT_EQ(values.size(), 3u);
+  const auto low_iter  = std::find(values.begin(), values.end(), 2);
+  const auto high_iter = std::find(values.begin(), values.end(), 4);
+  EXPECT_LT(high_iter, low_iter) << "High priority request is not served first";
+  pipeline.ClosePipeline();
+}
+
+void test_async_pipeline_compile(const AsyncPipelineConfig &config)
+{
+  std::mutex                               mtx;
+  std::unordered_map<int, std::thread::id> add_threads;
+  std::unordered_map<int, std::thread::id> twice_threads;
+  std::atomic<int>                         trivial_count{0};
+  std::atomic<int>                         fused_count{0};
+
+  // record the thread running the block on the package pushed with `key`
+  auto record = [&](std::unordered_map<int, std::thread::id> &threads, int key) {
+    std::lock_guard<std::mutex> lk(mtx);
+    threads[key] = std::this_thread::get_id();
+  };
+  // odd values fail in the first block
+  auto add_one = [&](ToyParsingType unit) -> bool {
+    if (Cast(unit)->value % 2 == 1)
+    {
+      return false;
+    }
+    record(add_threads, Cast(unit)->value);
+    return AddOne(unit);
+  };
+  auto trivial = [&](ToyParsingType) -> bool {
+    trivial_count.fetch_add(1);
+    return true;
+  };
+  auto twice = [&](ToyParsingType unit) -> bool {
+    fused_count.fetch_add(1);
+    record(twice_threads, Cast(unit)->value - 1);
+    return Twice(unit);
+  };
+
+  ToyAsyncPipeline pipeline;
+  auto             trivial_block = pipeline.BuildPipelineBlock(trivial, "Trivial");
+  auto             fusible_block = pipeline.BuildPipelineBlock(twice, "Twice");
+  trivial_block.SetTrivial();
+  fusible_block.SetFusible();
+  pipeline.ConfigPipeline("compiled",
+                          {trivial_block, pipeline.BuildPipelineBlock(add_one, "AddOne"),
+                           fusible_block, trivial_block});
+  pipeline.InitPipeline(config);
+
+  std::vector<std::future<int>> futures;
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    futures.push_back(pipeline.Push("compiled", i));
+  }
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    if (i % 2 == 1)
+    {
+      EXPECT_EQ(GetFutureStatus(futures[i]), PackageStatus::FAILED);
+    } else
+    {
+      EXPECT_EQ(futures[i].get(), (i + 1) * 2) << "Got unexpected result from compiled pipeline";
+    }
+  }
+  // 1. the fused block is skipped once the block it is fused into fails
+  EXPECT_EQ(fused_count.load(), kRequestNum / 2);
+
+  // 2. the trivial blocks are removed
+  EXPECT_EQ(trivial_count.load(), 0) << "Trivial block is not removed";
+
+  // 3. the fused block runs right after the previous block on the same thread
+  std::lock_guard<std::mutex> lk(mtx);
+  for (int i = 0; i < kRequestNum; i += 2)
+  {
+    EXPECT_EQ(add_threads[i], twice_threads[i]) << "Fusible block is not fused";
+  }
+  pipeline.ClosePipeline();
+}
+
+void test_pipeline_placement()
+{
+  const auto available_cpus = GetAvailableCpus();
+  ASSERT_FALSE(available_cpus.empty());
+  const int cpu = available_cpus.front();
+
+  // 1. the reserved cpus are left out of auto assignment
+  PipelinePlacementPolicy policy;
+  policy.reserved_cpus = {cpu};
+  const auto auto_cpus = policy.GetAutoAssignCpus();
+  EXPECT_EQ(auto_cpus.size(), available_cpus.size() - 1);
+  EXPECT_EQ(std::find(auto_cpus.begin(), auto_cpus.end(), cpu), auto_cpus.end());
+  EXPECT_FALSE(SetCurrentThreadAffinity({-1}));
+
+#ifdef __linux__
+  // 2. the dedicated threads of a block listed in the policy run on its cpus
+  std::atomic<int> misplaced{0};
+  auto             check_cpu = [&](ToyParsingType unit) -> bool {
+    if (sched_getcpu() != cpu)
+    {
+      misplaced.fetch_add(1);
+    }
+    return AddOne(unit);
+  };
+  AsyncPipelineConfig config;
+  config.execution_mode          = PipelineExecutionMode::DEDICATED_THREAD;
+  config.placement.block_cpus    = {{"Pinned", {cpu}}};
+  config.placement.reserved_cpus = {cpu};
+  config.placement.auto_assign   = true;
+  ToyAsyncPipeline pipeline;
+  pipeline.ConfigPipeline("pinned", {pipeline.BuildPipelineBlock(check_cpu, "Pinned", 2),
+                                     pipeline.BuildPipelineBlock(Twice, "Twice")});
+  pipeline.InitPipeline(config);
+  std::vector<std::future<int>> futures;
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    futures.push_back(pipeline.Push("pinned", i));
+  }
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    EXPECT_EQ(futures[i].get(), (i + 1) * 2);
+  }
+  pipeline.ClosePipeline();
+  EXPECT_EQ(misplaced.load(), 0) << "Block thread is not pinned to its cpus";
+
+  // 3. the executor workers are pinned in turn
+  misplaced.store(0);
+  std::atomic<int> done{0};
+  {
+    WorkStealingThreadPool pool(2, {cpu});
+    for (int i = 0; i < kRequestNum; ++i)
+    {
+      pool.Submit([&] {
+        if (sched_getcpu() != cpu)
+        {
+          misplaced.fetch_add(1);
+        }
+        done.fetch_add(1);
+      });
+    }
+  }
+  EXPECT_EQ(done.load(), kRequestNum);
+  EXPECT_EQ(misplaced.load(), 0) << "Executor worker is not pinned to its cpu";
+
+  // 4. the executor blocks are pinned by the executor passed in the config, not by the policy
+  misplaced.store(0);
+  const std::vector<int> pinned_cpus{cpu};
+  AsyncPipelineConfig    executor_config;
+  executor_config.execution_mode       = PipelineExecutionMode::SHARED_EXECUTOR;
+  executor_config.executor             = std::make_shared<WorkStealingThreadPool>(2, pinned_cpus);
+  executor_config.placement.block_cpus = {{"Pinned", pinned_cpus}};
+  ToyAsyncPipeline executor_pipeline;
+  executor_pipeline.ConfigPipeline("pinned",
+                                   {executor_pipeline.BuildPipelineBlock(check_cpu, "Pinned")});
+  executor_pipeline.InitPipeline(executor_config);
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    EXPECT_EQ(executor_pipeline.Push("pinned", i).get(), i + 1);
+  }
+  executor_pipeline.ClosePipeline();
+  EXPECT_EQ(misplaced.load(), 0) << "Executor block is not pinned to the executor cpus";
+#endif
+}
+
+void test_async_pipeline_reconfigure(const AsyncPipelineConfig &config)
+{
+  constexpr int    kPushNum = 4 * kRequestNum;
+  ToyRecorder      recorder;
+  ToyAsyncPipeline pipeline;
+  pipeline.ConfigPipeline("linear", {pipeline.BuildPipelineBlock(AddOneWithJitter, "AddOne"),
+                                     pipeline.BuildPipelineBlock(Twice, "Twice"),
+                                     pipeline.BuildPipelineBlock(std::ref(recorder), "Recorder")});
+  pipeline.InitPipeline(config);
+
+  // 1. reconfigure while a producer keeps pushing, no package is lost
+  std::vector<std::future<int>> futures;
+  std::atomic<int>              pushed{0};
+  std::thread                   pusher([&] {
+    for (int i = 0; i < kPushNum; ++i)
+    {
+      futures.push_back(pipeline.Push("linear", i));
+      pushed.store(i + 1);
+    }
+  });
+  EXPECT_TRUE(WaitFor([&] { return pushed.load() >= kRequestNum; }));
+
+  AsyncPipelineConfig new_config = config;
+  new_config.bq_max_size         = std::max(config.bq_max_size / 2, 1);
+  EXPECT_TRUE(pipeline.ReconfigurePipeline(
+      "linear",
+      {pipeline.BuildPipelineBlock(AddOneWithJitter, "AddOne", 4, true),
+       pipeline.BuildPipelineBlock(Twice, "Twice"),
+       pipeline.BuildPipelineBlock(std::ref(recorder), "Recorder")},
+      new_config));
+  EXPECT_TRUE(pipeline.ReconfigurePipeline("linear", config));
+  pusher.join();
+  for (int i = 0; i < kPushNum; ++i)
+  {
+    EXPECT_EQ(GetFutureStatus(futures[i]), PackageStatus::SUCCESS) << "Lost package " << i;
+  }
+  const auto values = recorder.GetValues();
+  ASSERT_EQ(values.size(), static_cast<size_t>(kPushNum));
+  for (int i = 0; i < kPushNum; ++i)
+  {
+    EXPECT_EQ(values[i], (i + 1) * 2) << "Got package out of order at " << i;
+  }
+
+  // 2. the pushes block while the pipeline is drained, and go on once it is resumed
+  ASSERT_TRUE(pipeline.DrainPipeline("linear"));
+  std::future<int>  blocked;
+  std::atomic<bool> blocked_pushed{false};
+  std::thread       blocked_pusher([&] {
+    blocked = pipeline.Push("linear", 1);
+    blocked_pushed.store(true);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_FALSE(blocked_pushed.load()) << "Push is not blocked by drain";
+  pipeline.ResumePipeline("linear");
+  blocked_pusher.join();
+  EXPECT_EQ(blocked.get(), 4);
+
+  // 3. an invalid pipeline is rejected, and the running one is kept
+  AsyncPipelineConfig invalid_config = config;
+  invalid_config.target_latency_ms   = -1;
+  EXPECT_FALSE(pipeline.ReconfigurePipeline("linear", invalid_config));
+  auto dangling = pipeline.BuildPipelineBlock(Twice, "Dangling");
+  dangling.SetDependencies({"Unknown"});
+  EXPECT_FALSE(pipeline.ReconfigurePipeline("linear", {dangling}, config));
+  // too many join blocks, the old blocks are kept
+  std::vector<AsyncPipelineContext<ToyParsingType>> chain_blocks{
+      pipeline.BuildPipelineBlock(AddOne, "Join0")};
+  for (int i = 1; i <= 9; ++i)
+  {
+    auto side   = pipeline.BuildPipelineBlock(AddOne, "Side" + std::to_string(i));
+    auto joined = pipeline.BuildPipelineBlock(AddOne, "Join" + std::to_string(i));
+    side.SetDependencies({"Join" + std::to_string(i - 1)});
+    joined.SetDependencies({"Join" + std::to_string(i - 1), "Side" + std::to_string(i)});
+    chain_blocks.push_back(side);
+    chain_blocks.push_back(joined);
+  }
+  EXPECT_FALSE(pipeline.ReconfigurePipeline("linear", chain_blocks, config));
+  EXPECT_EQ(pipeline.Push("linear", 2).get(), 6) << "Running pipeline is not kept";
+  pipeline.ClosePipeline();
+
+  // 4. the drain times out behind a held package, the pipeline keeps running
+  ToyGate          gate;
+  ToyAsyncPipeline gated_pipeline;
+  gated_pipeline.ConfigPipeline("gated", {gated_pipeline.BuildPipelineBlock(std::ref(gate), "Gate"),
+                                          gated_pipeline.BuildPipelineBlock(Twice, "Twice")});
+  gated_pipeline.InitPipeline(config);
+  auto held = gated_pipeline.Push("gated", 1);
+  EXPECT_TRUE(gate.WaitArrived(1)) << "Timeout waiting for the gate";
+  EXPECT_FALSE(gated_pipeline.DrainPipeline("gated", 20));
+  EXPECT_FALSE(gated_pipeline.ReconfigurePipeline("gated", config, 20));
+  auto after = gated_pipeline.Push("gated", 2);
+  gate.Open();
+  EXPECT_EQ(held.get(), 2);
+  EXPECT_EQ(after.get(), 4);
+
+  EXPECT_FALSE(gated_pipeline.DrainPipeline("invalid"));
+  gated_pipeline.ClosePipeline();
+}
+
+void test_async_pipeline_completion(const AsyncPipelineConfig &config)
+{
+  ToyGate          gate;
+  ToyAsyncPipeline pipeline;
+  pipeline.ConfigPipeline("linear",
+                          {pipeline.BuildPipelineBlock(AddOneWithJitter, "AddOne", 4, true),
+                           pipeline.BuildPipelineBlock(Twice, "Twice")});
+  pipeline.ConfigPipeline("gated", {pipeline.BuildPipelineBlock(std::ref(gate), "Gate"),
+                                    pipeline.BuildPipelineBlock(Twice, "Twice")});
+  pipeline.InitPipeline(config);
+
+  // 1. the callbacks are called once per request, in the order of completion
+  std::mutex                                 mtx;
+  std::vector<std::pair<PackageStatus, int>> callback_results;
+  AsyncCompletion<int>                       callback([&](PackageStatus status, int &&result) {
+    std::lock_guard<std::mutex> lk(mtx);
+    callback_results.emplace_back(status, result);
+  });
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    ASSERT_TRUE(pipeline.Push("linear", i, callback));
+  }
+  ASSERT_TRUE(WaitFor([&] {
+    std::lock_guard<std::mutex> lk(mtx);
+    return callback_results.size() == static_cast<size_t>(kRequestNum);
+  })) << "Timeout waiting for the callbacks";
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    EXPECT_EQ(callback_results[i].first, PackageStatus::SUCCESS);
+    EXPECT_EQ(callback_results[i].second, (i + 1) * 2);
+  }
+
+  // 2. the completion queue receives the tagged results and notifies the consumer
+  std::atomic<int>          notified{0};
+  AsyncCompletionQueue<int> queue(kRequestNum, [&] { notified.fetch_add(1); });
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    ASSERT_TRUE(pipeline.Push("linear", i, AsyncCompletion<int>(queue, i)));
+  }
+  std::vector<int> tag_results(kRequestNum, -1);
+  int              popped = 0;
+  ASSERT_TRUE(WaitFor([&] {
+    while (auto entry = queue.TryPop())
+    {
+      EXPECT_EQ(entry->status, PackageStatus::SUCCESS);
+      tag_results[entry->tag] = entry->result;
+      ++popped;
+    }
+    return popped == kRequestNum;
+  })) << "Timeout waiting for the completion queue";
+  EXPECT_EQ(notified.load(), kRequestNum);
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    EXPECT_EQ(tag_results[i], (i + 1) * 2) << "Got unexpected result of tag " << i;
+  }
+
+  // 3. a dropped request completes with its status
+  auto held = pipeline.Push("gated", 0);
+  EXPECT_TRUE(gate.WaitArrived(1)) << "Timeout waiting for the gate";
+  ASSERT_TRUE(pipeline.Push("gated", 1, AsyncCompletion<int>(queue, 1)));
+  EXPECT_TRUE(pipeline.DropOldestPackage("gated"));
+  gate.Open();
+  EXPECT_EQ(held.get(), 0);
+  auto dropped = queue.TryPop();
+  ASSERT_TRUE(dropped.has_value());
+  EXPECT_EQ(dropped->tag, 1u);
+  EXPECT_EQ(dropped->status, PackageStatus::DROPPED);
+
+  // 4. the completion is not called if the request is not pushed
+  EXPECT_FALSE(pipeline.Push("invalid", 0, AsyncCompletion<int>(queue, 0)));
+  EXPECT_FALSE(pipeline.Push("linear", 0, AsyncCompletion<int>(nullptr)));
+  pipeline.ClosePipeline();
+  EXPECT_FALSE(pipeline.Push("linear", 0, AsyncCompletion<int>(queue, 0)));
+  EXPECT_EQ(queue.Size(), 0u);
+
+  // 5. a callback of a package dropped by the close may push again without deadlock
+  ToyGate          close_gate;
+  ToyAsyncPipeline closing;
+  closing.ConfigPipeline("gated", {closing.BuildPipelineBlock(std::ref(close_gate), "Gate"),
+                                   closing.BuildPipelineBlock(Twice, "Twice")});
+  closing.InitPipeline(config);
+  std::atomic<int>  repushed{0};
+  std::promise<int> repush_status;
+  auto              closing_held = closing.Push("gated", 0);
+  EXPECT_TRUE(close_gate.WaitArrived(1)) << "Timeout waiting for the gate";
+  ASSERT_TRUE(closing.Push("gated", 1, AsyncCompletion<int>([&](PackageStatus status, int &&) {
+    EXPECT_EQ(status, PackageStatus::DROPPED);
+    repushed.fetch_add(1);
+    closing.Push("gated", 2, AsyncCompletion<int>([&](PackageStatus again, int &&) {
+      repush_status.set_value(static_cast<int>(again));
+    }));
+  })));
+  auto closed = std::async(std::launch::async, [&] { closing.ClosePipeline(); });
+  EXPECT_TRUE(WaitFor([&] { return repushed.load() == 1; })) << "Timeout waiting for the drop";
+  close_gate.Open();
+  EXPECT_EQ(closed.wait_for(kWaitTimeout), std::future_status::ready)
+      << "ClosePipeline deadlocked on a callback pushing again";
+  closing_held.wait();
+  EXPECT_EQ(repush_status.get_future().get(), static_cast<int>(PackageStatus::DROPPED));
+}
+
+void test_async_completion_queue_correctness()
+{
+  // 1. the capacity is rounded up to a power of 2, pushes fail once it is full
+  AsyncCompletionQueue<int> queue(5);
+  EXPECT_EQ(queue.GetCapacity(), 8u);
+  for (int i = 0; i < 8; ++i)
+  {
+    AsyncCompletionEntry<int> entry{static_cast<uint64_t>(i), PackageStatus::SUCCESS, i};
+    ASSERT_TRUE(queue.TryPush(entry));
+  }
+  AsyncCompletionEntry<int> overflow{8, PackageStatus::SUCCESS, 8};
+  EXPECT_FALSE(queue.TryPush(overflow));
+  EXPECT_EQ(queue.Size(), 8u);
+  for (int i = 0; i < 8; ++i)
+  {
+    auto entry = queue.TryPop();
+    ASSERT_TRUE(entry.has_value());
+    EXPECT_EQ(entry->tag, static_cast<uint64_t>(i));
+  }
+  EXPECT_FALSE(queue.TryPop().has_value());
+
+  // 2. concurrent producers and consumers, every entry is popped exactly once
+  constexpr int            kThreadNum = 4;
+  constexpr int            kEntryNum  = 10000;
+  std::atomic<int>         popped_sum{0};
+  std::atomic<int>         popped_num{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreadNum; ++t)
+  {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < kEntryNum; ++i)
+      {
+        queue.Push({static_cast<uint64_t>(t), PackageStatus::SUCCESS, 1});
+      }
+    });
+    threads.emplace_back([&] {
+      while (popped_num.load() < kThreadNum * kEntryNum)
+      {
+        if (auto entry = queue.TryPop())
+        {
+          popped_sum.fetch_add(entry->result);
+          popped_num.fetch_add(1);
+        } else
+        {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+  EXPECT_EQ(popped_sum.load(), kThreadNum * kEntryNum);
+  EXPECT_EQ(queue.Size(), 0u);
+  EXPECT_EQ(queue.GetDroppedCount(), 0u);
+
+  // 3. a push on the full queue without consumer gives up after the timeout, and an exception of
+  // the notifier does not escape
+  int                       notified = 0;
+  AsyncCompletionQueue<int> full_queue(1, [&] {
+    ++notified;
+    throw std::runtime_error("toy notifier failure");
+  });
+  const auto capacity = full_queue.GetCapacity();
+  for (size_t i = 0; i < capacity; ++i)
+  {
+    EXPECT_TRUE(full_queue.Push({i, PackageStatus::SUCCESS, 0}));
+  }
+  EXPECT_EQ(notified, static_cast<int>(capacity));
+  const auto start = std::chrono::steady_clock::now();
+  EXPECT_FALSE(full_queue.Push({capacity, PackageStatus::SUCCESS, 0}));
+  EXPECT_GE(std::chrono::steady_clock::now() - start, AsyncCompletionQueue<int>::kPushTimeout);
+  EXPECT_EQ(full_queue.GetDroppedCount(), 1u);
+  EXPECT_EQ(notified, static_cast<int>(capacity));
+  for (size_t i = 0; i < capacity; ++i)
+  {
+    auto entry = full_queue.TryPop();
+    ASSERT_TRUE(entry.has_value());
+    EXPECT_EQ(entry->tag, i);
+  }
+  EXPECT_FALSE(full_queue.TryPop().has_value());
+}
+
+void test_async_pipeline_dag(const AsyncPipelineConfig &config)
+{
+  using Block_t   = AsyncPipelineBlock<ToyParsingType>;
+  using Context_t = AsyncPipelineContext<ToyParsingType>;
+
+  // writes `value * (branch + 1)` into its own slot
+  auto branch = [](int index) {
+    return [index](ToyParsingType unit) -> bool {
+      std::this_thread::sleep_for(std::chrono::microseconds(Cast(unit)->value % 3 * 50));
+      Cast(unit)->branch_values[index] = Cast(unit)->value * (index + 1);
+      return true;
+    };
+  };
+  // sums the slots up
+  auto join = [](ToyParsingType unit) -> bool {
+    auto package   = Cast(unit);
+    package->value = 0;
+    for (int value : package->branch_values)
+    {
+      package->value += value;
+    }
+    return true;
+  };
+
+  ToyAsyncPipeline pipeline;
+  // 1. diamond: AddOne -> (Left, Right) -> Join -> Recorder
+  ToyRecorder recorder;
+  Block_t     left         = pipeline.BuildPipelineBlock(branch(0), "Left");
+  Block_t     right        = pipeline.BuildPipelineBlock(branch(1), "Right", 2, true);
+  Block_t     diamond_join = pipeline.BuildPipelineBlock(join, "Join");
+  right.SetDependencies({"AddOne"});
+  diamond_join.SetDependencies({"Left", "Right"});
+  pipeline.ConfigPipeline("diamond", {pipeline.BuildPipelineBlock(AddOne, "AddOne"), left, right,
+                                      diamond_join,
+                                      pipeline.BuildPipelineBlock(std::ref(recorder), "Recorder")});
+
+  // 2. fan-out from the input into more branches than join stages, and one join of all of them
+  std::vector<Context_t>   wide_blocks;
+  std::vector<std::string> branch_names;
+  for (int i = 0; i < kBranchNum; ++i)
+  {
+    branch_names.push_back("Branch" + std::to_string(i));
+    Block_t block = pipeline.BuildPipelineBlock(branch(i), branch_names.back());
+    block.SetDependencies({});
+    wide_blocks.push_back(block);
+  }
+  Block_t wide_join = pipeline.BuildPipelineBlock(join, "Join");
+  wide_join.SetDependencies(branch_names);
+  wide_blocks.push_back(wide_join);
+  pipeline.ConfigPipeline("wide", wide_blocks);
+  pipeline.InitPipeline(config);
+
+  std::vector<std::future<int>> diamond_futures;
+  std::vector<std::future<int>> wide_futures;
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    diamond_futures.push_back(pipeline.Push("diamond", i));
+    wide_futures.push_back(pipeline.Push("wide", i));
+  }
+  const int wide_factor = kBranchNum * (kBranchNum + 1) / 2;
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    EXPECT_EQ(diamond_futures[i].get(), (i + 1) * 3) << "Got unexpected result of diamond";
+    EXPECT_EQ(wide_futures[i].get(), i * wide_factor) << "Got unexpected result of wide join";
+  }
+  // the join runs once per package after both branches, in the order of pushing
+  const auto values = recorder.GetValues();
+  ASSERT_EQ(values.size(), static_cast<size_t>(kRequestNum));
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    EXPECT_EQ(values[i], (i + 1) * 3) << "Got package out of order at " << i;
+  }
+  pipeline.ClosePipeline();
+
+  // 3. the number of join stages in one pipeline is limited, it is checked on config
+  std::vector<Context_t> chain_blocks{pipeline.BuildPipelineBlock(AddOne, "Join0")};
+  ToyAsyncPipeline       chain_pipeline;
+  for (int i = 1; i <= 9; ++i)
+  {
+    if (i == 9)
+    {
+      // 8 join stages are fine
+      chain_pipeline.ConfigPipeline("chain", chain_blocks);
+      chain_pipeline.InitPipeline(config);
+      EXPECT_EQ(chain_pipeline.Push("chain", 0).get(), 8 * 2 + 1);
+      chain_pipeline.ClosePipeline();
+    }
+    const auto prev   = "Join" + std::to_string(i - 1);
+    Block_t    side   = pipeline.BuildPipelineBlock(AddOne, "Side" + std::to_string(i));
+    Block_t    joined = pipeline.BuildPipelineBlock(AddOne, "Join" + std::to_string(i));
+    side.SetDependencies({prev});
+    joined.SetDependencies({prev, "Side" + std::to_string(i)});
+    chain_blocks.push_back(side);
+    chain_blocks.push_back(joined);
+  }
+  EXPECT_THROW(chain_pipeline.ConfigPipeline("chain", chain_blocks), std::invalid_argument);
+}
+
+void test_pipeline_trace(const AsyncPipelineConfig &config)
+{
+  ToyAsyncPipeline pipeline;
+  pipeline.ConfigPipeline("traced", {pipeline.BuildPipelineBlock(AddOne, "TraceAddOne"),
+                                     pipeline.BuildPipelineBlock(Twice, "TraceTwice")});
+  pipeline.InitPipeline(config);
+  auto run_requests = [&] {
+    std::vector<std::future<int>> futures;
+    for (int i = 0; i < kRequestNum; ++i)
+    {
+      futures.push_back(pipeline.Push("traced", i));
+    }
+    for (int i = 0; i < kRequestNum; ++i)
+    {
+      EXPECT_EQ(futures[i].get(), (i + 1) * 2);
+    }
+  };
+
+  // 1. every compute span and queue wait of the session is exported
+  PipelineTracer::Start();
+  EXPECT_TRUE(PipelineTracer::IsEnabled());
+  run_requests();
+  PipelineTracer::Stop();
+  EXPECT_FALSE(PipelineTracer::IsEnabled());
+  EXPECT_EQ(PipelineTracer::GetDroppedCount(), 0u);
+
+  const auto json = PipelineTracer::ExportChromeTrace();
+  EXPECT_EQ(json.rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0), 0u);
+  EXPECT_EQ(json.substr(json.size() - 4), "\n]}\n");
+  EXPECT_EQ(CountOf(json, "{"), CountOf(json, "}")) << "Got invalid trace json";
+  for (const std::string name : {"TraceAddOne", "TraceTwice"})
+  {
+    EXPECT_EQ(CountOf(json, "{\"name\":\"" + name + "\",\"cat\":\"compute\",\"ph\":\"X\""),
+              static_cast<size_t>(kRequestNum))
+        << "Got unexpected compute spans of " << name;
+    EXPECT_EQ(CountOf(json, "{\"name\":\"wait " + name + "\",\"cat\":\"queue\",\"ph\":\"b\""),
+              CountOf(json, "{\"name\":\"wait " + name + "\",\"cat\":\"queue\",\"ph\":\"e\""));
+  }
+  EXPECT_EQ(CountOf(json, "{\"name\":\"wait TraceTwice\",\"cat\":\"queue\",\"ph\":\"b\""),
+            static_cast<size_t>(kRequestNum))
+      << "Got unexpected queue waits";
+
+  // 2. nothing is recorded once stopped
+  run_requests();
+  EXPECT_EQ(PipelineTracer::ExportChromeTrace(), json);
+  EXPECT_FALSE(PipelineTracer::ExportChromeTrace("/nonexistent_dir/pipeline_trace.json"));
+
+  // 3. the records over the buffer capacity are dropped and counted
+  PipelineTracer::Start(4);
+  run_requests();
+  PipelineTracer::Stop();
+  EXPECT_GT(PipelineTracer::GetDroppedCount(), 0u);
+  EXPECT_LT(CountOf(PipelineTracer::ExportChromeTrace(), "\"cat\":\"compute\""),
+            static_cast<size_t>(kRequestNum));
+  pipeline.ClosePipeline();
+}
+
+void test_async_pipeline_adaptive_depth(const AsyncPipelineConfig &config)
+{
+  constexpr int kPushNum = 1000;
+
+  // max number of packages pushed but not yet through the slow block, once the queues have adapted
+  // in the first half of the run
+  auto run_backlog = [](const AsyncPipelineConfig &run_config) {
+    std::atomic<int> processed{0};
+    int              max_backlog = 0;
+    auto             slow        = [&](ToyParsingType unit) -> bool {
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+      processed.fetch_add(1);
+      return AddOne(unit);
+    };
+    ToyAsyncPipeline pipeline;
+    pipeline.ConfigPipeline("slow", {pipeline.BuildPipelineBlock(Twice, "Twice"),
+                                     pipeline.BuildPipelineBlock(slow, "Slow")});
+    pipeline.InitPipeline(run_config);
+    std::vector<std::future<int>> futures;
+    for (int i = 0; i < kPushNum; ++i)
+    {
+      futures.push_back(pipeline.Push("slow", i));
+      if (i >= kPushNum / 2)
+      {
+        max_backlog = std::max(max_backlog, i + 1 - processed.load());
+      }
+    }
+    for (int i = 0; i < kPushNum; ++i)
+    {
+      EXPECT_EQ(futures[i].get(), i * 2 + 1);
+    }
+    pipeline.ClosePipeline();
+    return max_backlog;
+  };
+
+  AsyncPipelineConfig fixed_config = config;
+  fixed_config.bq_max_size         = 100;
+  fixed_config.target_latency_ms   = 0;
+  AsyncPipelineConfig adaptive_config = fixed_config;
+  adaptive_config.target_latency_ms   = 2;
+  adaptive_config.min_queue_size      = 2;
+
+  // the packages pile up in the fixed depth queues, but not in the adapted ones
+  const int fixed_backlog    = run_backlog(fixed_config);
+  const int adaptive_backlog = run_backlog(adaptive_config);
+  EXPECT_GT(fixed_backlog, 50);
+  EXPECT_LT(adaptive_backlog, 50) << "Queue depth is not adapted to the target latency";
+
+  AsyncPipelineConfig invalid_config = config;
+  invalid_config.target_latency_ms   = -1;
+  ToyAsyncPipeline pipeline;
+  pipeline.ConfigPipeline("invalid", {pipeline.BuildPipelineBlock(AddOne, "AddOne")});
+  EXPECT_THROW(pipeline.InitPipeline(invalid_config), std::invalid_argument);
+}
+
+void test_async_pipeline_wait_stats(const AsyncPipelineConfig &config)
+{
+  AsyncPipelineConfig wait_config = config;
+  wait_config.execution_mode      = PipelineExecutionMode::DEDICATED_THREAD;
+  wait_config.wait_strategy       = WaitStrategy::Park();
+  ToyAsyncPipeline pipeline;
+  pipeline.ConfigPipeline("linear", {pipeline.BuildPipelineBlock(AddOne, "AddOne"),
+                                     pipeline.BuildPipelineBlock(Twice, "Twice")});
+  pipeline.InitPipeline(wait_config);
+
+  // the blocks park on their empty input queues between the requests
+  for (int i = 0; i < 8; ++i)
+  {
+    EXPECT_EQ(pipeline.Push("linear", i).get(), (i + 1) * 2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  const auto stats = pipeline.GetQueueWaitStats("linear");
+  ASSERT_GE(stats.size(), 2u);
+  EXPECT_EQ(stats[0].first, "AddOne");
+  EXPECT_EQ(stats[1].first, "Twice");
+  for (const auto &name_stats : stats)
+  {
+    EXPECT_GT(name_stats.second.consumer.park, 0u) << "Got no park wait of " << name_stats.first;
+    EXPECT_EQ(name_stats.second.consumer.spin, 0u) << "Got spin wait of " << name_stats.first;
+  }
+  EXPECT_TRUE(pipeline.GetQueueWaitStats("invalid").empty());
+  pipeline.ClosePipeline();
+}
+
+void test_async_pipeline_failure(const AsyncPipelineConfig &config)
+{
+  using Block_t = AsyncPipelineBlock<ToyParsingType>;
+
+  // multiples of 3 return false, the other odd values throw
+  auto check = [](ToyParsingType unit) -> bool {
+    const int value = Cast(unit)->value;
+    if (value % 2 == 1 && value % 3 != 0)
+    {
+      throw std::runtime_error("toy block failure");
+    }
+    return value % 3 != 0;
+  };
+  // counts the packages running the blocks after `check`
+  std::atomic<int> later_count{0};
+  auto             count = [&](ToyParsingType) -> bool {
+    later_count.fetch_add(1);
+    return true;
+  };
+
+  ToyAsyncPipeline pipeline;
+  ToyRecorder      recorder;
+  pipeline.ConfigPipeline("linear", {pipeline.BuildPipelineBlock(check, "Check"),
+                                     pipeline.BuildPipelineBlock(count, "Count"),
+                                     pipeline.BuildPipelineBlock(std::ref(recorder), "Recorder")});
+  // a failed branch of a DAG pipeline stops its siblings before the join
+  Block_t left  = pipeline.BuildPipelineBlock(check, "Left");
+  Block_t slow  = pipeline.BuildPipelineBlock(
+      [](ToyParsingType) -> bool {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return true;
+      },
+      "Slow");
+  Block_t right = pipeline.BuildPipelineBlock(count, "Right");
+  Block_t join  = pipeline.BuildPipelineBlock(AddOne, "Join");
+  left.SetDependencies({});
+  slow.SetDependencies({});
+  right.SetDependencies({"Slow"});
+  join.SetDependencies({"Left", "Right"});
+  pipeline.ConfigPipeline("diamond", {left, slow, right, join});
+  pipeline.InitPipeline(config);
+
+  std::vector<std::future<int>> futures;
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    futures.push_back(pipeline.Push("linear", i));
+  }
+  int failed_num = 0;
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    if (i % 2 == 1 || i % 3 == 0)
+    {
+      EXPECT_EQ(GetFutureStatus(futures[i]), PackageStatus::FAILED) << "Package " << i;
+      ++failed_num;
+    } else
+    {
+      EXPECT_EQ(futures[i].get(), i);
+    }
+  }
+  // the failed packages skip the rest blocks
+  EXPECT_EQ(later_count.load(), kRequestNum - failed_num);
+  EXPECT_EQ(recorder.GetValues().size(), static_cast<size_t>(kRequestNum - failed_num));
+
+  later_count.store(0);
+  auto failed  = pipeline.Push("diamond", 3);
+  auto succeed = pipeline.Push("diamond", 2);
+  EXPECT_EQ(GetFutureStatus(failed), PackageStatus::FAILED);
+  EXPECT_EQ(succeed.get(), 3);
+  EXPECT_EQ(later_count.load(), 1) << "Sibling branch runs on after the package failed";
+  pipeline.ClosePipeline();
+}
+
+void test_static_pipeline_correctness()
+{
+  struct ToyStaticPackage {
+    int value   = 0;
+    int visited = 0;
+  };
+  // values divisible by 5 fail in the second stage, by 7 throw
+  struct AddOneStage {
+    bool operator()(ToyStaticPackage &package)
+    {
+      package.value += 1;
+      ++package.visited;
+      return true;
+    }
+  };
+  struct CheckStage {
+    bool operator()(ToyStaticPackage &package)
+    {
+      ++package.visited;
+      if (package.value % 7 == 0)
+      {
+        throw std::runtime_error("toy stage failure");
+      }
+      return package.value % 5 != 0;
+    }
+  };
+  struct TwiceStage {
+    bool operator()(ToyStaticPackage &package)
+    {
+      package.value *= 2;
+      ++package.visited;
+      return true;
+    }
+  };
+  using ToyStaticPipeline = StaticPipeline<ToyStaticPackage, AddOneStage, CheckStage, TwiceStage>;
+  const auto failed = [](int value) { return (value + 1) % 5 == 0 || (value + 1) % 7 == 0; };
+
+  // 1. the stages run inline and short-circuit on failure
+  ToyStaticPipeline pipeline(AddOneStage{}, CheckStage{}, TwiceStage{});
+  ToyStaticPackage  inline_package{1};
+  EXPECT_TRUE(pipeline.Run(inline_package));
+  EXPECT_EQ(inline_package.value, 4);
+  inline_package = {4};
+  EXPECT_FALSE(pipeline.Run(inline_package));
+  EXPECT_EQ(inline_package.visited, 2) << "Stage runs after the failed one";
+
+  // 2. the packages leave in push order, the failed ones skip the rest stages
+  EXPECT_FALSE(pipeline.Push(std::make_unique<ToyStaticPackage>())) << "Pushed before Init";
+  ASSERT_TRUE(pipeline.Init(4));
+  EXPECT_FALSE(pipeline.Init(4));
+  std::thread pusher([&] {
+    for (int i = 0; i < kRequestNum; ++i)
+    {
+      auto package   = std::make_unique<ToyStaticPackage>();
+      package->value = i;
+      EXPECT_TRUE(pipeline.Push(std::move(package)));
+    }
+  });
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    auto output = pipeline.Take();
+    ASSERT_TRUE(output.has_value());
+    ASSERT_NE(output->package, nullptr);
+    if (failed(i))
+    {
+      EXPECT_EQ(output->status, PackageStatus::FAILED) << "Package " << i;
+      EXPECT_EQ(output->package->visited, 2);
+    } else
+    {
+      EXPECT_EQ(output->status, PackageStatus::SUCCESS) << "Package " << i;
+      EXPECT_EQ(output->package->value, (i + 1) * 2) << "Got package out of order at " << i;
+    }
+  }
+  pusher.join();
+
+  // 3. closing drains the packages in flight, then stops
+  ASSERT_TRUE(pipeline.Push(std::make_unique<ToyStaticPackage>()));
+  pipeline.Close();
+  EXPECT_FALSE(pipeline.Push(std::make_unique<ToyStaticPackage>()));
+  auto last = pipeline.Take();
+  ASSERT_TRUE(last.has_value());
+  EXPECT_EQ(last->package->value, 2);
+  EXPECT_FALSE(pipeline.Take().has_value());
+}
+
+void test_async_pipeline_bottleneck(const AsyncPipelineConfig &config)
+{
+  constexpr int kSlowPushNum = 400;
+  auto          slow         = [](ToyParsingType unit) -> bool {
+    std::this_thread::sleep_for(std::chrono::microseconds(300));
+    return Twice(unit);
+  };
+  AsyncPipelineConfig sample_config  = config;
+  sample_config.bottleneck_sample_ms = 2;
+  ToyAsyncPipeline pipeline;
+  pipeline.ConfigPipeline("linear", {pipeline.BuildPipelineBlock(AddOne, "AddOne"),
+                                     pipeline.BuildPipelineBlock(slow, "Slow")});
+  pipeline.InitPipeline(sample_config);
+  EXPECT_TRUE(pipeline.GetBottleneckReport("invalid").stages.empty());
+
+  // keep the slow block saturated while sampling
+  std::vector<std::future<int>> futures;
+  std::thread                   pusher([&] {
+    for (int i = 0; i < kSlowPushNum; ++i)
+    {
+      futures.push_back(pipeline.Push("linear", i));
+    }
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  const auto report = pipeline.GetBottleneckReport("linear");
+  pusher.join();
+  for (int i = 0; i < kSlowPushNum; ++i)
+  {
+    EXPECT_EQ(futures[i].get(), (i + 1) * 2);
+  }
+
+  EXPECT_GT(report.window_ms, 0);
+  ASSERT_GE(report.stages.size(), 2u);
+  EXPECT_EQ(report.stages[0].name, "AddOne");
+  EXPECT_EQ(report.stages[1].name, "Slow");
+  ASSERT_EQ(report.bottleneck, 1) << "Got bottleneck " << report.bottleneck;
+  const auto &bottleneck = report.stages[1];
+  EXPECT_GT(bottleneck.busy_ratio, 0.5);
+  EXPECT_GT(bottleneck.busy_ratio, report.stages[0].busy_ratio);
+  EXPECT_NEAR(bottleneck.headroom, 1 - bottleneck.busy_ratio, 1e-9);
+  EXPECT_GT(bottleneck.throughput, 0);
+  EXPECT_GE(bottleneck.service_p50_us, 300);
+  EXPECT_LE(bottleneck.service_p50_us, bottleneck.service_p99_us);
+  EXPECT_LE(bottleneck.queue_depth, bottleneck.max_queue_depth);
+  pipeline.ClosePipeline();
+
+  // the report is empty without the sampler
+  ToyAsyncPipeline unsampled_pipeline;
+  unsampled_pipeline.ConfigPipeline("linear",
+                                    {unsampled_pipeline.BuildPipelineBlock(AddOne, "AddOne")});
+  unsampled_pipeline.InitPipeline(config);
+  EXPECT_EQ(unsampled_pipeline.Push("linear", 1).get(), 2);
+  const auto unsampled_report = unsampled_pipeline.GetBottleneckReport("linear");
+  EXPECT_TRUE(unsampled_report.stages.empty());
+  EXPECT_EQ(unsampled_report.bottleneck, -1);
+  unsampled_pipeline.ClosePipeline();
+}
+
+void test_async_pipeline_cancel(const AsyncPipelineConfig &config)
+{
+  ToyGate          gate;
+  std::atomic<int> twice_count{0};
+  auto             twice = [&](ToyParsingType unit) -> bool {
+    twice_count.fetch_add(1);
+    return Twice(unit);
+  };
+  ToyAsyncPipeline pipeline;
+  pipeline.ConfigPipeline("gated", {pipeline.BuildPipelineBlock(std::ref(gate), "Gate"),
+                                    pipeline.BuildPipelineBlock(twice, "Twice")});
+  pipeline.InitPipeline(config);
+
+  // 1. a token cancelled before pushing completes the request at once
+  auto cancelled_token = AsyncCancelToken::Create();
+  cancelled_token.Cancel();
+  auto early = pipeline.Push("gated", 0, false, kPipelineNoDeadline, PRIORITY_NORMAL,
+                             cancelled_token);
+  EXPECT_EQ(GetFutureStatus(early), PackageStatus::CANCELLED);
+
+  // 2. the packages cancelled in the gate skip the rest blocks, the others go on
+  const int  push_num = std::min(config.bq_max_size, 4);
+  const auto token    = AsyncCancelToken::Create();
+  auto       held = pipeline.Push("gated", 1, false, kPipelineNoDeadline, PRIORITY_NORMAL, token);
+  ASSERT_TRUE(gate.WaitArrived(1)) << "Timeout waiting for the gate";
+  std::vector<std::future<int>> kept;
+  std::thread                   pusher([&] {
+    for (int i = 0; i < push_num; ++i)
+    {
+      kept.push_back(pipeline.Push("gated", 2 + i));
+    }
+  });
+  token.Cancel();
+  gate.Open();
+  pusher.join();
+  EXPECT_EQ(GetFutureStatus(held), PackageStatus::CANCELLED);
+  for (int i = 0; i < push_num; ++i)
+  {
+    EXPECT_EQ(kept[i].get(), (2 + i) * 2);
+  }
+  EXPECT_EQ(twice_count.load(), push_num) << "Cancelled package is not skipped";
+
+  // 3. an empty token is never cancelled
+  AsyncCancelToken empty_token;
+  empty_token.Cancel();
+  EXPECT_FALSE(empty_token.IsValid());
+  EXPECT_FALSE(empty_token.IsCancelled());
+  auto plain = pipeline.Push("gated", 3, false, kPipelineNoDeadline, PRIORITY_NORMAL, empty_token);
+  EXPECT_EQ(plain.get(), 6);
+  pipeline.ClosePipeline();
+}
+
+void test_async_pipeline_shared_stage(const AsyncPipelineConfig &config)
+{
+  auto                         shared_stage = std::make_shared<SharedPipelineStage>("Toy Shared");
+  std::mutex                   mtx;
+  std::vector<std::thread::id> shared_threads;
+  int                          running     = 0;
+  int                          max_running = 0;
+  auto                         shared      = [&](ToyParsingType unit) -> bool {
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      shared_threads.push_back(std::this_thread::get_id());
+      max_running = std::max(max_running, ++running);
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(20));
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      --running;
+    }
+    return Twice(unit);
+  };
+
+  ToyAsyncPipeline first_pipeline;
+  ToyAsyncPipeline second_pipeline;
+  for (auto *pipeline : {&first_pipeline, &second_pipeline})
+  {
+    auto shared_block = pipeline->BuildPipelineBlock(shared, "Shared", 2);
+    shared_block.SetSharedStage(shared_stage);
+    pipeline->ConfigPipeline("linear", {pipeline->BuildPipelineBlock(AddOne, "AddOne"),
+                                        shared_block,
+                                        pipeline->BuildPipelineBlock(AddOne, "AddOne")});
+    pipeline->InitPipeline(config);
+  }
+  EXPECT_EQ(shared_stage->GetClientNum(), 2u);
+
+  // 1. the shared block of both pipelines runs on one thread, one package at a time
+  std::vector<std::future<int>> first_futures;
+  std::vector<std::future<int>> second_futures;
+  std::thread                   pusher([&] {
+    for (int i = 0; i < kRequestNum; ++i)
+    {
+      second_futures.push_back(second_pipeline.Push("linear", i));
+    }
+  });
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    first_futures.push_back(first_pipeline.Push("linear", i));
+  }
+  pusher.join();
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    EXPECT_EQ(first_futures[i].get(), (i + 1) * 2 + 1);
+    EXPECT_EQ(second_futures[i].get(), (i + 1) * 2 + 1);
+  }
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    EXPECT_EQ(max_running, 1) << "Shared block runs concurrently";
+    ASSERT_EQ(shared_threads.size(), static_cast<size_t>(kRequestNum * 2));
+    for (const auto &thread_id : shared_threads)
+    {
+      EXPECT_EQ(thread_id, shared_threads.front()) << "Shared block runs on another thread";
+    }
+  }
+
+  // 2. a closed pipeline detaches, the other one is still served
+  first_pipeline.ClosePipeline();
+  EXPECT_EQ(shared_stage->GetClientNum(), 1u);
+  EXPECT_EQ(second_pipeline.Push("linear", 1).get(), 5);
+  second_pipeline.ClosePipeline();
+  EXPECT_EQ(shared_stage->GetClientNum(), 0u);
+
+  // 3. a reinitialized pipeline attaches again
+  first_pipeline.InitPipeline(config);
+  EXPECT_EQ(shared_stage->GetClientNum(), 1u);
+  EXPECT_EQ(first_pipeline.Push("linear", 2).get(), 7);
+  first_pipeline.ClosePipeline();
+  EXPECT_EQ(shared_stage->GetClientNum(), 0u);
+
+  // 4. a pipeline blocked after the shared block keeps its back pressure, and does not stall the
+  // other one
+  AsyncPipelineConfig small_config = config;
+  small_config.bq_max_size         = 1;
+  ToyGate          gate;
+  ToyAsyncPipeline gated_pipeline;
+  ToyAsyncPipeline free_pipeline;
+  for (auto *pipeline : {&gated_pipeline, &free_pipeline})
+  {
+    auto shared_block = pipeline->BuildPipelineBlock(Twice, "Shared");
+    shared_block.SetSharedStage(shared_stage);
+    // the gate holds a dedicated thread, not an executor worker
+    auto next_block = pipeline == &gated_pipeline
+                          ? pipeline->BuildPipelineBlock(std::ref(gate), "Gate")
+                                .SetDedicatedThread()
+                          : pipeline->BuildPipelineBlock(AddOne, "AddOne");
+    pipeline->ConfigPipeline("linear", {shared_block, next_block});
+    pipeline->InitPipeline(small_config);
+  }
+  const int                     gated_num = 16;
+  std::atomic<int>              gated_pushed{0};
+  std::vector<std::future<int>> gated_futures;
+  std::thread                   gated_pusher([&] {
+    for (int i = 0; i < gated_num; ++i)
+    {
+      gated_futures.push_back(gated_pipeline.Push("linear", i));
+      gated_pushed.fetch_add(1);
+    }
+  });
+  ASSERT_TRUE(gate.WaitArrived(1)) << "Timeout waiting for the gate";
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  const int  held_pushed = gated_pushed.load();
+  auto       free_future = free_pipeline.Push("linear", 3);
+  const bool served =
+      free_future.wait_for(kWaitTimeout) == std::future_status::ready && free_future.get() == 7;
+  gate.Open();
+  gated_pusher.join();
+  EXPECT_LT(held_pushed, gated_num) << "Shared block takes packages while its output is blocked";
+  EXPECT_TRUE(served) << "Shared stage is stalled by the blocked pipeline";
+  for (int i = 0; i < gated_num; ++i)
+  {
+    EXPECT_EQ(gated_futures[i].get(), i * 2);
+  }
+  gated_pipeline.ClosePipeline();
+  free_pipeline.ClosePipeline();
+}
+
+void test_async_pipeline_latency_record(const AsyncPipelineConfig &config)
+{
+  // odd values fail in the first block
+  auto check = [](ToyParsingType unit) -> bool { return Cast(unit)->value % 2 == 0; };
+  auto slow  = [](ToyParsingType unit) -> bool {
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    return AddOne(unit);
+  };
+  ToyAsyncPipeline pipeline;
+  pipeline.ConfigPipeline("linear", {pipeline.BuildPipelineBlock(check, "Check"),
+                                     pipeline.BuildPipelineBlock(slow, "Slow"),
+                                     pipeline.BuildPipelineBlock(Twice, "Twice")});
+  pipeline.InitPipeline(config);
+
+  // 1. the record is filled before the future is ready, one record reused for many requests
+  const auto latency = std::make_shared<PipelineLatencyRecord>();
+  for (int i = 0; i < 4; i += 2)
+  {
+    const auto push_time = PipelineLatencyRecord::Clock::now();
+    auto       future    = pipeline.Push("linear", i, false, kPipelineNoDeadline, PRIORITY_NORMAL,
+                                         AsyncCancelToken(), latency);
+    EXPECT_EQ(future.get(), (i + 1) * 2);
+    EXPECT_GE(latency->GetSubmitTime(), push_time);
+    const auto &blocks = latency->GetBlocks();
+    ASSERT_EQ(blocks.size(), 3u);
+    EXPECT_EQ(blocks[0].name, "Check");
+    EXPECT_EQ(blocks[1].name, "Slow");
+    EXPECT_EQ(blocks[2].name, "Twice");
+    int64_t block_ns = 0;
+    for (const auto &block : blocks)
+    {
+      EXPECT_TRUE(block.reached) << "Block " << block.name << " is not recorded";
+      EXPECT_GE(block.queue_wait_ns, 0);
+      EXPECT_GE(block.compute_ns, 0);
+      block_ns += block.queue_wait_ns + block.compute_ns;
+    }
+    EXPECT_GE(blocks[1].compute_ns, 2000000);
+    EXPECT_GE(latency->GetCallbackDelayNs(), 0);
+    EXPECT_GE(latency->GetTotalNs(), block_ns + latency->GetCallbackDelayNs());
+  }
+
+  // 2. the blocks skipped after a failure are not reached
+  auto failed = pipeline.Push("linear", 1, false, kPipelineNoDeadline, PRIORITY_NORMAL,
+                              AsyncCancelToken(), latency);
+  EXPECT_EQ(GetFutureStatus(failed), PackageStatus::FAILED);
+  const auto &blocks = latency->GetBlocks();
+  ASSERT_EQ(blocks.size(), 3u);
+  EXPECT_TRUE(blocks[0].reached);
+  EXPECT_FALSE(blocks[1].reached);
+  EXPECT_FALSE(blocks[2].reached);
+  EXPECT_GE(latency->GetTotalNs(), blocks[0].compute_ns);
+  pipeline.ClosePipeline();
+}
+
+void test_async_pipeline_admission(const AsyncPipelineConfig &config)
+{
+  constexpr int kBurstNum = 16;
+  auto          slow      = [](ToyParsingType unit) -> bool {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    return AddOne(unit);
+  };
+  AsyncPipelineConfig admission_config = config;
+  admission_config.admission_slo_ms    = 14;
+  ToyAsyncPipeline pipeline;
+  pipeline.ConfigPipeline("linear", {pipeline.BuildPipelineBlock(slow, "Slow")});
+  EXPECT_TRUE(pipeline.AdmitRequest("linear", PipelineClock::now() - std::chrono::seconds(1)))
+      << "Uninitialized pipeline rejects requests";
+  pipeline.InitPipeline(admission_config);
+
+  // 1. the service time is measured on the requests admitted into the idle pipeline
+  for (int i = 0; i < 8; ++i)
+  {
+    EXPECT_TRUE(pipeline.AdmitRequest("linear"));
+    EXPECT_EQ(pipeline.Push("linear", i).get(), i + 1);
+    // the package leaves the pipeline right after its future is ready
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_TRUE(pipeline.AdmitRequest("invalid", PipelineClock::now()));
+  EXPECT_FALSE(pipeline.AdmitRequest("linear", PipelineClock::now() - std::chrono::seconds(1)))
+      << "Request missing its deadline is admitted";
+  auto hopeless = pipeline.Push("linear", 0, false, PipelineClock::now());
+  EXPECT_EQ(GetFutureStatus(hopeless), PackageStatus::REJECTED);
+
+  // 2. a burst beyond the SLO is rejected at once instead of blocking the caller, the admitted
+  // requests go through
+  std::vector<std::future<int>> futures;
+  for (int i = 0; i < kBurstNum; ++i)
+  {
+    futures.push_back(pipeline.Push("linear", i));
+  }
+  int rejected = 0;
+  for (int i = 0; i < kBurstNum; ++i)
+  {
+    const auto status = GetFutureStatus(futures[i]);
+    EXPECT_TRUE(status == PackageStatus::SUCCESS || status == PackageStatus::REJECTED)
+        << "Got unexpected status " << status;
+    rejected += status == PackageStatus::REJECTED;
+  }
+  EXPECT_GT(rejected, 0) << "Overloaded pipeline admits all requests";
+  EXPECT_LT(rejected, kBurstNum);
+
+  // 3. the requests pushed with `cover_oldest` are never rejected
+  std::vector<std::future<int>> covering;
+  for (int i = 0; i < kBurstNum; ++i)
+  {
+    covering.push_back(pipeline.Push("linear", i, true));
+  }
+  for (int i = 0; i < kBurstNum; ++i)
+  {
+    EXPECT_NE(GetFutureStatus(covering[i]), PackageStatus::REJECTED);
+  }
+
+  // 4. the SLO may be changed by `Reconfigure` while the requests are being admitted
+  std::atomic<bool> admitting{true};
+  std::thread       admitter([&] {
+    while (admitting.load())
+    {
+      pipeline.AdmitRequest("linear");
+    }
+  });
+  for (int slo_ms : {0, 14, 0, 14, 0})
+  {
+    admission_config.admission_slo_ms = slo_ms;
+    EXPECT_TRUE(pipeline.ReconfigurePipeline("linear", admission_config));
+  }
+  EXPECT_TRUE(pipeline.AdmitRequest("linear", PipelineClock::now() - std::chrono::seconds(1)))
+      << "Admission control is not disabled by `Reconfigure`";
+  admitting.store(false);
+  admitter.join();
+  pipeline.ClosePipeline();
+
+  // 5. admission control is disabled by default
+  pipeline.InitPipeline(config);
+  EXPECT_TRUE(pipeline.AdmitRequest("linear", PipelineClock::now() - std::chrono::seconds(1)));
+  pipeline.ClosePipeline();
+
+  admission_config.admission_slo_ms = -1;
+  EXPECT_THROW(pipeline.InitPipeline(admission_config), std::invalid_argument);
+}
+
+} // namespace easy_deploy
@@ -0,0 +1,449 @@
+#include "test_utils/block_queue_test_utils.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common_utils/block_queue.hpp"
+#include "common_utils/priority_block_queue.hpp"
+#include "common_utils/ring_buffer.hpp"
+#include "common_utils/spsc_queue.hpp"
+
+#include <gtest/gtest.h>
+
+namespace easy_deploy {
+
+namespace {
+
+// long enough for the waiting side to spin out and park
+constexpr std::chrono::milliseconds kParkTime{50};
+
+// the lane of a value is its hundreds digit
+struct ToyLaneOf {
+  size_t operator()(int value) const noexcept
+  {
+    return value / 100;
+  }
+};
+
+using ToyPriorityQueue = PriorityBlockQueue<int, ToyLaneOf>;
+
+// calls back into its queue when destroyed, like a dropped package whose callback pushes again
+struct ToyReentrant {
+  std::function<void()> on_destroy;
+
+  ~ToyReentrant()
+  {
+    on_destroy();
+  }
+};
+
+using ToyReentrantPtr = std::shared_ptr<ToyReentrant>;
+
+struct ToyReentrantLaneOf {
+  size_t operator()(const ToyReentrantPtr &) const noexcept
+  {
+    return 0;
+  }
+};
+
+} // namespace
+
+void test_spsc_queue_correctness()
+{
+  // 1. wraparound, the elements keep their order across the end of the ring
+  {
+    SpscQueue<int> queue(3);
+    EXPECT_EQ(queue.GetMaxSize(), 3u);
+    for (int i = 0; i < 10; ++i)
+    {
+      ASSERT_TRUE(queue.BlockPush(2 * i));
+      ASSERT_TRUE(queue.BlockPush(2 * i + 1));
+      EXPECT_EQ(queue.Size(), 2u);
+      EXPECT_EQ(queue.TryTake(), 2 * i);
+      EXPECT_EQ(queue.Take(), 2 * i + 1);
+      EXPECT_TRUE(queue.Empty());
+    }
+    EXPECT_EQ(queue.TryTake(), std::nullopt);
+  }
+
+  // 2. one producer and one consumer, both of them wait on the small ring
+  {
+    constexpr int  kElementNum = 100000;
+    SpscQueue<int> queue(4);
+    std::thread    producer([&] {
+      for (int i = 0; i < kElementNum; ++i)
+      {
+        queue.BlockPush(i);
+      }
+    });
+    int wrong = 0;
+    for (int i = 0; i < kElementNum; ++i)
+    {
+      auto value = queue.Take();
+      if (!value.has_value() || value.value() != i)
+      {
+        ++wrong;
+      }
+    }
+    producer.join();
+    EXPECT_EQ(wrong, 0) << "Got elements out of order from SpscQueue";
+    EXPECT_TRUE(queue.Empty());
+  }
+
+  // 3. park and unpark, the parked consumer is woken up by a push, the parked producer by a take
+  {
+    SpscQueue<int> queue(1);
+    std::thread    producer([&] {
+      std::this_thread::sleep_for(kParkTime);
+      queue.BlockPush(1);
+      // the queue is full, wait for the consumer
+      queue.BlockPush(2);
+    });
+    EXPECT_EQ(queue.Take(), 1);
+    std::this_thread::sleep_for(kParkTime);
+    EXPECT_EQ(queue.Take(), 2);
+    producer.join();
+  }
+
+  // 4. SetNoMoreInput wakes up the parked consumer once the queue is empty
+  {
+    SpscQueue<int> queue(2);
+    ASSERT_TRUE(queue.BlockPush(1));
+    std::thread notifier([&] {
+      std::this_thread::sleep_for(kParkTime);
+      queue.SetNoMoreInput();
+    });
+    EXPECT_EQ(queue.Take(), 1);
+    EXPECT_EQ(queue.Take(), std::nullopt);
+    notifier.join();
+  }
+
+  // 5. Disable and DisableAndClear wake up both sides, and reject any further push or take
+  {
+    SpscQueue<int> queue(1);
+    ASSERT_TRUE(queue.BlockPush(1));
+    std::thread producer([&] { EXPECT_FALSE(queue.BlockPush(2)); });
+    std::this_thread::sleep_for(kParkTime);
+    queue.DisableAndClear();
+    producer.join();
+    EXPECT_FALSE(queue.BlockPush(3));
+    EXPECT_EQ(queue.Take(), std::nullopt);
+    EXPECT_EQ(queue.TryTake(), std::nullopt);
+
+    SpscQueue<int> empty_queue(1);
+    std::thread    consumer([&] { EXPECT_EQ(empty_queue.Take(), std::nullopt); });
+    std::this_thread::sleep_for(kParkTime);
+    empty_queue.Disable();
+    consumer.join();
+  }
+
+  // 6. the elements cleared by DisableAndClear are destroyed by the next take of the consumer
+  {
+    SpscQueue<std::shared_ptr<int>> queue(4);
+    std::vector<std::weak_ptr<int>> elements;
+    for (int i = 0; i < 3; ++i)
+    {
+      auto element = std::make_shared<int>(i);
+      elements.push_back(element);
+      ASSERT_TRUE(queue.BlockPush(std::move(element)));
+    }
+    queue.DisableAndClear();
+    EXPECT_EQ(queue.TryTake(), std::nullopt);
+    for (const auto &element : elements)
+    {
+      EXPECT_TRUE(element.expired()) << "Cleared element is still alive";
+    }
+
+    // a plain Disable keeps the elements
+    SpscQueue<std::shared_ptr<int>> disabled_queue(4);
+    auto                            element = std::make_shared<int>(0);
+    ASSERT_TRUE(disabled_queue.BlockPush(element));
+    disabled_queue.Disable();
+    EXPECT_EQ(disabled_queue.TryTake(), std::nullopt);
+    EXPECT_EQ(element.use_count(), 2);
+  }
+}
+
+void test_ring_buffer_correctness()
+{
+  RingBuffer<int> buffer(3);
+  EXPECT_EQ(buffer.capacity(), 4u);
+  EXPECT_TRUE(buffer.empty());
+
+  // 1. wraparound without growth
+  for (int i = 0; i < 10; ++i)
+  {
+    buffer.push_back(2 * i);
+    buffer.push_back(2 * i + 1);
+    EXPECT_EQ(buffer.front(), 2 * i);
+    EXPECT_EQ(buffer.back(), 2 * i + 1);
+    buffer.pop_front();
+    buffer.pop_front();
+  }
+  EXPECT_TRUE(buffer.empty());
+  EXPECT_EQ(buffer.capacity(), 4u);
+
+  // 2. growth from a wrapped ring keeps the order
+  buffer.push_back(0);
+  buffer.push_back(1);
+  buffer.pop_front();
+  for (int i = 2; i < 20; ++i)
+  {
+    buffer.push_back(i);
+  }
+  EXPECT_EQ(buffer.size(), 19u);
+  EXPECT_EQ(buffer.capacity(), 32u);
+  EXPECT_EQ(buffer.back(), 19);
+  buffer.pop_back();
+  for (int i = 1; i < 19; ++i)
+  {
+    ASSERT_FALSE(buffer.empty());
+    EXPECT_EQ(buffer.front(), i);
+    buffer.pop_front();
+  }
+  EXPECT_TRUE(buffer.empty());
+
+  // 3. `clear` keeps the capacity
+  buffer.push_back(0);
+  buffer.clear();
+  EXPECT_TRUE(buffer.empty());
+  EXPECT_EQ(buffer.capacity(), 32u);
+}
+
+void test_priority_block_queue_correctness()
+{
+  // 1. the highest lane is served first, each lane keeps FIFO order
+  {
+    ToyPriorityQueue queue(10, 3, std::chrono::seconds(60));
+    EXPECT_EQ(queue.GetLaneNum(), 3u);
+    for (int value : {200, 201, 100, 101, 0, 300})
+    {
+      ASSERT_TRUE(queue.BlockPush(value));
+    }
+    EXPECT_EQ(queue.Size(), 6u);
+    // the lanes out of range go to the last lane
+    for (int value : {0, 100, 101, 200, 201, 300})
+    {
+      EXPECT_EQ(queue.TryTake(), value);
+    }
+    EXPECT_TRUE(queue.Empty());
+  }
+
+  // 2. an element waiting longer than the aging time is served before the higher lanes
+  {
+    ToyPriorityQueue queue(10, 3, std::chrono::milliseconds(10));
+    ASSERT_TRUE(queue.BlockPush(200));
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    ASSERT_TRUE(queue.BlockPush(0));
+    EXPECT_EQ(queue.TryTake(), 200);
+    EXPECT_EQ(queue.TryTake(), 0);
+  }
+
+  // 3. `max_size` bounds the total size, each lane leaves a slot for every higher lane, and
+  // `CoverPush` evicts the oldest of the lowest lane not higher than the new element
+  {
+    ToyPriorityQueue queue(4, 3, std::chrono::seconds(60));
+    EXPECT_EQ(queue.GetMaxSize(), 4u);
+    ASSERT_TRUE(queue.BlockPush(200));
+    ASSERT_TRUE(queue.BlockPush(201));
+    for (int value : {202, 100, 101, 0, 1})
+    {
+      const bool pushed = queue.TryPush(value);
+      EXPECT_EQ(pushed, value == 100 || value == 0) << "Got unexpected push of " << value;
+    }
+    EXPECT_EQ(queue.Size(), 4u);
+
+    std::optional<int> evicted;
+    EXPECT_TRUE(queue.CoverPush(101, &evicted));
+    EXPECT_EQ(evicted, 200);
+    EXPECT_TRUE(queue.CoverPush(1, &evicted));
+    EXPECT_EQ(evicted, 201);
+    // only higher lanes are left, the new element is evicted itself
+    EXPECT_TRUE(queue.CoverPush(202, &evicted));
+    EXPECT_EQ(evicted, 202);
+    EXPECT_EQ(queue.Size(), 4u);
+    for (int value : {100, 101, 0, 1})
+    {
+      EXPECT_EQ(queue.TryTakeLowest(), value);
+    }
+    EXPECT_EQ(queue.TryTakeLowest(), std::nullopt);
+  }
+
+  // 4. `DisableAndClear` wakes up the blocked producer and consumer
+  {
+    ToyPriorityQueue queue(1, 3, std::chrono::seconds(60));
+    ASSERT_TRUE(queue.BlockPush(0));
+    std::thread producer([&] { EXPECT_FALSE(queue.BlockPush(1)); });
+    std::this_thread::sleep_for(kParkTime);
+    queue.DisableAndClear();
+    producer.join();
+    EXPECT_TRUE(queue.Empty());
+    EXPECT_EQ(queue.Take(), std::nullopt);
+  }
+}
+
+void test_block_queue_resize()
+{
+  ToyPriorityQueue priority_queue(4, 3, std::chrono::seconds(60));
+  BlockQueue<int>  block_queue(4);
+  SpscQueue<int>   spsc_queue(4);
+  for (IBlockQueue<int> *queue :
+       std::vector<IBlockQueue<int> *>{&block_queue, &priority_queue, &spsc_queue})
+  {
+    // 1. the elements over the new max size are kept, the pushes fail until it shrinks below
+    for (int i = 0; i < 3; ++i)
+    {
+      ASSERT_TRUE(queue->BlockPush(i));
+    }
+    queue->SetMaxSize(2);
+    EXPECT_EQ(queue->GetMaxSize(), 2u);
+    int value = 3;
+    EXPECT_FALSE(queue->TryPush(value));
+    EXPECT_EQ(queue->Size(), 3u);
+    EXPECT_EQ(queue->TryTake(), 0);
+    EXPECT_EQ(queue->TryTake(), 1);
+    EXPECT_TRUE(queue->TryPush(value));
+
+    // 2. a producer blocked on the full queue goes on once it grows
+    queue->SetMaxSize(0);
+    EXPECT_EQ(queue->GetMaxSize(), 1u);
+    std::atomic<bool> pushed{false};
+    std::thread       producer([&] {
+      EXPECT_TRUE(queue->BlockPush(4));
+      pushed.store(true);
+    });
+    std::this_thread::sleep_for(kParkTime);
+    EXPECT_FALSE(pushed.load());
+    queue->SetMaxSize(4);
+    producer.join();
+    EXPECT_EQ(queue->Size(), 3u);
+    EXPECT_EQ(queue->GetMaxSize(), 4u);
+  }
+
+  // 3. the spsc queue does not grow over its capacity
+  spsc_queue.SetMaxSize(100);
+  EXPECT_EQ(spsc_queue.GetMaxSize(), 4u);
+}
+
+void test_block_queue_push_forwarding()
+{
+  // 1. the forwarding push constructs the element from a convertible argument, and copies an
+  // lvalue without touching it
+  BlockQueue<std::string> string_queue(4);
+  const std::string       kept = "kept";
+  EXPECT_TRUE(string_queue.BlockPush("converted"));
+  EXPECT_TRUE(string_queue.BlockPush(kept));
+  EXPECT_EQ(kept, "kept");
+  EXPECT_EQ(string_queue.TryTake(), "converted");
+  EXPECT_EQ(string_queue.TryTake(), "kept");
+
+  // 2. the move-only elements are pushed directly and through `IBlockQueue`
+  BlockQueue<std::unique_ptr<int>>   unique_queue(4);
+  IBlockQueue<std::unique_ptr<int>> &base_queue = unique_queue;
+  EXPECT_TRUE(unique_queue.BlockPush(std::make_unique<int>(1)));
+  EXPECT_TRUE(base_queue.BlockPush(std::make_unique<int>(2)));
+  EXPECT_EQ(*unique_queue.TryTake().value(), 1);
+  EXPECT_EQ(*base_queue.TryTake().value(), 2);
+  unique_queue.Disable();
+  EXPECT_FALSE(unique_queue.BlockPush(std::make_unique<int>(3)));
+}
+
+void test_block_queue_wait_strategy()
+{
+  ToyPriorityQueue priority_queue(1, 3, std::chrono::seconds(60));
+  BlockQueue<int>  block_queue(1);
+  SpscQueue<int>   spsc_queue(1);
+  for (IBlockQueue<int> *queue :
+       std::vector<IBlockQueue<int> *>{&block_queue, &priority_queue, &spsc_queue})
+  {
+    // the other side comes back after `delay`
+    auto take_after = [&](std::chrono::microseconds delay) {
+      std::thread consumer([&] {
+        std::this_thread::sleep_for(delay);
+        EXPECT_EQ(queue->Take(), 0);
+      });
+      EXPECT_TRUE(queue->BlockPush(0));
+      EXPECT_TRUE(queue->BlockPush(0));
+      consumer.join();
+      EXPECT_EQ(queue->TryTake(), 0);
+    };
+    auto push_after = [&](std::chrono::microseconds delay) {
+      std::thread producer([&] {
+        std::this_thread::sleep_for(delay);
+        EXPECT_TRUE(queue->BlockPush(0));
+      });
+      EXPECT_EQ(queue->Take(), 0);
+      producer.join();
+    };
+
+    // 1. park at once, the waits without a wait are not counted
+    queue->SetWaitStrategy(WaitStrategy::Park());
+    const auto init_stats = queue->GetWaitStats();
+    ASSERT_TRUE(queue->BlockPush(0));
+    EXPECT_EQ(queue->Take(), 0);
+    push_after(kParkTime);
+    take_after(kParkTime);
+    auto stats = queue->GetWaitStats();
+    EXPECT_EQ(stats.consumer.park, init_stats.consumer.park + 1);
+    EXPECT_EQ(stats.producer.park, init_stats.producer.park + 1);
+    EXPECT_EQ(stats.consumer.spin, init_stats.consumer.spin);
+    EXPECT_EQ(stats.producer.spin, init_stats.producer.spin);
+
+    // 2. spin long enough for the other side
+    queue->SetWaitStrategy({1 << 30, 0});
+    push_after(std::chrono::microseconds(100));
+    take_after(std::chrono::microseconds(100));
+    const auto spin_stats = queue->GetWaitStats();
+    EXPECT_EQ(spin_stats.consumer.spin, stats.consumer.spin + 1);
+    EXPECT_EQ(spin_stats.producer.spin, stats.producer.spin + 1);
+    EXPECT_EQ(spin_stats.consumer.park, stats.consumer.park);
+    EXPECT_EQ(spin_stats.producer.park, stats.producer.park);
+  }
+}
+
+void test_block_queue_reentrant_clear()
+{
+  using ReentrantQueue = IBlockQueue<ToyReentrantPtr>;
+  std::vector<std::shared_ptr<ReentrantQueue>> queues{
+      std::make_shared<BlockQueue<ToyReentrantPtr>>(4),
+      std::make_shared<PriorityBlockQueue<ToyReentrantPtr, ToyReentrantLaneOf>>(
+          4, 3, std::chrono::seconds(60))};
+  for (const auto &queue : queues)
+  {
+    auto destroyed = std::make_shared<std::atomic<int>>(0);
+    for (int i = 0; i < 3; ++i)
+    {
+      auto element        = std::make_shared<ToyReentrant>();
+      element->on_destroy = [queue_ptr = queue.get(), destroyed] {
+        EXPECT_FALSE(queue_ptr->BlockPush(ToyReentrantPtr())) << "Push into the cleared queue";
+        EXPECT_EQ(queue_ptr->Size(), 0u);
+        destroyed->fetch_add(1);
+      };
+      ASSERT_TRUE(queue->BlockPush(std::move(element)));
+    }
+    // the clearing thread deadlocks if the elements are destroyed under the lock
+    auto        cleared = std::make_shared<std::promise<void>>();
+    auto        future  = cleared->get_future();
+    std::thread clearer([queue, cleared] {
+      queue->DisableAndClear();
+      cleared->set_value();
+    });
+    if (future.wait_for(std::chrono::seconds(5)) != std::future_status::ready)
+    {
+      clearer.detach();
+      FAIL() << "DisableAndClear deadlocks on a reentrant element";
+    }
+    clearer.join();
+    EXPECT_EQ(destroyed->load(), 3);
+    EXPECT_TRUE(queue->Empty());
+  }
+}
+
+} // namespace easy_deploy
@@ -72,6 +72,93 @@ void test_detection_2d_algorithm_async_correctness(const std::shared_ptr<BaseDet
   ASSERT_TRUE(det_results.size() == expected_obj_num)
       << "Got unexpected obj num, expected : " << expected_obj_num
       << ", but got : " << det_results.size();
+
+  for (auto mode :
+       {PipelineExecutionMode::DEDICATED_THREAD, PipelineExecutionMode::SHARED_EXECUTOR})
+  {
+    AsyncPipelineConfig config;
+    config.execution_mode = mode;
+    model->ClosePipeline();
+    model->InitPipeline(config);
+
+    auto future = model->DetectAsync(test_image, conf_threshold, false);
+    ASSERT_TRUE(future.valid());
+    std::vector<BBox2D> mode_results;
+    EXPECT_NO_THROW(mode_results = future.get());
+    EXPECT_EQ(mode_results.size(), expected_obj_num);
+
+    // callback
+    std::promise<std::pair<PackageStatus, size_t>> callback_promise;
+    auto callback_future = callback_promise.get_future();
+    ASSERT_TRUE(model->DetectAsync(
+        test_image, conf_threshold,
+        AsyncCompletion<std::vector<BBox2D>>(
+            [&](PackageStatus status, std::vector<BBox2D> &&results) {
+              callback_promise.set_value({status, results.size()});
+            }),
+        false));
+    ASSERT_TRUE(callback_future.wait_for(std::chrono::seconds(10)) == std::future_status::ready)
+        << "Timeout waiting for the callback of async detection API";
+    auto callback_result = callback_future.get();
+    EXPECT_EQ(callback_result.first, PackageStatus::SUCCESS);
+    EXPECT_EQ(callback_result.second, expected_obj_num);
+
+    // cancel
+    auto cancel_token = AsyncCancelToken::Create();
+    cancel_token.Cancel();
+    auto cancelled = model->DetectAsync(test_image, conf_threshold, false, false,
+                                        kPipelineNoDeadline, PRIORITY_NORMAL, cancel_token);
+    ASSERT_TRUE(cancelled.valid());
+    try
+    {
+      cancelled.get();
+      ADD_FAILURE() << "Cancelled request is not cancelled";
+    } catch (const AsyncPipelineException &e)
+    {
+      EXPECT_EQ(e.GetStatus(), PackageStatus::CANCELLED);
+    }
+
+    // deadline
+    auto expired = model->DetectAsync(test_image, conf_threshold, false, false,
+                                      PipelineClock::now() - std::chrono::seconds(1));
+    ASSERT_TRUE(expired.valid());
+    try
+    {
+      expired.get();
+      ADD_FAILURE() << "Expired request is not timeout";
+    } catch (const AsyncPipelineException &e)
+    {
+      EXPECT_EQ(e.GetStatus(), PackageStatus::TIMEOUT);
+    }
+
+    // priority
+    for (auto priority : {PRIORITY_HIGH, PRIORITY_LOW})
+    {
+      auto future = model->DetectAsync(test_image, conf_threshold, false, false,
+                                       kPipelineNoDeadline, priority);
+      ASSERT_TRUE(future.valid());
+      std::vector<BBox2D> priority_results;
+      EXPECT_NO_THROW(priority_results = future.get());
+      EXPECT_EQ(priority_results.size(), expected_obj_num);
+    }
+
+    // reject
+    config.admission_slo_ms = 60000;
+    model->ClosePipeline();
+    model->InitPipeline(config);
+    auto rejected = model->DetectAsync(test_image, conf_threshold, false, false,
+                                       PipelineClock::now() - std::chrono::seconds(1));
+    ASSERT_TRUE(rejected.valid());
+    try
+    {
+      rejected.get();
+      ADD_FAILURE() << "Hopeless request is not rejected";
+    } catch (const AsyncPipelineException &e)
+    {
+      EXPECT_EQ(e.GetStatus(), PackageStatus::REJECTED);
+    }
+  }
+  model->ClosePipeline();
 }
 
 } // namespace easy_deploy
@@ -0,0 +1,441 @@
+#include "test_utils/infer_core_test_utils.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace easy_deploy {
+
+namespace {
+
+constexpr size_t kMaxBatchSize  = 4;
+constexpr size_t kSampleSize    = 2;
+constexpr size_t kMemBufferSize = 64;
+
+const std::string kInputBlobName  = "input";
+const std::string kOutputBlobName = "output";
+
+/**
+ * @brief Float tensor on host, the first dimension is the batch dimension.
+ *
+ */
+class ToyTensor : public ITensor {
+public:
+  ToyTensor(const std::string &name, const std::vector<size_t> &shape)
+      : name_(name),
+        default_shape_(shape),
+        shape_(shape),
+        data_(std::accumulate(shape.begin(), shape.end(), size_t(1), std::multiplies<size_t>()))
+  {}
+
+  const std::string &GetName() const noexcept override
+  {
+    return name_;
+  }
+
+  void *RawPtr() override
+  {
+    return data_.data();
+  }
+
+  void SetBufferLocation(DataLocation location) override
+  {
+    location_ = location;
+  }
+
+  void ToLocation(DataLocation) override
+  {}
+
+  DataLocation GetBufferLocation() const noexcept override
+  {
+    return location_;
+  }
+
+  void ZeroCopy(ITensor *tensor) override
+  {
+    DeepCopy(tensor);
+  }
+
+  void DeepCopy(ITensor *tensor) override
+  {
+    data_ = static_cast<ToyTensor *>(tensor)->data_;
+  }
+
+  const std::vector<size_t> &GetDefaultShape() const noexcept override
+  {
+    return default_shape_;
+  }
+
+  const std::vector<size_t> &GetShape() const noexcept override
+  {
+    return shape_;
+  }
+
+  void SetShape(const std::vector<size_t> &shape) override
+  {
+    shape_ = shape;
+  }
+
+  size_t GetBufferMaxByteSize() const noexcept override
+  {
+    return data_.size() * sizeof(float);
+  }
+
+  size_t GetTensorByteSize() const noexcept override
+  {
+    return std::accumulate(shape_.begin(), shape_.end(), size_t(1), std::multiplies<size_t>()) *
+           sizeof(float);
+  }
+
+  size_t GetElementByteSize() const noexcept override
+  {
+    return sizeof(float);
+  }
+
+private:
+  const std::string         name_;
+  const std::vector<size_t> default_shape_;
+  std::vector<size_t>       shape_;
+  std::vector<float>        data_;
+  DataLocation              location_ = DataLocation::HOST;
+};
+
+/**
+ * @brief Inference core computing `output = input * 2 + 1` on every sample of the batch.
+ *
+ */
+class ToyInferCore : public BaseInferCore {
+public:
+  ToyInferCore()
+  {
+    Init(kMemBufferSize);
+  }
+
+  ~ToyInferCore() override
+  {
+    BaseInferCore::Release();
+  }
+
+  std::unique_ptr<BlobsTensor> AllocBlobsBuffer() override
+  {
+    if (alloc_failure_.load())
+    {
+      throw std::runtime_error("toy allocation failure");
+    }
+    std::unordered_map<std::string, std::unique_ptr<ITensor>> tensor_map;
+    tensor_map.emplace(kInputBlobName, std::make_unique<ToyTensor>(
+                                           kInputBlobName, std::vector<size_t>{kMaxBatchSize,
+                                                                               kSampleSize}));
+    tensor_map.emplace(kOutputBlobName, std::make_unique<ToyTensor>(
+                                            kOutputBlobName, std::vector<size_t>{kMaxBatchSize,
+                                                                                 kSampleSize}));
+    return std::make_unique<BlobsTensor>(std::move(tensor_map));
+  }
+
+  size_t GetInferenceCount() const noexcept
+  {
+    return inference_count_.load();
+  }
+
+  // let the allocation of blobs buffers throw
+  void SetAllocFailure(bool alloc_failure) noexcept
+  {
+    alloc_failure_.store(alloc_failure);
+  }
+
+  // max number of inferences running at the same time
+  int GetMaxConcurrency() const noexcept
+  {
+    return max_concurrency_.load();
+  }
+
+  // input of all samples of the last inference
+  std::vector<float> GetLastInput()
+  {
+    std::lock_guard<std::mutex> lk(last_input_mtx_);
+    return last_input_;
+  }
+
+  // initialize the pipeline of the core itself
+  void InitCorePipeline(const AsyncPipelineConfig &config)
+  {
+    InitPipeline(config);
+  }
+
+protected:
+  bool PreProcess(std::shared_ptr<IPipelinePackage>) override
+  {
+    return true;
+  }
+
+  bool Inference(std::shared_ptr<IPipelinePackage> buffer) override
+  {
+    const int concurrency     = running_.fetch_add(1) + 1;
+    int       max_concurrency = max_concurrency_.load();
+    while (concurrency > max_concurrency &&
+           !max_concurrency_.compare_exchange_weak(max_concurrency, concurrency))
+    {
+    }
+    auto blobs_tensor = buffer->GetInferBuffer();
+    auto input        = blobs_tensor->GetTensor(kInputBlobName)->Cast<float>();
+    auto output       = blobs_tensor->GetTensor(kOutputBlobName)->Cast<float>();
+    for (size_t i = 0; i < kMaxBatchSize * kSampleSize; ++i)
+    {
+      output[i] = input[i] * 2 + 1;
+    }
+    {
+      std::lock_guard<std::mutex> lk(last_input_mtx_);
+      last_input_.assign(input, input + kMaxBatchSize * kSampleSize);
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(20));
+    inference_count_.fetch_add(1);
+    running_.fetch_sub(1);
+    return true;
+  }
+
+  bool PostProcess(std::shared_ptr<IPipelinePackage>) override
+  {
+    return true;
+  }
+
+private:
+  std::atomic<size_t> inference_count_{0};
+  std::atomic<int>    running_{0};
+  std::atomic<int>    max_concurrency_{0};
+  std::atomic<bool>   alloc_failure_{false};
+  std::mutex          last_input_mtx_;
+  std::vector<float>  last_input_;
+};
+
+struct ToyInferPackage : public IPipelinePackage {
+  std::shared_ptr<BlobsTensor> infer_buffer;
+  float                        input = 0;
+  std::vector<float>           output;
+
+  BlobsTensor *GetInferBuffer() override
+  {
+    return infer_buffer.get();
+  }
+};
+
+using ToyInferParsingType = std::shared_ptr<IPipelinePackage>;
+
+class ToyInferGenResultType {
+public:
+  std::vector<float> operator()(const ToyInferParsingType &package)
+  {
+    return std::static_pointer_cast<ToyInferPackage>(package)->output;
+  }
+};
+
+/**
+ * @brief Algorithm running the pipeline context of an inference core between its own blocks.
+ *
+ */
+class ToyInferAlgorithm : public BaseAsyncPipeline<std::vector<float>, ToyInferGenResultType> {
+public:
+  explicit ToyInferAlgorithm(const std::shared_ptr<ToyInferCore> &infer_core)
+      : infer_core_(infer_core)
+  {
+    auto preprocess_block  = BuildPipelineBlock(PreProcess, "Toy PreProcess");
+    auto postprocess_block = BuildPipelineBlock(PostProcess, "Toy PostProcess");
+    ConfigPipeline(kPipelineName,
+                   {preprocess_block, infer_core->GetPipelineContext(), postprocess_block});
+  }
+
+  std::future<std::vector<float>> Push(float input)
+  {
+    auto package          = std::make_shared<ToyInferPackage>();
+    package->infer_buffer = infer_core_->GetBuffer(true);
+    package->input        = input;
+    return PushPipeline(kPipelineName, package);
+  }
+
+private:
+  // each package keeps its sample at index 0 of its own blobs buffer
+  static bool PreProcess(ToyInferParsingType unit)
+  {
+    auto package = std::static_pointer_cast<ToyInferPackage>(unit);
+    auto input   = package->infer_buffer->GetTensor(kInputBlobName)->Cast<float>();
+    for (size_t i = 0; i < kSampleSize; ++i)
+    {
+      input[i] = package->input + i;
+    }
+    return true;
+  }
+
+  static bool PostProcess(ToyInferParsingType unit)
+  {
+    auto package = std::static_pointer_cast<ToyInferPackage>(unit);
+    auto output  = package->infer_buffer->GetTensor(kOutputBlobName)->Cast<float>();
+    package->output.assign(output, output + kSampleSize);
+    package->infer_buffer.reset();
+    return true;
+  }
+
+  static constexpr const char *kPipelineName = "ToyInferPipeline";
+
+  std::shared_ptr<ToyInferCore> infer_core_;
+};
+
+void ExpectToyInferResult(std::future<std::vector<float>> &future, float input)
+{
+  ASSERT_TRUE(future.valid()) << "Got invalid future from async pipeline";
+  const auto output = future.get();
+  ASSERT_EQ(output.size(), kSampleSize);
+  for (size_t i = 0; i < kSampleSize; ++i)
+  {
+    EXPECT_FLOAT_EQ(output[i], (input + i) * 2 + 1) << "Got unexpected result of " << input;
+  }
+}
+
+} // namespace
+
+void test_infer_core_dynamic_batching(const AsyncPipelineConfig &config)
+{
+  constexpr int kRequestNum = 32;
+  auto          infer_core  = std::make_shared<ToyInferCore>();
+
+  // 1. a blob whose batch dimension could not hold the batch is rejected
+  EXPECT_THROW(infer_core->EnableDynamicBatching(kMaxBatchSize + 1, 1000), std::invalid_argument);
+
+  ASSERT_TRUE(infer_core->EnableDynamicBatching(kMaxBatchSize, 10000));
+  ToyInferAlgorithm algorithm(infer_core);
+  algorithm.InitPipeline(config);
+
+  // 2. a burst of packages is inferred in full batches, each package gets its own sample back
+  std::vector<std::future<std::vector<float>>> futures;
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    futures.push_back(algorithm.Push(i));
+  }
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    ExpectToyInferResult(futures[i], i);
+  }
+  EXPECT_GE(infer_core->GetInferenceCount(), static_cast<size_t>(kRequestNum / kMaxBatchSize));
+  EXPECT_LT(infer_core->GetInferenceCount(), static_cast<size_t>(kRequestNum))
+      << "The packages are not batched";
+
+  // 3. a partial batch is inferred once `max_wait_us` elapsed, the unused samples are zeroed
+  // instead of the stale ones of the last batch
+  for (int i = 0; i < 4; ++i)
+  {
+    auto future = algorithm.Push(100 + i);
+    ExpectToyInferResult(future, 100 + i);
+    const auto last_input = infer_core->GetLastInput();
+    ASSERT_EQ(last_input.size(), kMaxBatchSize * kSampleSize);
+    EXPECT_FLOAT_EQ(last_input[0], 100 + i);
+    for (size_t j = kSampleSize; j < last_input.size(); ++j)
+    {
+      EXPECT_EQ(last_input[j], 0.f) << "Got stale sample at " << j;
+    }
+  }
+  algorithm.ClosePipeline();
+
+  // 4. the batching is not changed once the pipeline of the core is initialized
+  auto running_core = std::make_shared<ToyInferCore>();
+  running_core->InitCorePipeline(config);
+  EXPECT_FALSE(running_core->EnableDynamicBatching(kMaxBatchSize, 1000));
+}
+
+void test_infer_core_place_buffer_pool()
+{
+  auto infer_core = std::make_shared<ToyInferCore>();
+
+  // 1. the pool is not placed while some buffer is in use
+  auto buffer = infer_core->GetBuffer(false);
+  ASSERT_NE(buffer, nullptr);
+  EXPECT_FALSE(infer_core->PlaceBufferPool({GetAvailableCpus().front()}));
+  buffer.reset();
+
+  // 2. the placed pool serves all its buffers, first-touched and reset
+  ASSERT_TRUE(infer_core->PlaceBufferPool({GetAvailableCpus().front()}));
+  std::vector<std::shared_ptr<BlobsTensor>> buffers;
+  for (size_t i = 0; i < kMemBufferSize; ++i)
+  {
+    buffers.push_back(infer_core->GetBuffer(false));
+    ASSERT_NE(buffers.back(), nullptr) << "Placed pool lost buffers";
+    auto input = buffers.back()->GetTensor(kInputBlobName);
+    EXPECT_EQ(input->GetShape(), input->GetDefaultShape());
+    EXPECT_EQ(input->Cast<float>()[0], 0.f);
+  }
+  EXPECT_EQ(infer_core->GetBuffer(false), nullptr);
+  buffers.clear();
+
+  // 3. the old pool is kept if the placed one fails to allocate
+  infer_core->SetAllocFailure(true);
+  EXPECT_FALSE(infer_core->PlaceBufferPool({GetAvailableCpus().front()}));
+  infer_core->SetAllocFailure(false);
+  for (size_t i = 0; i < kMemBufferSize; ++i)
+  {
+    buffers.push_back(infer_core->GetBuffer(false));
+    ASSERT_NE(buffers.back(), nullptr) << "Old pool is lost";
+  }
+  buffers.clear();
+
+  // 4. the pool is placed on the cpus of the `Inference` block in the placement policy
+  PipelinePlacementPolicy placement;
+  EXPECT_FALSE(infer_core->PlaceBufferPool(placement));
+  placement.block_cpus["BaseInferCore Inference"] = {GetAvailableCpus().front()};
+  EXPECT_TRUE(infer_core->PlaceBufferPool(placement));
+  EXPECT_NE(infer_core->GetBuffer(false), nullptr);
+}
+
+void test_infer_core_shared_inference_stage(const AsyncPipelineConfig &config)
+{
+  constexpr int kRequestNum = 64;
+  auto          infer_core  = std::make_shared<ToyInferCore>();
+  ASSERT_TRUE(infer_core->EnableSharedInferenceStage());
+
+  // the algorithms built on one core run its inference on one worker
+  ToyInferAlgorithm first_algorithm(infer_core);
+  ToyInferAlgorithm second_algorithm(infer_core);
+  first_algorithm.InitPipeline(config);
+  second_algorithm.InitPipeline(config);
+  std::vector<std::future<std::vector<float>>> first_futures;
+  std::vector<std::future<std::vector<float>>> second_futures;
+  std::thread                                  pusher([&] {
+    for (int i = 0; i < kRequestNum; ++i)
+    {
+      second_futures.push_back(second_algorithm.Push(-i));
+    }
+  });
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    first_futures.push_back(first_algorithm.Push(i));
+  }
+  pusher.join();
+  for (int i = 0; i < kRequestNum; ++i)
+  {
+    ExpectToyInferResult(first_futures[i], i);
+    ExpectToyInferResult(second_futures[i], -i);
+  }
+  EXPECT_EQ(infer_core->GetInferenceCount(), static_cast<size_t>(kRequestNum * 2));
+  EXPECT_EQ(infer_core->GetMaxConcurrency(), 1) << "Inference of the algorithms runs concurrently";
+
+  // closing one algorithm leaves the other one served
+  first_algorithm.ClosePipeline();
+  auto future = second_algorithm.Push(7);
+  ExpectToyInferResult(future, 7);
+  second_algorithm.ClosePipeline();
+
+  // the stage is not shared once the pipeline of the core is initialized, or it is batched
+  auto running_core = std::make_shared<ToyInferCore>();
+  running_core->InitCorePipeline(config);
+  EXPECT_FALSE(running_core->EnableSharedInferenceStage());
+  auto batched_core = std::make_shared<ToyInferCore>();
+  ASSERT_TRUE(batched_core->EnableDynamicBatching(kMaxBatchSize, 1000));
+  EXPECT_FALSE(batched_core->EnableSharedInferenceStage());
+}
+
+} // namespace easy_deploy
@@ -97,6 +97,8 @@ OrtInferCore::OrtInferCore(
   func_display_blobs_info(input_blobs_shape);
   func_display_blobs_info(output_blobs_shape);
 
+  // `PreProcess` and `PostProcess` do nothing, remove them from the algorithm pipelines
+  BaseInferCore::SetTrivialStages(true, true);
   BaseInferCore::Init();
 }
 
@@ -113,6 +113,8 @@ RknnInferCore::RknnInferCore(
 
   ResolveModelInformation(map_blob_type);
 
+  // `PostProcess` does nothing, remove it from the algorithm pipelines
+  BaseInferCore::SetTrivialStages(false, true);
   BaseInferCore::Init(mem_buf_size);
 }
 